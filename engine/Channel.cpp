@@ -22,6 +22,48 @@
 #include <string.h>
 #include <stdlib.h>
 
+// Resolution and size of the driver's channel timer wheel
+#define DRIVER_TIMER_TICK 1000000
+#define DRIVER_TIMER_SLOTS 256
+
+// Seconds an idle routing thread waits for calls before exiting
+#define ROUTER_IDLE 30
+
+namespace TelEngine {
+
+// A call waiting for a thread of the routing pool
+class RouteJob : public GenObject
+{
+public:
+    RouteJob(Driver* driver, const String& id, Message* msg);
+    virtual ~RouteJob();
+    void process();
+    static bool route(Driver* driver, const String& id, Message* msg);
+private:
+    void reject();
+    Driver* m_driver;
+    String m_id;
+    Message* m_msg;
+    u_int64_t m_queued;
+};
+
+// A thread of the routing pool
+class RouterWorker : public GenObject, public Thread
+{
+public:
+    RouterWorker();
+    virtual ~RouterWorker();
+    virtual void run();
+    static bool enqueue(Driver* driver, const String& id, Message* msg);
+    static bool congested();
+    static int count;
+    static int idle;
+private:
+    static void makeWorker();
+};
+
+};
+
 using namespace TelEngine;
 
 // Find if a string appears to be an E164 phone number
@@ -67,6 +109,16 @@ static Mutex s_mutex(true,"CallEndpoint");
 static const String s_audioType = "audio";
 static const String s_copyParams = "copyparams";
 
+// Routing thread pool, settings are in the [telephony] section of yate.conf
+static int s_maxRouters = 64;
+static int s_routeQueue = 256;
+static int s_routeWait = 0;
+static bool s_routersCreating = false;
+static int s_routeQueued = 0;
+static Mutex s_routersMutex(false,"CallRouters");
+static Semaphore s_routersWake(0x7fffffff,"CallRouters");
+static ObjList s_routeJobs;
+
 
 CallEndpoint::CallEndpoint(const char* id)
     : m_peer(0), m_id(id), m_mutex(0)
@@ -332,7 +384,7 @@ Channel::Channel(Driver* driver, const char* id, bool outgoing)
     : CallEndpoint(id),
       m_parameters(""), m_driver(driver), m_outgoing(outgoing),
       m_timeout(0), m_maxcall(0), m_maxPDD(0), m_dtmfTime(0),
-      m_toutAns(0), m_dtmfSeq(0), m_answered(false)
+      m_timerTime(0), m_timerSlot(-1), m_toutAns(0), m_dtmfSeq(0), m_answered(false)
 {
     init();
 }
@@ -341,7 +393,7 @@ Channel::Channel(Driver& driver, const char* id, bool outgoing)
     : CallEndpoint(id),
       m_parameters(""), m_driver(&driver), m_outgoing(outgoing),
       m_timeout(0), m_maxcall(0), m_maxPDD(0), m_dtmfTime(0),
-      m_toutAns(0), m_dtmfSeq(0), m_answered(false)
+      m_timerTime(0), m_timerSlot(-1), m_toutAns(0), m_dtmfSeq(0), m_answered(false)
 {
     init();
 }
@@ -426,6 +478,8 @@ void Channel::initChan()
     m_driver->m_total++;
     m_driver->m_chanCount++;
     m_driver->channels().append(this);
+    m_driver->m_chanIndex.append(this)->setDelete(false);
+    m_driver->scheduleTimer(this);
     m_driver->changed();
 }
 
@@ -436,7 +490,15 @@ void Channel::dropChan()
     m_driver->lock();
     if (!m_driver)
 	Debug(DebugFail,"Driver lost in dropChan! [%p]",this);
-    if (m_driver->channels().remove(this,false)) {
+    bool listed = (0 != m_driver->channels().remove(this,false));
+    // the list may have been cleared, scan all the index only if we were listed
+    if (!m_driver->m_chanIndex.remove(this,false,true) && listed)
+	m_driver->m_chanIndex.remove(this,false);
+    if (m_timerSlot >= 0) {
+	m_driver->m_timerWheel[m_timerSlot].remove(this,false);
+	m_timerSlot = -1;
+    }
+    if (listed) {
 	if (m_driver->m_chanCount > 0)
 	    m_driver->m_chanCount--;
 	m_driver->changed();
@@ -502,9 +564,16 @@ void Channel::dispatched(const Message& msg, bool handled)
 
 void Channel::setId(const char* newId)
 {
+    Lock lock(m_driver);
+    // move in the driver's index only if we are already listed
+    ObjList* idx = m_driver ? m_driver->m_chanIndex.find(this,id().hash()) : 0;
+    if (idx)
+	idx->remove(false);
     debugName(0);
     CallEndpoint::setId(newId);
     debugName(id());
+    if (idx)
+	m_driver->m_chanIndex.append(this)->setDelete(false);
 }
 
 Message* Channel::getDisconnect(const char* reason)
@@ -638,15 +707,23 @@ bool Channel::startRouter(Message* msg)
 {
     if (!msg)
 	return false;
-    if (m_driver) {
+    const char* error = "failure";
+    const char* reason = "Internal server error";
+    if (!m_driver)
+	TelEngine::destruct(msg);
+    else if (s_maxRouters > 0) {
+	if (RouterWorker::enqueue(m_driver,id(),msg))
+	    return true;
+	error = "congestion";
+	reason = "Call routing is congested";
+    }
+    else {
 	Router* r = new Router(m_driver,id(),msg);
 	if (r->startup())
 	    return true;
 	delete r;
     }
-    else
-	TelEngine::destruct(msg);
-    callRejected("failure","Internal server error");
+    callRejected(error,reason);
     // dereference and die if the channel is dynamic
     if (m_driver && m_driver->varchan())
 	deref();
@@ -812,6 +889,23 @@ void Channel::checkTimers(Message& msg, const Time& tmr)
 	msgDrop(msg,"postdialdelay");
 }
 
+u_int64_t Channel::nextTimer() const
+{
+    u_int64_t when = m_timeout;
+    if (m_maxcall && (!when || (m_maxcall < when)))
+	when = m_maxcall;
+    if (m_maxPDD && (!when || (m_maxPDD < when)))
+	when = m_maxPDD;
+    return when;
+}
+
+void Channel::scheduleTimers()
+{
+    Driver* drv = m_driver;
+    if (drv)
+	drv->scheduleTimer(this);
+}
+
 bool Channel::callPrerouted(Message& msg, bool handled)
 {
     status("prerouted");
@@ -1278,14 +1372,22 @@ bool Module::filterDebug(const String& item) const
 
 Driver::Driver(const char* name, const char* type)
     : Module(name,type),
-      m_init(false), m_varchan(true),
+      m_init(false), m_varchan(true), m_chanIndex(1021),
       m_routing(0), m_routed(0), m_total(0),
       m_nextid(0), m_timeout(0),
-      m_maxroute(0), m_maxchans(0), m_chanCount(0), m_dtmfDups(false)
+      m_maxroute(0), m_maxchans(0), m_chanCount(0), m_dtmfDups(false),
+      m_timerWheel(new ObjList[DRIVER_TIMER_SLOTS]),
+      m_timerTick(Time::now() / DRIVER_TIMER_TICK),
+      m_routeQueued(0), m_routePooled(0), m_routeWaitTotal(0), m_routeWaitMax(0)
 {
     m_prefix << name << "/";
 }
 
+Driver::~Driver()
+{
+    delete[] m_timerWheel;
+}
+
 void* Driver::getObject(const String& name) const
 {
     if (name == YATOM("Driver"))
@@ -1330,8 +1432,7 @@ bool Driver::isBusy() const
 
 Channel* Driver::find(const String& id) const
 {
-    const ObjList* pos = m_chans.find(id);
-    return pos ? static_cast<Channel*>(pos->get()) : 0;
+    return static_cast<Channel*>(m_chanIndex[id]);
 }
 
 bool Driver::received(Message &msg, int id)
@@ -1343,18 +1444,16 @@ bool Driver::received(Message &msg, int id)
     switch (id) {
 	case Timer:
 	    {
-		// check each channel for timeouts
-		lock();
-		ListIterator iter(m_chans);
+		// check only the channels whose timers expired
 		Time t;
-		for (;;) {
-		    RefPointer<Channel> c = static_cast<Channel*>(iter.get());
-		    unlock();
-		    if (!c)
-			break;
+		ObjList due;
+		lock();
+		expireTimers(due,t);
+		unlock();
+		for (ObjList* l = due.skipNull(); l; l = l->skipNext()) {
+		    Channel* c = static_cast<Channel*>(l->get());
 		    c->checkTimers(msg,t);
-		    c = 0;
-		    lock();
+		    scheduleTimer(c);
 		}
 	    }
 	case Status:
@@ -1488,7 +1587,7 @@ bool Driver::canRoute()
 	return false;
     if (m_maxroute && (m_routing >= m_maxroute))
 	return false;
-    return true;
+    return !RouterWorker::congested();
 }
 
 bool Driver::hasLine(const String& line) const
@@ -1534,6 +1633,9 @@ void Driver::statusParams(String& str)
     str << ",routing=" << m_routing;
     str << ",total=" << m_total;
     str << ",chans=" << m_chanCount;
+    str << ",routequeue=" << m_routeQueued;
+    str << ",routewait=" << (unsigned int)(m_routePooled ? (m_routeWaitTotal / m_routePooled) : 0);
+    str << ",routewaitmax=" << (unsigned int)m_routeWaitMax;
 }
 
 void Driver::statusDetail(String& str)
@@ -1594,6 +1696,10 @@ void Driver::loadLimits()
     maxRoute(Engine::config().getIntValue(YSTRING("telephony"),"maxroute"));
     maxChans(Engine::config().getIntValue(YSTRING("telephony"),"maxchans"));
     dtmfDups(Engine::config().getBoolValue(YSTRING("telephony"),"dtmfdups"));
+    // the routing pool is shared by all drivers
+    s_maxRouters = Engine::config().getIntValue(YSTRING("telephony"),"routers",64,0);
+    s_routeQueue = Engine::config().getIntValue(YSTRING("telephony"),"routequeue",256,0);
+    s_routeWait = Engine::config().getIntValue(YSTRING("telephony"),"routewait",0,0);
 }
 
 unsigned int Driver::nextid()
@@ -1602,6 +1708,68 @@ unsigned int Driver::nextid()
     return ++m_nextid;
 }
 
+// File a channel in the timer wheel if it must be checked earlier than
+//  it is filed for, later times are handled when its slot expires
+void Driver::scheduleTimer(Channel* chan)
+{
+    Lock lock(this);
+    if (chan->m_driver != this)
+	return;
+    u_int64_t when = chan->nextTimer();
+    if (!when)
+	return;
+    if (chan->m_timerSlot >= 0) {
+	if (chan->m_timerTime <= when)
+	    return;
+	m_timerWheel[chan->m_timerSlot].remove(chan,false);
+	chan->m_timerSlot = -1;
+    }
+    // channels not listed yet are filed by initChan()
+    else if (!m_chanIndex.find(chan,chan->id().hash()))
+	return;
+    chan->m_timerTime = when;
+    u_int64_t tick = when / DRIVER_TIMER_TICK;
+    if (tick < m_timerTick)
+	tick = m_timerTick;
+    chan->m_timerSlot = (int)(tick % DRIVER_TIMER_SLOTS);
+    m_timerWheel[chan->m_timerSlot].append(chan)->setDelete(false);
+}
+
+// Collect referenced channels whose timers expired, file again the others
+// Must be called with the driver locked
+void Driver::expireTimers(ObjList& due, u_int64_t time)
+{
+    u_int64_t tick = time / DRIVER_TIMER_TICK;
+    unsigned int slots = DRIVER_TIMER_SLOTS;
+    if (tick - m_timerTick < slots)
+	slots = (unsigned int)(tick - m_timerTick) + 1;
+    ObjList later;
+    for (unsigned int i = 0; i < slots; i++) {
+	ObjList* l = &m_timerWheel[(m_timerTick + i) % DRIVER_TIMER_SLOTS];
+	while (l) {
+	    Channel* c = static_cast<Channel*>(l->get());
+	    // entries due in a later turn of the wheel stay where they are
+	    if (!c || (c->m_timerTime > time)) {
+		l = l->next();
+		continue;
+	    }
+	    c->m_timerSlot = -1;
+	    l->remove(false);
+	    // timers may have been moved later or cleared meanwhile
+	    u_int64_t when = c->nextTimer();
+	    if (when && (when <= time)) {
+		if (c->ref())
+		    due.append(c);
+	    }
+	    else if (when)
+		later.append(c)->setDelete(false);
+	}
+    }
+    m_timerTick = tick;
+    for (ObjList* l = later.skipNull(); l; l = l->skipNext())
+	scheduleTimer(static_cast<Channel*>(l->get()));
+}
+
 
 Router::Router(Driver* driver, const char* id, Message* msg)
     : Thread("Call Router"), m_driver(driver), m_id(id), m_msg(msg)
@@ -1628,87 +1796,155 @@ void Router::run()
 bool Router::route()
 {
     DDebug(m_driver,DebugAll,"Routing thread for '%s' [%p]",m_id.c_str(),this);
+    return RouteJob::route(m_driver,m_id,m_msg);
+}
+
+void Router::cleanup()
+{
+    destruct(m_msg);
+}
+
+
+int RouterWorker::count = 0;
+int RouterWorker::idle = 0;
+
+RouteJob::RouteJob(Driver* driver, const String& id, Message* msg)
+    : m_driver(driver), m_id(id), m_msg(msg), m_queued(Time::now())
+{
+    m_driver->lock();
+    m_driver->m_routing++;
+    m_driver->m_routeQueued++;
+    m_driver->changed();
+    m_driver->unlock();
+}
+
+RouteJob::~RouteJob()
+{
+    TelEngine::destruct(m_msg);
+}
+
+void RouteJob::process()
+{
+    u_int64_t waited = Time::now() - m_queued;
+    m_driver->lock();
+    m_driver->m_routeQueued--;
+    m_driver->unlock();
+    bool ok = false;
+    if (Engine::exiting() || ((s_routeWait > 0) && (waited > 1000 * (u_int64_t)s_routeWait)))
+	reject();
+    else {
+	DDebug(m_driver,DebugAll,"Routing '%s' after %u usec in queue",m_id.c_str(),(unsigned int)waited);
+	ok = route(m_driver,m_id,m_msg);
+    }
+    m_driver->lock();
+    m_driver->m_routing--;
+    if (ok)
+	m_driver->m_routed++;
+    m_driver->m_routePooled++;
+    m_driver->m_routeWaitTotal += waited;
+    if (m_driver->m_routeWaitMax < waited)
+	m_driver->m_routeWaitMax = waited;
+    m_driver->changed();
+    m_driver->unlock();
+}
 
+// Reject a call that waited too long for a routing thread
+void RouteJob::reject()
+{
+    m_driver->lock();
+    RefPointer<Channel> chan = m_driver->find(m_id);
+    m_driver->unlock();
+    if (!chan)
+	return;
+    Debug(m_driver,DebugMild,"Rejecting '%s' that waited too long for routing",m_id.c_str());
+    chan->callRejected("congestion","Call routing is congested",m_msg);
+    if (m_driver->varchan())
+	chan->deref();
+}
+
+// Route a call and start it if successful, the message is not destroyed
+bool RouteJob::route(Driver* driver, const String& id, Message* msg)
+{
     RefPointer<Channel> chan;
-    String tmp(m_msg->getValue(YSTRING("callto")));
+    String tmp(msg->getValue(YSTRING("callto")));
     bool ok = !tmp.null();
     if (ok)
-	m_msg->retValue() = tmp;
+	msg->retValue() = tmp;
     else {
-	if (*m_msg == YSTRING("call.preroute")) {
-	    ok = Engine::dispatch(m_msg);
-	    m_driver->lock();
-	    chan = m_driver->find(m_id);
-	    m_driver->unlock();
+	if (*msg == YSTRING("call.preroute")) {
+	    ok = Engine::dispatch(msg);
+	    driver->lock();
+	    chan = driver->find(id);
+	    driver->unlock();
 	    if (!chan) {
-		Debug(m_driver,DebugInfo,"Connection '%s' vanished while prerouting!",m_id.c_str());
+		Debug(driver,DebugInfo,"Connection '%s' vanished while prerouting!",id.c_str());
 		return false;
 	    }
-	    const String* cp = m_msg->getParam(s_copyParams);
+	    const String* cp = msg->getParam(s_copyParams);
 	    if (!TelEngine::null(cp)) {
 		Channel::paramMutex().lock();
-		chan->parameters().copyParams(*m_msg,*cp);
+		chan->parameters().copyParams(*msg,*cp);
 		Channel::paramMutex().unlock();
 	    }
-	    bool dropCall = ok && ((m_msg->retValue() == YSTRING("-")) || (m_msg->retValue() == YSTRING("error")));
+	    bool dropCall = ok && ((msg->retValue() == YSTRING("-")) || (msg->retValue() == YSTRING("error")));
 	    if (dropCall)
-		chan->callRejected(m_msg->getValue(YSTRING("error"),"unknown"),
-		    m_msg->getValue(YSTRING("reason")),m_msg);
+		chan->callRejected(msg->getValue(YSTRING("error"),"unknown"),
+		    msg->getValue(YSTRING("reason")),msg);
 	    else
-		dropCall = !chan->callPrerouted(*m_msg,ok);
+		dropCall = !chan->callPrerouted(*msg,ok);
 	    if (dropCall) {
 		// get rid of the dynamic chans
-		if (m_driver->varchan())
+		if (driver->varchan())
 		    chan->deref();
 		return false;
 	    }
 	    chan = 0;
-	    *m_msg = "call.route";
-	    m_msg->retValue().clear();
+	    *msg = "call.route";
+	    msg->retValue().clear();
 	}
-	ok = Engine::dispatch(m_msg);
+	ok = Engine::dispatch(msg);
     }
 
-    m_driver->lock();
-    chan = m_driver->find(m_id);
-    m_driver->unlock();
+    driver->lock();
+    chan = driver->find(id);
+    driver->unlock();
 
     if (!chan) {
-	Debug(m_driver,DebugInfo,"Connection '%s' vanished while routing!",m_id.c_str());
+	Debug(driver,DebugInfo,"Connection '%s' vanished while routing!",id.c_str());
 	return false;
     }
     // chan will keep it referenced even if message user data is changed
-    m_msg->userData(chan);
+    msg->userData(chan);
 
     static const char s_noroute[] = "noroute";
     static const char s_looping[] = "looping";
     static const char s_noconn[] = "noconn";
 
-    if (ok && m_msg->retValue().trimSpaces()) {
-	if ((m_msg->retValue() == YSTRING("-")) || (m_msg->retValue() == YSTRING("error")))
-	    chan->callRejected(m_msg->getValue(YSTRING("error"),"unknown"),
-		m_msg->getValue("reason"),m_msg);
-	else if (m_msg->getIntValue(YSTRING("antiloop"),1) <= 0) {
-	    const char* error = m_msg->getValue(YSTRING("error"),s_looping);
-	    chan->callRejected(error,m_msg->getValue(YSTRING("reason"),
-		((s_looping == error) ? "Call is looping" : (const char*)0)),m_msg);
+    if (ok && msg->retValue().trimSpaces()) {
+	if ((msg->retValue() == YSTRING("-")) || (msg->retValue() == YSTRING("error")))
+	    chan->callRejected(msg->getValue(YSTRING("error"),"unknown"),
+		msg->getValue("reason"),msg);
+	else if (msg->getIntValue(YSTRING("antiloop"),1) <= 0) {
+	    const char* error = msg->getValue(YSTRING("error"),s_looping);
+	    chan->callRejected(error,msg->getValue(YSTRING("reason"),
+		((s_looping == error) ? "Call is looping" : (const char*)0)),msg);
 	}
-	else if (chan->callRouted(*m_msg)) {
-	    *m_msg = "call.execute";
-	    m_msg->setParam("callto",m_msg->retValue());
-	    m_msg->clearParam(YSTRING("error"));
-	    m_msg->retValue().clear();
-	    ok = Engine::dispatch(m_msg);
+	else if (chan->callRouted(*msg)) {
+	    *msg = "call.execute";
+	    msg->setParam("callto",msg->retValue());
+	    msg->clearParam(YSTRING("error"));
+	    msg->retValue().clear();
+	    ok = Engine::dispatch(msg);
 	    if (ok)
-		chan->callAccept(*m_msg);
+		chan->callAccept(*msg);
 	    else {
-		const char* error = m_msg->getValue(YSTRING("error"),s_noconn);
-		const char* reason = m_msg->getValue(YSTRING("reason"),
+		const char* error = msg->getValue(YSTRING("error"),s_noconn);
+		const char* reason = msg->getValue(YSTRING("reason"),
 		    ((s_noconn == error) ? "Could not connect to target" : (const char*)0));
 		Message m(s_disconnected);
-		const String* cp = m_msg->getParam(s_copyParams);
+		const String* cp = msg->getParam(s_copyParams);
 		if (!TelEngine::null(cp))
-		    m.copyParams(*m_msg,*cp);
+		    m.copyParams(*msg,*cp);
 		chan->complete(m);
 		m.setParam("error",error);
 		m.setParam("reason",reason);
@@ -1716,25 +1952,120 @@ bool Router::route()
 		m.userData(chan);
 		m.setNotify();
 		if (!Engine::dispatch(m))
-		    chan->callRejected(error,reason,m_msg);
+		    chan->callRejected(error,reason,msg);
 	    }
 	}
     }
     else {
-	const char* error = m_msg->getValue(YSTRING("error"),s_noroute);
-	chan->callRejected(error,m_msg->getValue(YSTRING("reason"),
-	    ((s_noroute == error) ? "No route to call target" : (const char*)0)),m_msg);
+	const char* error = msg->getValue(YSTRING("error"),s_noroute);
+	chan->callRejected(error,msg->getValue(YSTRING("reason"),
+	    ((s_noroute == error) ? "No route to call target" : (const char*)0)),msg);
     }
 
     // dereference again if the channel is dynamic
-    if (m_driver->varchan())
+    if (driver->varchan())
 	chan->deref();
     return ok;
 }
 
-void Router::cleanup()
+
+RouterWorker::RouterWorker()
+    : Thread("Call Router")
 {
-    destruct(m_msg);
+    Lock mylock(s_routersMutex);
+    count++;
+}
+
+RouterWorker::~RouterWorker()
+{
+    Lock mylock(s_routersMutex);
+    count--;
+}
+
+void RouterWorker::run()
+{
+    s_routersMutex.lock();
+    s_routersCreating = false;
+    s_routersMutex.unlock();
+    long maxwait = Thread::idleUsec() * 20;
+    u_int64_t idleSince = 0;
+    for (;;) {
+	s_routersMutex.lock();
+	RouteJob* job = static_cast<RouteJob*>(s_routeJobs.remove(false));
+	if (job)
+	    s_routeQueued--;
+	else {
+	    u_int64_t now = Time::now();
+	    if (!idleSince)
+		idleSince = now;
+	    else if (((now - idleSince) > (1000000 * (u_int64_t)ROUTER_IDLE)) && (count > 1)) {
+		s_routersMutex.unlock();
+		return;
+	    }
+	    idle++;
+	}
+	s_routersMutex.unlock();
+	if (job) {
+	    idleSince = 0;
+	    // keep growing the pool while calls are waiting
+	    makeWorker();
+	    job->process();
+	    TelEngine::destruct(job);
+	}
+	else {
+	    // sleep until a call is queued, wake up now and then to exit
+	    s_routersWake.lock(maxwait);
+	    s_routersMutex.lock();
+	    idle--;
+	    s_routersMutex.unlock();
+	}
+	Thread::check(true);
+    }
+}
+
+// Queue a call for routing, the message is consumed even on failure
+bool RouterWorker::enqueue(Driver* driver, const String& id, Message* msg)
+{
+    if (Engine::exiting()) {
+	Debug(driver,DebugInfo,"Engine is exiting, not routing '%s'",id.c_str());
+	TelEngine::destruct(msg);
+	return false;
+    }
+    if (congested()) {
+	Debug(driver,DebugWarn,"Routing queue is full, refusing '%s'",id.c_str());
+	TelEngine::destruct(msg);
+	return false;
+    }
+    RouteJob* job = new RouteJob(driver,id,msg);
+    s_routersMutex.lock();
+    s_routeJobs.append(job);
+    s_routeQueued++;
+    s_routersMutex.unlock();
+    s_routersWake.unlock();
+    makeWorker();
+    return true;
+}
+
+// Check if routing is saturated and new calls should be refused early
+bool RouterWorker::congested()
+{
+    return (s_maxRouters > 0) && (s_routeQueue > 0) && (s_routeQueued >= s_routeQueue);
+}
+
+// Create a new routing thread if all are busy
+void RouterWorker::makeWorker()
+{
+    Lock mylock(s_routersMutex);
+    if ((s_routeQueued <= idle) || s_routersCreating || (count >= s_maxRouters))
+	return;
+    s_routersCreating = true;
+    mylock.drop();
+    RouterWorker* w = new RouterWorker;
+    if (!w->startup()) {
+	delete w;
+	Lock lck(s_routersMutex);
+	s_routersCreating = false;
+    }
 }
 
 /* vi: set ts=8 sw=4 sts=4 noet: */
@@ -83,19 +83,19 @@ const DataBlock& DataBlock::empty()
 }
 
 DataBlock::DataBlock()
-    : m_data(0), m_length(0)
+    : m_data(0), m_length(0), m_capacity(0)
 {
 }
 
 DataBlock::DataBlock(const DataBlock& value)
     : GenObject(),
-      m_data(0), m_length(0)
+      m_data(0), m_length(0), m_capacity(0)
 {
     assign(value.data(),value.length());
 }
 
 DataBlock::DataBlock(void* value, unsigned int len, bool copyData)
-    : m_data(0), m_length(0)
+    : m_data(0), m_length(0), m_capacity(0)
 {
     assign(value,len,copyData);
 }
@@ -115,6 +115,7 @@ void* DataBlock::getObject(const String& name) const
 void DataBlock::clear(bool deleteData)
 {
     m_length = 0;
+    m_capacity = 0;
     if (m_data) {
 	void *data = m_data;
 	m_data = 0;
@@ -128,6 +129,7 @@ DataBlock& DataBlock::assign(void* value, unsigned int len, bool copyData)
     if ((value != m_data) || (len != m_length)) {
 	void *odata = m_data;
 	m_length = 0;
+	m_capacity = 0;
 	m_data = 0;
 	if (len) {
 	    if (copyData) {
@@ -145,7 +147,7 @@ DataBlock& DataBlock::assign(void* value, unsigned int len, bool copyData)
 	    else
 		m_data = value;
 	    if (m_data)
-		m_length = len;
+		m_length = m_capacity = len;
 	}
 	if (odata && (odata != m_data))
 	    ::free(odata);
@@ -158,7 +160,7 @@ void DataBlock::truncate(unsigned int len)
     if (!len)
 	clear();
     else if (len < m_length)
-	assign(m_data,len);
+	m_length = len;
 }
 
 void DataBlock::cut(int len)
@@ -175,7 +177,86 @@ void DataBlock::cut(int len)
 	return;
     }
 
-    assign(ofs+(char *)m_data,m_length - len);
+    // keep the buffer, cutting from the start just moves the data
+    m_length -= len;
+    if (ofs)
+	::memmove(m_data,ofs+(char *)m_data,m_length);
+}
+
+void DataBlock::reserve(unsigned int len)
+{
+    if (!m_data) {
+	m_capacity = len;
+	return;
+    }
+    if (len <= m_capacity)
+	return;
+    void* data = ::malloc(len);
+    if (!data) {
+	Debug("DataBlock",DebugFail,"malloc(%u) returned NULL!",len);
+	return;
+    }
+    ::memcpy(data,m_data,m_length);
+    void* odata = m_data;
+    m_data = data;
+    m_capacity = len;
+    ::free(odata);
+}
+
+void DataBlock::shrink()
+{
+    if (!m_data) {
+	m_capacity = 0;
+	return;
+    }
+    if (m_capacity > m_length) {
+	void* data = ::realloc(m_data,m_length);
+	if (data) {
+	    m_data = data;
+	    m_capacity = m_length;
+	}
+    }
+}
+
+// Append data keeping room for more, the data may be part of our own buffer
+void DataBlock::appendData(const void* value, unsigned int len)
+{
+    unsigned int total = m_length + len;
+    if (total <= m_capacity) {
+	::memcpy(m_length + (char*)m_data,value,len);
+	m_length = total;
+	return;
+    }
+    unsigned int cap = total + ((total < 64) ? 32 : (total >> 1));
+    void* data = ::malloc(cap);
+    if (!data) {
+	Debug("DataBlock",DebugFail,"malloc(%u) returned NULL!",cap);
+	return;
+    }
+    ::memcpy(data,m_data,m_length);
+    ::memcpy(m_length + (char*)data,value,len);
+    void* odata = m_data;
+    m_data = data;
+    m_length = total;
+    m_capacity = cap;
+    ::free(odata);
+}
+
+// Copy data into an empty block using any reserved length
+void DataBlock::assignData(const void* value, unsigned int len)
+{
+    if (m_capacity <= len) {
+	assign(const_cast<void*>(value),len);
+	return;
+    }
+    void* data = ::malloc(m_capacity);
+    if (!data) {
+	Debug("DataBlock",DebugFail,"malloc(%u) returned NULL!",m_capacity);
+	return;
+    }
+    ::memcpy(data,value,len);
+    m_data = data;
+    m_length = len;
 }
 
 DataBlock& DataBlock::operator=(const DataBlock& value)
@@ -186,40 +267,22 @@ DataBlock& DataBlock::operator=(const DataBlock& value)
 
 void DataBlock::append(const DataBlock& value)
 {
-    if (m_length) {
-	if (value.length()) {
-	    unsigned int len = m_length+value.length();
-	    void *data = ::malloc(len);
-	    if (data) {
-		::memcpy(data,m_data,m_length);
-		::memcpy(m_length+(char*)data,value.data(),value.length());
-		assign(data,len,false);
-	    }
-	    else
-		Debug("DataBlock",DebugFail,"malloc(%d) returned NULL!",len);
-	}
-    }
+    if (!value.length())
+	return;
+    if (m_length)
+	appendData(value.data(),value.length());
     else
-	assign(value.data(),value.length());
+	assignData(value.data(),value.length());
 }
 
 void DataBlock::append(const String& value)
 {
-    if (m_length) {
-	if (value.length()) {
-	    unsigned int len = m_length+value.length();
-	    void *data = ::malloc(len);
-	    if (data) {
-		::memcpy(data,m_data,m_length);
-		::memcpy(m_length+(char*)data,value.safe(),value.length());
-		assign(data,len,false);
-	    }
-	    else
-		Debug("DataBlock",DebugFail,"malloc(%d) returned NULL!",len);
-	}
-    }
+    if (!value.length())
+	return;
+    if (m_length)
+	appendData(value.c_str(),value.length());
     else
-	assign((void*)value.c_str(),value.length());
+	assignData(value.c_str(),value.length());
 }
 
 void DataBlock::insert(const DataBlock& value)
@@ -21,6 +21,14 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 namespace TelEngine {
 
@@ -46,6 +54,8 @@ static const FormatInfo s_formats[] = {
     FormatInfo("g729", 10, 10000),
     FormatInfo("plain", 0, 0, "text", 0),
     FormatInfo("raw", 0, 0, "data", 0),
+    FormatInfo("slin/44100", 882, 10000, "audio", 44100, 1, true),
+    FormatInfo("slin/48000", 960, 10000, "audio", 48000, 1, true),
 };
 
 // FIXME: put proper conversion costs everywhere below
@@ -86,13 +96,28 @@ static TranslatorCaps s_simpleCaps32k[] = {
     { 0, 0, 0 }
 };
 
+// Resampling costs more when the rates have no small common ratio
 static TranslatorCaps s_resampCaps[] = {
     { s_formats+0, s_formats+3, 2 },
     { s_formats+0, s_formats+6, 2 },
+    { s_formats+0, s_formats+20, 4 },
+    { s_formats+0, s_formats+21, 3 },
     { s_formats+3, s_formats+0, 2 },
     { s_formats+3, s_formats+6, 2 },
+    { s_formats+3, s_formats+20, 4 },
+    { s_formats+3, s_formats+21, 3 },
     { s_formats+6, s_formats+0, 2 },
     { s_formats+6, s_formats+3, 2 },
+    { s_formats+6, s_formats+20, 4 },
+    { s_formats+6, s_formats+21, 3 },
+    { s_formats+20, s_formats+0, 4 },
+    { s_formats+20, s_formats+3, 4 },
+    { s_formats+20, s_formats+6, 4 },
+    { s_formats+20, s_formats+21, 4 },
+    { s_formats+21, s_formats+0, 3 },
+    { s_formats+21, s_formats+3, 3 },
+    { s_formats+21, s_formats+6, 3 },
+    { s_formats+21, s_formats+20, 4 },
     { 0, 0, 0 }
 };
 
@@ -136,6 +161,186 @@ private:
     RefPointer<ThreadedSource> m_source;
 };
 
+// Period of the shared media clocks in microseconds
+#define CLOCK_TICK 10000
+// Maximum number of sources ticked by one shared clock
+#define CLOCK_SOURCES 256
+// Time an idle shared clock waits for new sources before exiting
+#define CLOCK_IDLE 5000000
+
+// A source scheduled on a shared media clock
+class MediaClockEntry : public GenObject
+{
+public:
+    inline MediaClockEntry(ThreadedSource* source, u_int64_t interval, u_int64_t next)
+	: m_source(source), m_interval(interval), m_next(next)
+	{ }
+    RefPointer<ThreadedSource> m_source;
+    u_int64_t m_interval;
+    u_int64_t m_next;
+};
+
+// Thread that ticks several cooperative sources on a common schedule
+class MediaClock : public Thread, public GenObject
+{
+public:
+    MediaClock(Thread::Priority prio);
+    void add(ThreadedSource* source, unsigned int msec);
+    inline unsigned int count() const
+	{ return m_count; }
+    inline Thread::Priority prio() const
+	{ return m_prio; }
+    static MediaClock* find(Thread::Priority prio);
+protected:
+    virtual void run();
+    virtual void cleanup();
+private:
+    void drop(ObjList& list);
+    ObjList m_sources;
+    unsigned int m_count;
+    Thread::Priority m_prio;
+};
+
+static Mutex s_clockMutex(false,"MediaClock");
+static ObjList s_clocks;
+
+MediaClock::MediaClock(Thread::Priority prio)
+    : Thread("Media Clock",prio),
+      m_count(0), m_prio(prio)
+{
+    s_clocks.append(this)->setDelete(false);
+}
+
+// Find a clock with room for one more source, create one if needed
+// Must be called with s_clockMutex locked
+MediaClock* MediaClock::find(Thread::Priority prio)
+{
+    for (ObjList* l = s_clocks.skipNull(); l; l = l->skipNext()) {
+	MediaClock* c = static_cast<MediaClock*>(l->get());
+	if ((c->prio() == prio) && (c->count() < CLOCK_SOURCES))
+	    return c;
+    }
+    MediaClock* c = new MediaClock(prio);
+    if (c->startup())
+	return c;
+    s_clocks.remove(c,false);
+    delete c;
+    return 0;
+}
+
+// Add a source, must be called with s_clockMutex locked
+void MediaClock::add(ThreadedSource* source, unsigned int msec)
+{
+    u_int64_t interval = CLOCK_TICK * (u_int64_t)((1000 * msec + CLOCK_TICK - 1) / CLOCK_TICK);
+    if (!interval)
+	interval = CLOCK_TICK;
+    m_sources.append(new MediaClockEntry(source,interval,Time::now()));
+    m_count++;
+}
+
+void MediaClock::run()
+{
+    u_int64_t when = Time::now();
+    u_int64_t idle = 0;
+    unsigned int size = 0;
+    ThreadedSource** due = 0;
+    while (!(Engine::exiting() || Thread::check(false))) {
+	when += CLOCK_TICK;
+	int64_t dly = when - Time::now();
+	if (dly > 0)
+	    Thread::usleep((unsigned long)dly);
+	else if (dly < -(int64_t)(10 * CLOCK_TICK)) {
+	    // fell way behind, don't try to catch up
+	    when = Time::now();
+	}
+	// collect due sources, tick them without holding the lock
+	ObjList gone;
+	unsigned int n = 0;
+	s_clockMutex.lock();
+	if (size < m_count) {
+	    delete[] due;
+	    size = m_count;
+	    due = new ThreadedSource*[size];
+	}
+	for (ObjList* l = m_sources.skipNull(); l; ) {
+	    MediaClockEntry* e = static_cast<MediaClockEntry*>(l->get());
+	    if (e->m_source->m_clock != this) {
+		// stopped or moved elsewhere
+		gone.append(l->remove(false));
+		m_count--;
+		l = l->skipNull();
+		continue;
+	    }
+	    if (e->m_next <= when) {
+		e->m_next += e->m_interval;
+		if (e->m_next <= when)
+		    e->m_next = when + e->m_interval;
+		due[n++] = e->m_source;
+	    }
+	    l = l->skipNext();
+	}
+	if (m_count)
+	    idle = 0;
+	else if (!idle)
+	    idle = when + CLOCK_IDLE;
+	else if (idle < when) {
+	    // remove ourselves from the pool while still holding the lock
+	    s_clocks.remove(this,false);
+	    s_clockMutex.unlock();
+	    drop(gone);
+	    break;
+	}
+	s_clockMutex.unlock();
+	Time t(when);
+	// entries are removed only by this thread so their reference keeps
+	//  the sources alive, taking another one would hide abandoned sources
+	//  from ThreadedSource::looping()
+	for (unsigned int i = 0; i < n; i++) {
+	    ThreadedSource* src = due[i];
+	    if ((src->m_clock == this) && !src->tick(t)) {
+		src->lock();
+		if (src->m_clock == this)
+		    src->m_clock = 0;
+		src->unlock();
+	    }
+	}
+	drop(gone);
+    }
+    delete[] due;
+}
+
+// Clean up all sources still scheduled when the thread ends
+void MediaClock::cleanup()
+{
+    ObjList gone;
+    s_clockMutex.lock();
+    s_clocks.remove(this,false);
+    while (GenObject* o = m_sources.remove(false))
+	gone.append(o);
+    m_count = 0;
+    s_clockMutex.unlock();
+    drop(gone);
+}
+
+// Let sources that left the clock perform their cleanup
+void MediaClock::drop(ObjList& list)
+{
+    while (MediaClockEntry* e = static_cast<MediaClockEntry*>(list.remove(false))) {
+	RefPointer<ThreadedSource> source = e->m_source;
+	delete e;
+	if (!source)
+	    continue;
+	// a source that was already scheduled again elsewhere is left alone
+	source->lock();
+	bool moved = source->m_clock && (source->m_clock != this);
+	if (!moved)
+	    source->m_clock = 0;
+	source->unlock();
+	if (!moved)
+	    source->cleanup();
+    }
+}
+
 // slin/alaw/mulaw converter
 class SimpleTranslator : public DataTranslator
 {
@@ -181,71 +386,194 @@ private:
     DataBlock m_buffer;
 };
 
-// slin basic mono resampler
-class ResampTranslator : public DataTranslator
+// Taps per phase of the resampling filter, multiple of 16
+#define RESAMP_TAPS 32
+// Passband edge as fraction of the lower Nyquist frequency
+#define RESAMP_CUTOFF 0.95
+
+// Compute the dot product of signed linear samples and Q15 coefficients
+static inline int resampDot(const int16_t* x, const int16_t* h, unsigned int n)
+{
+#ifdef __AVX2__
+    __m256i acc = _mm256_setzero_si256();
+    for (unsigned int i = 0; i < n; i += 16)
+	acc = _mm256_add_epi32(acc,_mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(x + i)),
+	    _mm256_loadu_si256((const __m256i*)(h + i))));
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc),_mm256_extracti128_si256(acc,1));
+#elif defined(__SSE2__)
+    __m128i sum = _mm_setzero_si128();
+    for (unsigned int i = 0; i < n; i += 8)
+	sum = _mm_add_epi32(sum,_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(x + i)),
+	    _mm_loadu_si128((const __m128i*)(h + i))));
+#else
+    int sum = 0;
+    for (unsigned int i = 0; i < n; i++)
+	sum += x[i] * h[i];
+    return sum;
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+    sum = _mm_add_epi32(sum,_mm_shuffle_epi32(sum,0x4e));
+    sum = _mm_add_epi32(sum,_mm_shuffle_epi32(sum,0xb1));
+    return _mm_cvtsi128_si32(sum);
+#endif
+}
+
+// Polyphase filter table for a given rate ratio, shared by translators
+class ResampFilter : public RefObject
 {
+public:
+    ResampFilter(unsigned int up, unsigned int down);
+    static ResampFilter* get(int sRate, int dRate);
+    inline unsigned int up() const
+	{ return m_up; }
+    inline unsigned int down() const
+	{ return m_down; }
+    inline unsigned int taps() const
+	{ return m_taps; }
+    inline const int16_t* phase(unsigned int p) const
+	{ return ((const int16_t*)m_coefs.data()) + p * m_taps; }
 private:
-    int m_sRate, m_dRate;
-    short m_last;
+    unsigned int m_up;
+    unsigned int m_down;
+    unsigned int m_taps;
+    DataBlock m_coefs;
+};
+
+static ObjList s_resampFilters;
+static Mutex s_resampMutex(false,"ResampFilter");
+
+// Build a windowed sinc lowpass split in one phase per interpolation step
+ResampFilter::ResampFilter(unsigned int up, unsigned int down)
+    : m_up(up), m_down(down)
+{
+    // downsampling needs longer filters for the same transition band
+    m_taps = RESAMP_TAPS * ((down + up - 1) / up);
+    unsigned int len = m_up * m_taps;
+    double fc = RESAMP_CUTOFF / ((up > down) ? up : down);
+    double mid = (len - 1) / 2.0;
+    m_coefs.assign(0,len * sizeof(int16_t));
+    int16_t* h = (int16_t*)m_coefs.data();
+    double* tmp = new double[m_taps];
+    for (unsigned int p = 0; p < m_up; p++) {
+	double sum = 0;
+	for (unsigned int j = 0; j < m_taps; j++) {
+	    // tap j of phase p is applied to input sample (i - taps + 1 + j)
+	    unsigned int m = p + (m_taps - 1 - j) * m_up;
+	    double x = M_PI * fc * (m - mid);
+	    double v = x ? ::sin(x) / x : 1.0;
+	    // Blackman window
+	    x = 2 * M_PI * m / (len - 1);
+	    v *= 0.42 - 0.5 * ::cos(x) + 0.08 * ::cos(2 * x);
+	    tmp[j] = v;
+	    sum += v;
+	}
+	// each phase gets unity gain at DC
+	for (unsigned int j = 0; j < m_taps; j++) {
+	    long v = ::lrint(32768 * tmp[j] / sum);
+	    *h++ = (v > 32767) ? 32767 : ((v < -32767) ? -32767 : v);
+	}
+    }
+    delete[] tmp;
+}
+
+// Find or build the filter table for a rate ratio
+ResampFilter* ResampFilter::get(int sRate, int dRate)
+{
+    if ((sRate <= 0) || (dRate <= 0))
+	return 0;
+    unsigned int up = dRate;
+    unsigned int down = sRate;
+    for (unsigned int a = up, b = down; ; ) {
+	if (!b) {
+	    up /= a;
+	    down /= a;
+	    break;
+	}
+	unsigned int t = a % b;
+	a = b;
+	b = t;
+    }
+    Lock lock(s_resampMutex);
+    for (ObjList* l = s_resampFilters.skipNull(); l; l = l->skipNext()) {
+	ResampFilter* f = static_cast<ResampFilter*>(l->get());
+	if ((f->up() == up) && (f->down() == down))
+	    return f->ref() ? f : 0;
+    }
+    ResampFilter* f = new ResampFilter(up,down);
+    s_resampFilters.append(f);
+    return f->ref() ? f : 0;
+}
+
+// slin mono polyphase resampler for any rate ratio
+class ResampTranslator : public DataTranslator
+{
 public:
     ResampTranslator(const DataFormat& sFormat, const DataFormat& dFormat)
 	: DataTranslator(sFormat,dFormat),
-	m_sRate(sFormat.sampleRate()), m_dRate(dFormat.sampleRate()), m_last(0)
-	{ }
-    virtual unsigned long Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags)
+	  m_sRate(sFormat.sampleRate()), m_dRate(dFormat.sampleRate()), m_next(0)
 	{
-	    unsigned int n = data.length();
-	    if (!n || (n & 1) || !m_sRate || !m_dRate || !ref())
-		return 0;
-	    unsigned long len = 0;
-	    n /= 2;
-	    DataSource* src = getTransSource();
-	    if (src) {
-		long delta = tStamp - m_timestamp;
-		short* s = (short*) data.data();
-		DataBlock oblock;
-		if (m_dRate > m_sRate) {
-		    int mul = m_dRate / m_sRate;
-		    // linear interpolation between existing samples
-		    delta *= mul;
-		    oblock.assign(0,2*n*mul);
-		    short* d = (short*) oblock.data();
-		    while (n--) {
-			short v = *s++;
-			for (int i = 1; i <= mul; i++)
-			    *d++ = ((m_last * (mul - i)) + (v * i)) / mul;
-			m_last = v;
-		    }
-		}
-		else {
-		    int div = m_sRate / m_dRate;
-		    // average an integer number of samples
-		    delta /= div;
-		    n /= div;
-		    oblock.assign(0,2*n);
-		    short* d = (short*) oblock.data();
-		    while (n--) {
-			int v = 0;
-			for (int i = 0; i < div; i++)
-			    v += *s++;
-			v /= div;
-			// saturate average result
-			if (v > 32767)
-			    v = 32767;
-			if (v < -32767)
-			    v = -32767;
-			*d++ = v;
-		    }
-		}
-		if (src->timeStamp() != invalidStamp())
-		    delta += src->timeStamp();
-		len = src->Forward(oblock, delta, flags);
+	    m_filter = ResampFilter::get(m_sRate,m_dRate);
+	    if (m_filter) {
+		m_filter->deref();
+		m_history.assign(0,(m_filter->taps() - 1) * sizeof(int16_t));
 	    }
-	    deref();
-	    return len;
 	}
+    virtual unsigned long Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags);
+private:
+    int m_sRate, m_dRate;
+    RefPointer<ResampFilter> m_filter;
+    // position of next output sample in 1/up units of input samples
+    unsigned int m_next;
+    DataBlock m_history;
+    DataBlock m_work;
+    DataBlock m_out;
 };
 
+unsigned long ResampTranslator::Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags)
+{
+    unsigned int n = data.length();
+    if (!n || (n & 1) || !m_filter || !ref())
+	return 0;
+    unsigned long len = 0;
+    n /= 2;
+    DataSource* src = getTransSource();
+    if (src) {
+	long delta = (long)(((int64_t)(long)(tStamp - m_timestamp) * m_dRate) / m_sRate);
+	unsigned int up = m_filter->up();
+	unsigned int down = m_filter->down();
+	unsigned int taps = m_filter->taps();
+	// work buffer holds the last taps-1 samples followed by new data
+	unsigned int hist = m_history.length();
+	unsigned int wlen = hist + data.length();
+	if (m_work.length() != wlen)
+	    m_work.assign(0,wlen);
+	int16_t* w = (int16_t*)m_work.data();
+	::memcpy(w,m_history.data(),hist);
+	::memcpy(((char*)w) + hist,data.data(),data.length());
+	unsigned int outs = 0;
+	if (m_next < n * up)
+	    outs = (n * up - m_next + down - 1) / down;
+	if (m_out.length() != outs * sizeof(int16_t))
+	    m_out.assign(0,outs * sizeof(int16_t));
+	int16_t* d = (int16_t*)m_out.data();
+	unsigned int pos = m_next;
+	for (unsigned int i = 0; i < outs; i++) {
+	    // window ends at the input sample at or just before the output time
+	    int v = resampDot(w + pos / up,m_filter->phase(pos % up),taps);
+	    v = (v + 16384) >> 15;
+	    d[i] = (v > 32767) ? 32767 : ((v < -32767) ? -32767 : v);
+	    pos += down;
+	}
+	m_next = pos - n * up;
+	::memcpy(m_history.data(),((char*)w) + data.length(),hist);
+	if (src->timeStamp() != invalidStamp())
+	    delta += src->timeStamp();
+	len = src->Forward(m_out,delta,flags);
+    }
+    deref();
+    return len;
+}
+
 // slin simple mono-stereo converter
 class StereoTranslator : public DataTranslator
 {
@@ -1064,6 +1392,8 @@ void ThreadedSource::destroyed()
 {
     if (m_thread)
 	Debug(DebugFail,"ThreadedSource destroyed holding thread %p [%p]",m_thread,this);
+    if (m_clock)
+	Debug(DebugFail,"ThreadedSource destroyed holding clock %p [%p]",m_clock,this);
     DataSource::destroyed();
 }
 
@@ -1082,9 +1412,32 @@ bool ThreadedSource::start(const char* name, Thread::Priority prio)
     return m_thread->running();
 }
 
+bool ThreadedSource::schedule(unsigned int msec, Thread::Priority prio)
+{
+    Lock mylock(this);
+    if (m_thread)
+	return m_thread->running();
+    if (m_clock)
+	return true;
+    Lock lck(s_clockMutex);
+    MediaClock* clock = MediaClock::find(prio);
+    if (!clock)
+	return false;
+    clock->add(this,msec);
+    m_clock = clock;
+    return true;
+}
+
+bool ThreadedSource::tick(const Time& when)
+{
+    return false;
+}
+
 void ThreadedSource::stop()
 {
     Lock mylock(this);
+    // a shared clock notices the source is gone on its next tick
+    m_clock = 0;
     ThreadedSourcePrivate* tmp = m_thread;
     m_thread = 0;
     if (!tmp || tmp->running())
@@ -1103,13 +1456,15 @@ void ThreadedSource::cleanup()
 
 Thread* ThreadedSource::thread() const
 {
+    if (m_clock)
+	return m_clock;
     return m_thread;
 }
 
 bool ThreadedSource::running() const
 {
     Lock mylock(const_cast<ThreadedSource*>(this));
-    return m_thread && m_thread->running();
+    return m_clock || (m_thread && m_thread->running());
 }
 
 bool ThreadedSource::looping(bool runConsumers) const
@@ -1117,6 +1472,8 @@ bool ThreadedSource::looping(bool runConsumers) const
     Lock mylock(const_cast<ThreadedSource*>(this));
     if ((refcount() <= 1) && !(runConsumers && alive() && m_consumers.count()))
 	return false;
+    if (m_clock)
+	return !m_clock->check(false) && m_clock->isCurrent() && !Engine::exiting();
     return m_thread && !m_thread->check(false) &&
 	m_thread->isCurrent() && !Engine::exiting();
 }
@@ -85,16 +85,22 @@ static int s_childsig = 0;
 
 namespace TelEngine {
 
-class EnginePrivate : public Thread
+class EnginePrivate : public GenObject, public Thread
 {
 public:
-    EnginePrivate()
-	: Thread("Engine Worker")
-	{ count++; }
-    ~EnginePrivate()
-	{ count--; }
+    EnginePrivate();
+    ~EnginePrivate();
     virtual void run();
+    static void makeWorker(bool demand);
+    static void wakeup();
+    static void status(String& str, bool details);
     static int count;
+    static int idle;
+private:
+    unsigned int m_index;
+    u_int64_t m_dispatched;
+    u_int64_t m_waitTotal;
+    u_int64_t m_waitMax;
 };
 
 class EngineCommand : public MessageHandler
@@ -220,13 +226,22 @@ Engine::CallAccept Engine::s_accept = Engine::Accept;
 Engine* Engine::s_self = 0;
 int Engine::s_haltcode = -1;
 int EnginePrivate::count = 0;
+int EnginePrivate::idle = 0;
 static String s_cfgpath(CFG_PATH);
 static String s_usrpath;
 static bool s_createusr = true;
 static bool s_init = false;
 static bool s_dynplugin = false;
 static Engine::PluginMode s_loadMode = Engine::LoadFail;
+static int s_minworkers = 1;
 static int s_maxworkers = 10;
+static int s_idleworker = 60;
+static bool s_creating = false;
+static int s_wakes = 0;
+static unsigned int s_workerIndex = 0;
+static Mutex s_workersMutex(false,"EngineWorkers");
+static Semaphore s_workersWake(0x7fffffff,"EngineWorkers");
+static ObjList s_workers;
 static bool s_debug = true;
 static bool s_capture = CAPTURE_EVENTS;
 static int s_maxevents = 25;
@@ -420,7 +435,7 @@ bool EngineStatusHandler::received(Message &msg)
     msg.retValue() << ",lastsignal=" << s_childsig;
 #endif
     msg.retValue() << ",threads=" << Thread::count();
-    msg.retValue() << ",workers=" << EnginePrivate::count;
+    EnginePrivate::status(msg.retValue(),false);
     msg.retValue() << ",mutexes=" << Mutex::count();
     int locks = Mutex::locks();
     if (locks >= 0)
@@ -429,6 +444,7 @@ bool EngineStatusHandler::received(Message &msg)
     locks = Semaphore::locks();
     if (locks >= 0)
 	msg.retValue() << ",waiting=" << locks;
+    msg.retValue() << ",debugdropped=" << Debugger::dropped();
     msg.retValue() << ",acceptcalls=" << lookup(Engine::accept(),Engine::getCallAcceptStates());
     if (msg.getBoolValue("details",true)) {
 	NamedIterator iter(Engine::runParams());
@@ -439,6 +455,7 @@ bool EngineStatusHandler::received(Message &msg)
 	    msg.retValue() << sep << p->name() << "=" << *p;
 	    sep = ',';
 	}
+	EnginePrivate::status(msg.retValue(),true);
     }
     msg.retValue() << "\r\n";
     return false;
@@ -776,12 +793,140 @@ bool EngineHelp::received(Message &msg)
 }
 
 
+EnginePrivate::EnginePrivate()
+    : Thread("Engine Worker"),
+      m_index(0), m_dispatched(0), m_waitTotal(0), m_waitMax(0)
+{
+    Lock mylock(s_workersMutex);
+    count++;
+    m_index = ++s_workerIndex;
+    s_workers.append(this)->setDelete(false);
+}
+
+EnginePrivate::~EnginePrivate()
+{
+    Lock mylock(s_workersMutex);
+    count--;
+    s_workers.remove(this,false);
+}
+
 void EnginePrivate::run()
 {
+    s_creating = false;
+    long maxwait = Thread::idleUsec() * 20;
+    u_int64_t idleSince = Time::now();
     for (;;) {
-	s_makeworker = false;
-	Engine::self()->m_dispatcher.dequeue();
-	Thread::idle(true);
+	u_int64_t waited = 0;
+	if (Engine::self()->m_dispatcher.dequeueOne(waited)) {
+	    s_workersMutex.lock();
+	    m_dispatched++;
+	    m_waitTotal += waited;
+	    if (m_waitMax < waited)
+		m_waitMax = waited;
+	    s_workersMutex.unlock();
+	    idleSince = 0;
+	    Thread::check(true);
+	    continue;
+	}
+	u_int64_t now = Time::now();
+	if (!idleSince)
+	    idleSince = now;
+	else if (s_idleworker > 0 && (now - idleSince) > (1000000 * (u_int64_t)s_idleworker)) {
+	    // idle for too long - exit if we have more workers than needed
+	    Lock mylock(s_workersMutex);
+	    if (count > s_minworkers && !s_creating) {
+		Debug(DebugInfo,"Stopping idle message dispatching thread #%u (%d running)",
+		    m_index,count);
+		return;
+	    }
+	    idleSince = now;
+	}
+	s_workersMutex.lock();
+	idle++;
+	s_workersMutex.unlock();
+	// sleep until a message is enqueued, wake up now and then to exit
+	//  but don't miss one enqueued before we were counted as idle
+	bool woken = !Engine::self()->m_dispatcher.messageCount() &&
+	    s_workersWake.lock(maxwait);
+	s_workersMutex.lock();
+	idle--;
+	if (woken && s_wakes > 0)
+	    s_wakes--;
+	s_workersMutex.unlock();
+	Thread::check(true);
+    }
+}
+
+// Create a new message dispatching thread if required
+void EnginePrivate::makeWorker(bool demand)
+{
+    Lock mylock(s_workersMutex);
+    if (s_creating || (count >= s_maxworkers))
+	return;
+    if (demand) {
+	// grow only after the first worker is running and all others are busy
+	if (idle || !count)
+	    return;
+    }
+    else if (count >= s_minworkers)
+	return;
+    s_creating = true;
+    int running = count;
+    mylock.drop();
+    if (demand)
+	Alarm("engine","performance",(running < 4) ? DebugMild : DebugWarn,
+	    "Creating new message dispatching thread (%d running)",running);
+    else
+	Debug(DebugInfo,"Creating message dispatching thread (%d running)",running);
+    EnginePrivate *prv = new EnginePrivate;
+    if (!prv->startup()) {
+	delete prv;
+	s_creating = false;
+    }
+}
+
+// Wake up an idle worker or create a new one if all are busy
+void EnginePrivate::wakeup()
+{
+    Lock mylock(s_workersMutex);
+    if (idle > s_wakes) {
+	// post only for idle workers not already woken up
+	s_wakes++;
+	s_workersWake.unlock();
+	return;
+    }
+    bool grow = !(idle || s_creating) && (count < s_maxworkers);
+    mylock.drop();
+    if (grow)
+	makeWorker(true);
+}
+
+void EnginePrivate::status(String& str, bool details)
+{
+    Lock mylock(s_workersMutex);
+    if (!details) {
+	u_int64_t dispatched = 0;
+	u_int64_t waitTotal = 0;
+	u_int64_t waitMax = 0;
+	for (ObjList* o = s_workers.skipNull(); o; o = o->skipNext()) {
+	    const EnginePrivate* w = static_cast<const EnginePrivate*>(o->get());
+	    dispatched += w->m_dispatched;
+	    waitTotal += w->m_waitTotal;
+	    if (waitMax < w->m_waitMax)
+		waitMax = w->m_waitMax;
+	}
+	str << ",workers=" << count << ",idleworkers=" << idle;
+	str << ",dispatched=" << dispatched;
+	str << ",queuewait=" << (dispatched ? (waitTotal / dispatched) : 0);
+	str << ",queuewaitmax=" << waitMax;
+	return;
+    }
+    // per worker details: dispatched messages, average and maximum queue wait
+    for (ObjList* o = s_workers.skipNull(); o; o = o->skipNext()) {
+	const EnginePrivate* w = static_cast<const EnginePrivate*>(o->get());
+	str << ",worker" << w->m_index << "=" << w->m_dispatched << "|";
+	str << (w->m_dispatched ? (w->m_waitTotal / w->m_dispatched) : 0);
+	str << "|" << w->m_waitMax;
     }
 }
 
@@ -1350,10 +1495,15 @@ int Engine::engineInit()
     const char *modPath = s_cfg.getValue("general","modpath");
     if (modPath)
 	s_modpath = modPath;
-    s_maxworkers = s_cfg.getIntValue("general","maxworkers",s_maxworkers);
+    s_maxworkers = s_cfg.getIntValue("general","maxworkers",s_maxworkers,1);
+    s_minworkers = s_cfg.getIntValue("general","minworkers",s_minworkers,1,s_maxworkers);
+    s_idleworker = s_cfg.getIntValue("general","idleworker",s_idleworker);
     s_maxevents = s_cfg.getIntValue("general","maxevents",s_maxevents);
     s_restarts = s_cfg.getIntValue("general","restarts");
     m_dispatcher.warnTime(1000*(u_int64_t)s_cfg.getIntValue("general","warntime"));
+    int dbgBuf = s_cfg.getIntValue("general","debugbuffer",0,0,16384);
+    if (dbgBuf && !Debugger::setAsync(1024 * dbgBuf))
+	Debug(DebugWarn,"Asynchronous debug output is not available");
     extraPath(clientMode() ? "client" : "server");
     extraPath(s_cfg.getValue("general","extrapath"));
 
@@ -1377,6 +1527,7 @@ int Engine::engineInit()
 #ifndef _WINDOWS
     s_params.addParam("lastsignal",String(s_childsig));
 #endif
+    s_params.addParam("minworkers",String(s_minworkers));
     s_params.addParam("maxworkers",String(s_maxworkers));
     s_params.addParam("maxevents",String(s_maxevents));
     if (track)
@@ -1498,16 +1649,9 @@ int Engine::run()
 	    CapturedEvent::capturing(false);
 	}
 
-	// Create worker thread if we didn't hear about any of them in a while
-	if (s_makeworker && (EnginePrivate::count < s_maxworkers)) {
-	    if (EnginePrivate::count)
-		Alarm("engine","performance",(EnginePrivate::count < 4) ? DebugMild : DebugWarn,
-		    "Creating new message dispatching thread (%d running)",EnginePrivate::count);
-	    else
-		Debug(DebugInfo,"Creating first message dispatching thread");
-	    EnginePrivate *prv = new EnginePrivate;
-	    prv->startup();
-	}
+	// Create the minimum number of worker threads, more are created on demand
+	if (s_makeworker)
+	    EnginePrivate::makeWorker(false);
 	else
 	    s_makeworker = true;
 
@@ -1566,6 +1710,8 @@ int Engine::engineCleanup()
     checkPoint();
     // We are occasionally doing things that can cause crashes so don't abort
     abortOnBug(s_sigabrt && s_lateabrt);
+    // Write all queued debug messages before the writer thread gets killed
+    Debugger::setAsync(0);
     Thread::killall();
     checkPoint();
     m_dispatcher.dequeue();
@@ -1905,7 +2051,10 @@ bool Engine::enqueue(Message* msg, bool skipHooks)
 	    return true;
 	}
     }
-    return s_self ? s_self->m_dispatcher.enqueue(msg) : false;
+    if (!(s_self && s_self->m_dispatcher.enqueue(msg)))
+	return false;
+    EnginePrivate::wakeup();
+    return true;
 }
 
 bool Engine::dispatch(Message* msg)
@@ -35,9 +35,50 @@ private:
     RefPointer<MessageQueue> m_queue;
 };
 
+// Handlers for a message name, wildcard ones merged, in priority order
+class MessageHandlerList : public String
+{
+public:
+    inline MessageHandlerList(const char* name)
+	: String(name), m_handlers(0), m_count(0), m_size(0)
+	{ }
+    inline ~MessageHandlerList()
+	{ delete[] m_handlers; }
+    inline unsigned int count() const
+	{ return m_count; }
+    inline MessageHandler* at(unsigned int index) const
+	{ return (index < m_count) ? m_handlers[index] : 0; }
+    inline void reserve(unsigned int count = 1)
+	{ m_size += count; }
+    void append(MessageHandler* handler);
+    unsigned int resume(const Message& msg, const MessageHandler* handler, unsigned int priority) const;
+private:
+    MessageHandler** m_handlers;
+    unsigned int m_count;
+    unsigned int m_size;
+};
+
+// Immutable snapshot of the handlers installed in a dispatcher
+class TelEngine::MessageHandlerIndex : public RefObject
+{
+public:
+    MessageHandlerIndex(const ObjList& handlers, unsigned int changes);
+    inline unsigned int changes() const
+	{ return m_changes; }
+    inline const MessageHandlerList& find(const String& name) const
+	{
+	    const MessageHandlerList* lst = static_cast<const MessageHandlerList*>(m_names[name]);
+	    return lst ? *lst : m_wildcard;
+	}
+private:
+    HashList m_names;
+    MessageHandlerList m_wildcard;
+    unsigned int m_changes;
+};
+
 Message::Message(const char* name, const char* retval, bool broadcast)
     : NamedList(name),
-      m_return(retval), m_data(0), m_notify(false), m_broadcast(broadcast)
+      m_return(retval), m_data(0), m_notify(false), m_broadcast(broadcast), m_queued(0)
 {
     XDebug(DebugAll,"Message::Message(\"%s\",\"%s\",%s) [%p]",
 	name,retval,String::boolText(broadcast),this);
@@ -46,7 +87,7 @@ Message::Message(const char* name, const char* retval, bool broadcast)
 Message::Message(const Message& original)
     : NamedList(original),
       m_return(original.retValue()), m_time(original.msgTime()),
-      m_data(0), m_notify(false), m_broadcast(original.broadcast())
+      m_data(0), m_notify(false), m_broadcast(original.broadcast()), m_queued(0)
 {
     XDebug(DebugAll,"Message::Message(&%p) [%p]",&original,this);
 }
@@ -54,7 +95,7 @@ Message::Message(const Message& original)
 Message::Message(const Message& original, bool broadcast)
     : NamedList(original),
       m_return(original.retValue()), m_time(original.msgTime()),
-      m_data(0), m_notify(false), m_broadcast(broadcast)
+      m_data(0), m_notify(false), m_broadcast(broadcast), m_queued(0)
 {
     XDebug(DebugAll,"Message::Message(&%p,%s) [%p]",
 	&original,String::boolText(broadcast),this);
@@ -294,11 +335,85 @@ bool MessageRelay::receivedInternal(Message& msg)
 }
 
 
+void MessageHandlerList::append(MessageHandler* handler)
+{
+    if (!m_handlers)
+	m_handlers = new MessageHandler*[m_size];
+    if (m_count < m_size)
+	m_handlers[m_count++] = handler;
+}
+
+// Find where to continue dispatching after the handler list has changed
+unsigned int MessageHandlerList::resume(const Message& msg, const MessageHandler* handler,
+    unsigned int priority) const
+{
+    for (unsigned int i = 0; i < m_count; i++) {
+	MessageHandler* h = m_handlers[i];
+	if (h == handler)
+	    // exact match - silently continue where we left
+	    return i + 1;
+	// gone past last handler priority - continue with this one
+	if ((h->priority() > priority) || ((h->priority() == priority) && (h > handler))) {
+	    Debug(DebugAll,"Handler list for '%s' [%p] changed, skipping from %p (%u) to %p (%u)",
+		msg.c_str(),&msg,handler,priority,h,h->priority());
+	    return i;
+	}
+    }
+    return m_count;
+}
+
+
+MessageHandlerIndex::MessageHandlerIndex(const ObjList& handlers, unsigned int changes)
+    : m_names(251), m_wildcard(""), m_changes(changes)
+{
+    // first pass - create one list for each name and count handlers
+    unsigned int wildcards = 0;
+    ObjList* l = handlers.skipNull();
+    for (; l; l = l->skipNext()) {
+	MessageHandler* h = static_cast<MessageHandler*>(l->get());
+	if (h->null()) {
+	    wildcards++;
+	    continue;
+	}
+	MessageHandlerList* lst = static_cast<MessageHandlerList*>(m_names[*h]);
+	if (!lst) {
+	    lst = new MessageHandlerList(*h);
+	    m_names.append(lst);
+	}
+	lst->reserve();
+    }
+    m_wildcard.reserve(wildcards);
+    for (unsigned int n = 0; n < m_names.length(); n++) {
+	for (l = m_names.getList(n); l; l = l->next()) {
+	    MessageHandlerList* lst = static_cast<MessageHandlerList*>(l->get());
+	    if (lst)
+		lst->reserve(wildcards);
+	}
+    }
+    // second pass - fill the lists keeping the priority order
+    for (l = handlers.skipNull(); l; l = l->skipNext()) {
+	MessageHandler* h = static_cast<MessageHandler*>(l->get());
+	if (!h->null()) {
+	    static_cast<MessageHandlerList*>(m_names[*h])->append(h);
+	    continue;
+	}
+	m_wildcard.append(h);
+	for (unsigned int n = 0; n < m_names.length(); n++) {
+	    for (ObjList* o = m_names.getList(n); o; o = o->next()) {
+		MessageHandlerList* lst = static_cast<MessageHandlerList*>(o->get());
+		if (lst)
+		    lst->append(h);
+	    }
+	}
+    }
+}
+
+
 MessageDispatcher::MessageDispatcher(const char* trackParam)
     : Mutex(false,"MessageDispatcher"),
-      m_hookMutex(false,"PostHooks"),
-      m_msgAppend(&m_messages), m_hookAppend(&m_hooks),
-      m_trackParam(trackParam), m_changes(0), m_warnTime(0),
+      m_hookMutex(false,"PostHooks"), m_msgMutex(false,"DispatchQueue"),
+      m_msgAppend(&m_messages), m_hookAppend(&m_hooks), m_index(0),
+      m_trackParam(trackParam), m_changes(0), m_msgCount(0), m_warnTime(0),
       m_hookCount(0), m_hookHole(false)
 {
     XDebug(DebugInfo,"MessageDispatcher::MessageDispatcher('%s') [%p]",trackParam,this);
@@ -309,6 +424,7 @@ MessageDispatcher::~MessageDispatcher()
     XDebug(DebugInfo,"MessageDispatcher::~MessageDispatcher() [%p]",this);
     lock();
     clear();
+    TelEngine::destruct(m_index);
     unlock();
 }
 
@@ -384,72 +500,66 @@ bool MessageDispatcher::dispatch(Message& msg)
     u_int64_t t = m_warnTime ? Time::now() : 0;
 
     bool retv = false;
-    ObjList *l = &m_handlers;
     Lock mylock(this);
-    for (; l; l=l->next()) {
-	MessageHandler *h = static_cast<MessageHandler*>(l->get());
-	if (h && (h->null() || *h == msg)) {
-	    if (h->filter() && (*(h->filter()) != msg.getValue(h->filter()->name())))
-		continue;
-	    unsigned int c = m_changes;
-	    unsigned int p = h->priority();
-	    if (trackParam() && h->trackName()) {
-		NamedString* tracked = msg.getParam(trackParam());
-		if (tracked)
-		    tracked->append(h->trackName(),",");
-		else
-		    msg.addParam(trackParam(),h->trackName());
-	    }
-	    // mark handler as unsafe to destroy / uninstall
-	    h->m_unsafe++;
-	    mylock.drop();
-
-	    u_int64_t tm = m_warnTime ? Time::now() : 0;
-
-	    retv = h->receivedInternal(msg) || retv;
-
-	    if (tm) {
-		tm = Time::now() - tm;
-		if (tm > m_warnTime) {
-		    mylock.acquire(this);
-		    const char* name = (c == m_changes) ? h->trackName().c_str() : 0;
-		    Debug(DebugInfo,"Message '%s' [%p] passed through %p%s%s%s in " FMT64U " usec",
-			msg.c_str(),&msg,h,
-			(name ? " '" : ""),(name ? name : ""),(name ? "'" : ""),tm);
-		}
+    RefPointer<MessageHandlerIndex> index = handlerIndex();
+    mylock.drop();
+    // only handlers for this name and wildcard ones are visited
+    const MessageHandlerList* handlers = &index->find(msg);
+    unsigned int hash = msg.hash();
+    MessageHandler* last = 0;
+    unsigned int prio = 0;
+    for (unsigned int i = 0; ; i++) {
+	mylock.acquire(this);
+	if ((index->changes() != m_changes) || (hash != msg.hash())) {
+	    // the handler list or message name has changed - find again
+	    index = handlerIndex();
+	    handlers = &index->find(msg);
+	    hash = msg.hash();
+	    i = 0;
+	    if (last) {
+		NDebug(DebugAll,"Rescanning handler list for '%s' [%p] at priority %u",
+		    msg.c_str(),&msg,prio);
+		i = handlers->resume(msg,last,prio);
 	    }
-
-	    if (retv && !msg.broadcast())
-		break;
-	    mylock.acquire(this);
-	    if (c == m_changes)
-		continue;
-	    // the handler list has changed - find again
-	    NDebug(DebugAll,"Rescanning handler list for '%s' [%p] at priority %u",
-		msg.c_str(),&msg,p);
-	    ObjList* l2 = &m_handlers;
-	    for (l = l2; l; l=l->next()) {
-		MessageHandler *mh = static_cast<MessageHandler*>(l->get());
-		if (!mh)
-		    continue;
-		if (mh == h)
-		    // exact match - silently continue where we left
-		    break;
-
-		// gone past last handler priority - exit with last handler
-		if ((mh->priority() > p) || ((mh->priority() == p) && (mh > h))) {
-		    Debug(DebugAll,"Handler list for '%s' [%p] changed, skipping from %p (%u) to %p (%u)",
-			msg.c_str(),&msg,h,p,mh,mh->priority());
-		    // l will advance in the outer for loop so use previous
-		    l = l2;
-		    break;
-		}
-		l2 = l;
+	}
+	MessageHandler* h = handlers->at(i);
+	if (!h)
+	    break;
+	if (h->filter() && (*(h->filter()) != msg.getValue(h->filter()->name())))
+	    continue;
+	unsigned int c = m_changes;
+	prio = h->priority();
+	last = h;
+	if (trackParam() && h->trackName()) {
+	    NamedString* tracked = msg.getParam(trackParam());
+	    if (tracked)
+		tracked->append(h->trackName(),",");
+	    else
+		msg.addParam(trackParam(),h->trackName());
+	}
+	// mark handler as unsafe to destroy / uninstall
+	h->m_unsafe++;
+	mylock.drop();
+
+	u_int64_t tm = m_warnTime ? Time::now() : 0;
+
+	retv = h->receivedInternal(msg) || retv;
+
+	if (tm) {
+	    tm = Time::now() - tm;
+	    if (tm > m_warnTime) {
+		mylock.acquire(this);
+		const char* name = (c == m_changes) ? h->trackName().c_str() : 0;
+		Debug(DebugInfo,"Message '%s' [%p] passed through %p%s%s%s in " FMT64U " usec",
+		    msg.c_str(),&msg,h,
+		    (name ? " '" : ""),(name ? name : ""),(name ? "'" : ""),tm);
 	    }
-	    if (!l)
-		break;
 	}
+
+	if (retv && !msg.broadcast())
+	    break;
     }
+    index = 0;
     mylock.drop();
     msg.dispatched(retv);
 
@@ -472,7 +582,7 @@ bool MessageDispatcher::dispatch(Message& msg)
     m_hookMutex.lock();
     if (m_hookHole && !m_hookCount) {
 	// compact the list, remove the holes
-	for (l = &m_hooks; l; l = l->next()) {
+	for (ObjList* l = &m_hooks; l; l = l->next()) {
 	    while (!l->get()) {
 		if (!l->next())
 		    break;
@@ -484,7 +594,7 @@ bool MessageDispatcher::dispatch(Message& msg)
 	m_hookHole = false;
     }
     m_hookCount++;
-    for (l = m_hooks.skipNull(); l; l = l->skipNext()) {
+    for (ObjList* l = m_hooks.skipNull(); l; l = l->skipNext()) {
 	RefPointer<MessagePostHook> ph = static_cast<MessagePostHook*>(l->get());
 	if (ph) {
 	    m_hookMutex.unlock();
@@ -499,24 +609,51 @@ bool MessageDispatcher::dispatch(Message& msg)
     return retv;
 }
 
+// Retrieve the handler index, rebuild it if handlers changed, must be called locked
+MessageHandlerIndex* MessageDispatcher::handlerIndex()
+{
+    if (!m_index || (m_index->changes() != m_changes)) {
+	TelEngine::destruct(m_index);
+	m_index = new MessageHandlerIndex(m_handlers,m_changes);
+    }
+    return m_index;
+}
+
 bool MessageDispatcher::enqueue(Message* msg)
 {
-    Lock lock(this);
-    if (!msg || m_messages.find(msg))
+    if (!msg)
+	return false;
+    Lock lock(m_msgMutex);
+    // the queued flag replaces searching the whole queue for the message
+    if (msg->m_queued)
 	return false;
+    msg->m_queued = Time::now();
     m_msgAppend = m_msgAppend->append(msg);
+    m_msgCount++;
     return true;
 }
 
 bool MessageDispatcher::dequeueOne()
 {
-    lock();
+    u_int64_t waited;
+    return dequeueOne(waited);
+}
+
+bool MessageDispatcher::dequeueOne(u_int64_t& waited)
+{
+    m_msgMutex.lock();
     if (m_messages.next() == m_msgAppend)
 	m_msgAppend = &m_messages;
     Message* msg = static_cast<Message *>(m_messages.remove(false));
-    unlock();
+    if (msg) {
+	waited = msg->m_queued;
+	msg->m_queued = 0;
+	m_msgCount--;
+    }
+    m_msgMutex.unlock();
     if (!msg)
 	return false;
+    waited = Time::now() - waited;
     dispatch(*msg);
     msg->destruct();
     return true;
@@ -530,8 +667,8 @@ void MessageDispatcher::dequeue()
 
 unsigned int MessageDispatcher::messageCount()
 {
-    Lock lock(this);
-    return m_messages.count();
+    Lock lock(m_msgMutex);
+    return m_msgCount;
 }
 
 unsigned int MessageDispatcher::handlerCount()
@@ -574,7 +711,8 @@ MessageNotifier::~MessageNotifier()
 static const char* s_queueMutexName = "MessageQueue";
 
 MessageQueue::MessageQueue(const char* queueName, int numWorkers)
-    : Mutex(true,s_queueMutexName), m_filters(queueName), m_count(0)
+    : Mutex(true,s_queueMutexName), m_filters(queueName), m_count(0),
+      m_wakeup(0x7fffffff,"MessageQueueWakeup")
 {
     XDebug(DebugAll,"Creating MessageQueue for %s",queueName);
     for (int i = 0;i < numWorkers;i ++) {
@@ -614,6 +752,8 @@ bool MessageQueue::enqueue(Message* msg)
     Lock myLock(this);
     m_append = m_append->append(msg);
     m_count++;
+    myLock.drop();
+    m_wakeup.unlock();
     return true;
 }
 
@@ -688,7 +828,9 @@ void QueueWorker::run()
 	return;
     while (true) {
 	if (!m_queue->count()) {
-	    Thread::idle(true);
+	    // sleep until a message is enqueued, wake up now and then to exit
+	    m_queue->wait(Thread::idleUsec() * 10);
+	    Thread::check(true);
 	    continue;
 	}
 	m_queue->dequeue();
@@ -21,6 +21,11 @@
 
 using namespace TelEngine;
 
+// Number of parameters a lookup must scan before a hash index is built
+#ifndef NAMEDLIST_INDEX
+#define NAMEDLIST_INDEX 16
+#endif
+
 static const NamedList s_empty("");
 
 const NamedList& NamedList::empty()
@@ -29,26 +34,30 @@ const NamedList& NamedList::empty()
 }
 
 NamedList::NamedList(const char* name)
-    : String(name)
+    : String(name), m_index(0), m_last(0), m_count(0)
 {
 }
 
 NamedList::NamedList(const NamedList& original)
-    : String(original)
+    : String(original), m_index(0), m_last(0), m_count(0)
 {
-    ObjList* dest = &m_params;
     for (const ObjList* l = original.m_params.skipNull(); l; l = l->skipNext()) {
 	const NamedString* p = static_cast<const NamedString*>(l->get());
-	dest = dest->append(new NamedString(p->name(),*p));
+	addParam(new NamedString(p->name(),*p));
     }
 }
 
 NamedList::NamedList(const char* name, const NamedList& original, const String& prefix)
-    : String(name)
+    : String(name), m_index(0), m_last(0), m_count(0)
 {
     copySubParams(original,prefix);
 }
 
+NamedList::~NamedList()
+{
+    clearIndex();
+}
+
 NamedList& NamedList::operator=(const NamedList& value)
 {
     String::operator=(value);
@@ -67,8 +76,12 @@ NamedList& NamedList::addParam(NamedString* param)
 {
     XDebug(DebugInfo,"NamedList::addParam(%p) [\"%s\",\"%s\"]",
         param,(param ? param->name().c_str() : ""),TelEngine::c_safe(param));
-    if (param)
-	m_params.append(param);
+    if (param) {
+	m_last = tail()->append(param);
+	if (m_count >= 0)
+	    m_count++;
+	indexParam(param);
+    }
     return *this;
 }
 
@@ -76,30 +89,19 @@ NamedList& NamedList::addParam(const char* name, const char* value, bool emptyOK
 {
     XDebug(DebugInfo,"NamedList::addParam(\"%s\",\"%s\",%s)",name,value,String::boolText(emptyOK));
     if (emptyOK || !TelEngine::null(value))
-	m_params.append(new NamedString(name, value));
+	addParam(new NamedString(name,value));
     return *this;
 }
 
 NamedList& NamedList::setParam(const String& name, const char* value)
 {
     XDebug(DebugInfo,"NamedList::setParam(\"%s\",\"%s\")",name.c_str(),value);
-    ObjList *p = m_params.skipNull();
-    while (p) {
-        NamedString *s = static_cast<NamedString*>(p->get());
-        if (s->name() == name) {
-            *s = value;
-	    return *this;
-	}
-	ObjList* next = p->skipNext();
-	if (next)
-	    p = next;
-	else
-	    break;
-    }
-    if (p)
-	p->append(new NamedString(name,value));
+    // the lookup builds the index on long lists so copying many is not quadratic
+    NamedString* s = getParam(name);
+    if (s)
+	*s = value;
     else
-	m_params.append(new NamedString(name,value));
+	addParam(name,value);
     return *this;
 }
 
@@ -110,11 +112,18 @@ NamedList& NamedList::clearParam(const String& name, char childSep)
     String tmp;
     if (childSep)
 	tmp << name << childSep;
+    else if (m_index && !m_index->find(name))
+	return *this;
     ObjList *p = &m_params;
     while (p) {
         NamedString *s = static_cast<NamedString *>(p->get());
-        if (s && ((s->name() == name) || s->name().startsWith(tmp)))
+        if (s && ((s->name() == name) || s->name().startsWith(tmp))) {
+	    unindexParam(s);
             p->remove();
+	    m_last = 0;
+	    if (m_count > 0)
+		m_count--;
+	}
 	else
 	    p = p->next();
     }
@@ -127,8 +136,13 @@ NamedList& NamedList::clearParam(NamedString* param, bool delParam)
     if (!param)
 	return *this;
     ObjList* o = m_params.find(param);
-    if (o)
+    if (o) {
+	unindexParam(param);
 	o->remove(delParam);
+	m_last = 0;
+	if (m_count > 0)
+	    m_count--;
+    }
     XDebug(DebugInfo,"NamedList::clearParam(%p) found=%p",param,o);
     return *this;
 }
@@ -145,11 +159,10 @@ NamedList& NamedList::copyParam(const NamedList& original, const String& name, c
     clearParam(name,childSep);
     String tmp;
     tmp << name << childSep;
-    ObjList* dest = &m_params;
     for (const ObjList* l = original.m_params.skipNull(); l; l = l->skipNext()) {
 	const NamedString* s = static_cast<const NamedString*>(l->get());
         if ((s->name() == name) || s->name().startsWith(tmp))
-	    dest = dest->append(new NamedString(s->name(),*s));
+	    addParam(new NamedString(s->name(),*s));
     }
     return *this;
 }
@@ -200,7 +213,6 @@ NamedList& NamedList::copySubParams(const NamedList& original, const String& pre
 	String::boolText(replace),this);
     if (prefix) {
 	unsigned int offs = skipPrefix ? prefix.length() : 0;
-	ObjList* dest = &m_params;
 	for (const ObjList* l = original.m_params.skipNull(); l; l = l->skipNext()) {
 	    const NamedString* s = static_cast<const NamedString*>(l->get());
 	    if (s->name().startsWith(prefix)) {
@@ -208,7 +220,7 @@ NamedList& NamedList::copySubParams(const NamedList& original, const String& pre
 		if (!*name)
 		    continue;
 		if (!replace)
-		    dest = dest->append(new NamedString(name,*s));
+		    addParam(new NamedString(name,*s));
 		else if (offs)
 		    setParam(name,*s);
 		else
@@ -272,12 +284,22 @@ int NamedList::getIndex(const String& name) const
 NamedString* NamedList::getParam(const String& name) const
 {
     XDebug(DebugInfo,"NamedList::getParam(\"%s\")",name.c_str());
+    if (m_index) {
+	const ObjList* l = m_index->find(name);
+	return l ? static_cast<NamedString*>(l->get()) : 0;
+    }
+    unsigned int n = 0;
     const ObjList *p = m_params.skipNull();
-    for (; p; p=p->skipNext()) {
+    for (; p; p=p->skipNext(), n++) {
         NamedString *s = static_cast<NamedString *>(p->get());
-        if (s->name() == name)
+        if (s->name() == name) {
+	    if (n >= NAMEDLIST_INDEX)
+		buildIndex();
             return s;
+	}
     }
+    if (n >= NAMEDLIST_INDEX)
+	buildIndex();
     return 0;
 }
 
@@ -325,6 +347,63 @@ bool NamedList::getBoolValue(const String& name, bool defvalue) const
     return s ? s->toBoolean(defvalue) : defvalue;
 }
 
+// Count parameters after the list was changed directly
+unsigned int NamedList::recount() const
+{
+    m_count = m_params.count();
+    return m_count;
+}
+
+// Find the last list item, starting from the last known one if any
+ObjList* NamedList::tail()
+{
+    if (!m_last)
+	m_last = &m_params;
+    while (m_last->next())
+	m_last = m_last->next();
+    return m_last;
+}
+
+void NamedList::clearIndex()
+{
+    if (m_index) {
+	HashList* idx = m_index;
+	m_index = 0;
+	delete idx;
+    }
+}
+
+void NamedList::indexParam(NamedString* param)
+{
+    if (m_index)
+	m_index->append(param)->setDelete(false);
+}
+
+void NamedList::unindexParam(NamedString* param)
+{
+    if (m_index)
+	m_index->remove(param,false,true);
+}
+
+// Build the hash index of parameters
+// Lookups are const and may run concurrently so the index is published atomically
+void NamedList::buildIndex() const
+{
+#ifdef ATOMIC_OPS
+    unsigned int n = m_params.count();
+    HashList* idx = new HashList((n < 64) ? 64 : n);
+    for (const ObjList* l = m_params.skipNull(); l; l = l->skipNext())
+	idx->append(l->get())->setDelete(false);
+#ifdef _WINDOWS
+    if (::InterlockedCompareExchangePointer((PVOID volatile*)&m_index,idx,0))
+	delete idx;
+#else
+    if (!__sync_bool_compare_and_swap(&m_index,(HashList*)0,idx))
+	delete idx;
+#endif
+#endif
+}
+
 int NamedList::replaceParams(String& str, bool sqlEsc, char extraEsc) const
 {
     int p1 = 0;
@@ -372,4 +451,31 @@ int NamedList::replaceParams(String& str, bool sqlEsc, char extraEsc) const
     return cnt;
 }
 
+int NamedList::collectParams(const String& str, NamedList& dest, const char* const* reserved) const
+{
+    int p1 = 0;
+    int cnt = 0;
+    while ((p1 = str.find("${",p1)) >= 0) {
+	int p2 = str.find('}',p1+2);
+	if (p2 < 0)
+	    return -1;
+	String tmp = str.substr(p1+2,p2-p1-2);
+	tmp.trimBlanks();
+	int pq = tmp.find('$');
+	if (pq >= 0)
+	    tmp = tmp.substr(0,pq).trimBlanks();
+	if (reserved) {
+	    for (const char* const* r = reserved; *r; r++)
+		if (tmp == *r)
+		    return -1;
+	}
+	const String* ns = getParam(tmp);
+	if (ns && !dest.getParam(tmp))
+	    dest.addParam(tmp,*ns);
+	p1 = p2+1;
+	cnt++;
+    }
+    return cnt;
+}
+
 /* vi: set ts=8 sw=4 sts=4 noet: */
@@ -72,6 +72,8 @@
 
 #define MAX_SOCKLEN 1024
 #define MAX_RESWAIT 5000000
+// Maximum number of datagrams transferred by one batch system call
+#define MAX_BATCH 32
 
 using namespace TelEngine;
 
@@ -1833,6 +1835,48 @@ int Socket::sendTo(const void* buffer, int length, const struct sockaddr* addr,
     return res;
 }
 
+int Socket::sendMany(const void* const* buffers, const int* lengths, const SocketAddr* addrs,
+    int count, int flags)
+{
+    if (!(buffers && lengths) || (count <= 0))
+	return 0;
+    int sent = 0;
+#ifdef HAVE_MMSG
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec iovs[MAX_BATCH];
+    while (sent < count) {
+	int n = count - sent;
+	if (n > MAX_BATCH)
+	    n = MAX_BATCH;
+	::memset(msgs,0,n * sizeof(struct mmsghdr));
+	for (int i = 0; i < n; i++) {
+	    iovs[i].iov_base = (void*)buffers[sent + i];
+	    iovs[i].iov_len = buffers[sent + i] ? lengths[sent + i] : 0;
+	    msgs[i].msg_hdr.msg_iov = &iovs[i];
+	    msgs[i].msg_hdr.msg_iovlen = 1;
+	    if (addrs) {
+		msgs[i].msg_hdr.msg_name = (void*)addrs[sent + i].address();
+		msgs[i].msg_hdr.msg_namelen = addrs[sent + i].length();
+	    }
+	}
+	int res = ::sendmmsg(m_handle,msgs,n,flags);
+	if (!checkError(res,true))
+	    return sent ? sent : res;
+	sent += res;
+	if (res < n)
+	    break;
+    }
+#else
+    for (; sent < count; sent++) {
+	int res = addrs ? sendTo(buffers[sent],lengths[sent],addrs[sent],flags) :
+	    send(buffers[sent],lengths[sent],flags);
+	if (res == socketError())
+	    return sent ? sent : res;
+    }
+#endif
+    return sent;
+}
+
 int Socket::send(const void* buffer, int length, int flags)
 {
     if (!buffer)
@@ -1879,6 +1923,60 @@ int Socket::recvFrom(void* buffer, int length, SocketAddr& addr, int flags)
     return res;
 }
 
+int Socket::recvMany(void* const* buffers, int* lengths, SocketAddr* addrs, int count, int flags)
+{
+    if (!(buffers && lengths) || (count <= 0))
+	return 0;
+#ifdef HAVE_MMSG
+    if (count > MAX_BATCH)
+	count = MAX_BATCH;
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec iovs[MAX_BATCH];
+    struct sockaddr_storage from[MAX_BATCH];
+    ::memset(msgs,0,count * sizeof(struct mmsghdr));
+    for (int i = 0; i < count; i++) {
+	iovs[i].iov_base = buffers[i];
+	iovs[i].iov_len = buffers[i] ? lengths[i] : 0;
+	msgs[i].msg_hdr.msg_iov = &iovs[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+	if (addrs) {
+	    msgs[i].msg_hdr.msg_name = &from[i];
+	    msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+	}
+    }
+    int res = ::recvmmsg(m_handle,msgs,count,flags,0);
+    if (!checkError(res,true))
+	return res;
+    for (int i = 0; i < res; i++) {
+	struct sockaddr* addr = addrs ? (struct sockaddr*)&from[i] : 0;
+	socklen_t adrlen = addrs ? msgs[i].msg_hdr.msg_namelen : 0;
+	lengths[i] = msgs[i].msg_len;
+	if (applyFilters(buffers[i],lengths[i],flags,addr,adrlen))
+	    lengths[i] = socketError();
+	else if (addrs)
+	    addrs[i].assign(addr,adrlen);
+    }
+    return res;
+#else
+    int n = 0;
+    for (; n < count; n++) {
+	char buf[MAX_SOCKLEN];
+	socklen_t adrlen = sizeof(buf);
+	struct sockaddr* addr = addrs ? (struct sockaddr*)buf : 0;
+	int len = buffers[n] ? lengths[n] : 0;
+	int res = ::recvfrom(m_handle,(char*)buffers[n],len,flags,addr,(addrs ? &adrlen : 0));
+	if (!checkError(res,true))
+	    return n ? n : res;
+	lengths[n] = res;
+	if (applyFilters(buffers[n],res,flags,addr,(addrs ? adrlen : 0)))
+	    lengths[n] = socketError();
+	else if (addrs)
+	    addrs[n].assign(addr,adrlen);
+    }
+    return n;
+#endif
+}
+
 int Socket::recv(void* buffer, int length, int flags)
 {
     if (!buffer)
@@ -303,13 +303,13 @@ const String& String::empty()
 }
 
 String::String()
-    : m_string(0), m_length(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
+    : m_string(0), m_length(0), m_capacity(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
 {
     XDebug(DebugAll,"String::String() [%p]",this);
 }
 
 String::String(const char* value, int len)
-    : m_string(0), m_length(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
+    : m_string(0), m_length(0), m_capacity(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
 {
     XDebug(DebugAll,"String::String(\"%s\",%d) [%p]",value,len,this);
     assign(value,len);
@@ -317,7 +317,7 @@ String::String(const char* value, int len)
 
 String::String(const String& value)
     : GenObject(),
-      m_string(0), m_length(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
+      m_string(0), m_length(0), m_capacity(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
 {
     XDebug(DebugAll,"String::String(%p) [%p]",&value,this);
     if (!value.null()) {
@@ -331,7 +331,7 @@ String::String(const String& value)
 }
 
 String::String(char value, unsigned int repeat)
-    : m_string(0), m_length(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
+    : m_string(0), m_length(0), m_capacity(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
 {
     XDebug(DebugAll,"String::String('%c',%d) [%p]",value,repeat,this);
     if (value && repeat) {
@@ -348,7 +348,7 @@ String::String(char value, unsigned int repeat)
 }
 
 String::String(int32_t value)
-    : m_string(0), m_length(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
+    : m_string(0), m_length(0), m_capacity(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
 {
     XDebug(DebugAll,"String::String(%d) [%p]",value,this);
     char buf[16];
@@ -360,7 +360,7 @@ String::String(int32_t value)
 }
 
 String::String(int64_t value)
-    : m_string(0), m_length(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
+    : m_string(0), m_length(0), m_capacity(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
 {
     XDebug(DebugAll,"String::String(" FMT64 ") [%p]",value,this);
     char buf[24];
@@ -372,7 +372,7 @@ String::String(int64_t value)
 }
 
 String::String(uint32_t value)
-    : m_string(0), m_length(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
+    : m_string(0), m_length(0), m_capacity(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
 {
     XDebug(DebugAll,"String::String(%u) [%p]",value,this);
     char buf[16];
@@ -384,7 +384,7 @@ String::String(uint32_t value)
 }
 
 String::String(uint64_t value)
-    : m_string(0), m_length(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
+    : m_string(0), m_length(0), m_capacity(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
 {
     XDebug(DebugAll,"String::String(" FMT64U ") [%p]",value,this);
     char buf[24];
@@ -396,7 +396,7 @@ String::String(uint64_t value)
 }
 
 String::String(bool value)
-    : m_string(0), m_length(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
+    : m_string(0), m_length(0), m_capacity(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
 {
     XDebug(DebugAll,"String::String(%u) [%p]",value,this);
     m_string = ::strdup(boolText(value));
@@ -406,7 +406,7 @@ String::String(bool value)
 }
 
 String::String(const String* value)
-    : m_string(0), m_length(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
+    : m_string(0), m_length(0), m_capacity(0), m_hash(YSTRING_INIT_HASH), m_matches(0)
 {
     XDebug(DebugAll,"String::String(%p) [%p]",&value,this);
     if (value && !value->null()) {
@@ -455,6 +455,7 @@ String& String::assign(const char* value, int len)
 		char* odata = m_string;
 		m_string = data;
 		m_length = len;
+		m_capacity = 0;
 		changed();
 		if (odata)
 		    ::free(odata);
@@ -478,6 +479,7 @@ String& String::assign(char value, unsigned int repeat)
 	    char* odata = m_string;
 	    m_string = data;
 	    m_length = repeat;
+	    m_capacity = 0;
 	    changed();
 	    if (odata)
 		::free(odata);
@@ -514,6 +516,7 @@ String& String::hexify(void* data, unsigned int len, char sep, bool upCase)
 	    char* odata = m_string;
 	    m_string = data;
 	    m_length = repeat;
+	    m_capacity = 0;
 	    changed();
 	    if (odata)
 		::free(odata);
@@ -538,6 +541,7 @@ void String::changed()
 
 void String::clear()
 {
+    m_capacity = 0;
     if (m_string) {
 	char *odata = m_string;
 	m_string = 0;
@@ -739,6 +743,7 @@ String& String::operator=(const char* value)
 	char *tmp = m_string;
 	m_string = value ? ::strdup(value) : 0;
 	m_length = 0;
+	m_capacity = 0;
 	if (value && !m_string)
 	    Debug("String",DebugFail,"strdup() returned NULL!");
 	changed();
@@ -905,38 +910,83 @@ String& String::operator>>(bool& store)
 
 String& String::append(const char* value, int len)
 {
-    if (len && value && *value) {
-	if (len < 0) {
-	    if (!m_string) {
-		m_string = ::strdup(value);
-		m_length = 0;
-		if (!m_string)
-		    Debug("String",DebugFail,"strdup() returned NULL!");
-		changed();
-		return *this;
-	    }
-	    len = ::strlen(value);
-	}
-	int olen = length();
-	len += olen;
-	char *tmp1 = m_string;
-	char *tmp2 = (char *) ::malloc(len+1);
-	if (tmp2) {
-	    if (m_string)
-		::strncpy(tmp2,m_string,olen);
-	    ::strncpy(tmp2+olen,value,len-olen);
-	    tmp2[len] = 0;
-	    m_string = tmp2;
-	    m_length = len;
-	    ::free(tmp1);
-	}
-	else
-	    Debug("String",DebugFail,"malloc(%d) returned NULL!",len+1);
+    if (!(len && value && *value))
+	return *this;
+    if (len < 0)
+	len = ::strlen(value);
+    else {
+	int l = 0;
+	for (const char* p = value; l < len; l++)
+	    if (!*p++)
+		break;
+	len = l;
+    }
+    unsigned int olen = length();
+    unsigned int total = olen + len;
+    if (m_string && (total <= m_capacity)) {
+	// there is room left, value can't be in the unused part of our buffer
+	::memcpy(m_string + olen,value,len);
+	m_string[total] = 0;
+	m_length = total;
 	changed();
+	return *this;
+    }
+    // grow by half when appending again, use any reserved length
+    unsigned int cap = total;
+    if (m_string)
+	cap += (total < 32) ? 16 : (total >> 1);
+    else if (m_capacity > cap)
+	cap = m_capacity;
+    char* data = (char*) ::malloc(cap+1);
+    if (!data) {
+	Debug("String",DebugFail,"malloc(%u) returned NULL!",cap+1);
+	return *this;
     }
+    if (m_string)
+	::memcpy(data,m_string,olen);
+    // value may be part of the old buffer so copy it before releasing
+    ::memcpy(data+olen,value,len);
+    data[total] = 0;
+    char* odata = m_string;
+    m_string = data;
+    m_length = total;
+    m_capacity = cap;
+    changed();
+    if (odata)
+	::free(odata);
     return *this;
 }
 
+void String::reserve(unsigned int len)
+{
+    if (!m_string) {
+	m_capacity = len;
+	return;
+    }
+    if (len <= capacity())
+	return;
+    char* data = (char*) ::malloc(len+1);
+    if (!data) {
+	Debug("String",DebugFail,"malloc(%u) returned NULL!",len+1);
+	return;
+    }
+    ::memcpy(data,m_string,m_length+1);
+    char* odata = m_string;
+    m_string = data;
+    m_capacity = len;
+    ::free(odata);
+}
+
+void String::shrink()
+{
+    if (m_string && (m_capacity > m_length)) {
+	char* data = (char*) ::realloc(m_string,m_length+1);
+	if (data)
+	    m_string = data;
+    }
+    m_capacity = 0;
+}
+
 String& String::append(const char* value, const char* separator, bool force)
 {
     if (value || force) {
@@ -984,6 +1034,7 @@ String& String::append(const ObjList* list, const char* separator, bool force)
     newStr[olen] = 0;
     m_string = newStr;
     m_length = olen;
+    m_capacity = 0;
     ::free(oldStr);
     changed();
     return *this;
@@ -77,6 +77,7 @@ static int _localtime_s(struct tm* _tm, const time_t* time)
 
 #else // !_WINDOWS
 #include <sys/resource.h>
+#include <pthread.h>
 #endif
 
 
@@ -88,6 +89,15 @@ namespace TelEngine {
 
 #define OUT_BUFFER_SIZE 8192
 
+// Asynchronous debug output needs atomic operations and thread destructors
+#if defined(ATOMIC_OPS) && !defined(_WINDOWS)
+#define ASYNC_OUTPUT
+#endif
+
+// Limits of the size of a thread's asynchronous output buffer
+#define ASYNC_MIN_BUFFER 16384
+#define ASYNC_MAX_BUFFER 16777216
+
 // RefObject mutex pool array size
 #ifndef REFOBJECT_MUTEX_COUNT
 #define REFOBJECT_MUTEX_COUNT 47
@@ -170,7 +180,9 @@ static bool reentered()
     return (Thread::current() == s_thr);
 }
 
-static void common_output(int level,char* buf)
+// Send a message to the output callbacks, out_mux must be locked
+// The buffer must have room for 2 more characters after the message
+static void dbg_write(int level, char* buf)
 {
     if (level < -1)
 	level = -1;
@@ -179,8 +191,6 @@ static void common_output(int level,char* buf)
     int n = ::strlen(buf);
     if (n && (buf[n-1] == '\n'))
 	n--;
-    // serialize the output strings
-    out_mux.lock();
     // TODO: detect reentrant calls from foreign threads and main thread
     s_thr = Thread::current();
     if (CapturedEvent::capturing()) {
@@ -198,9 +208,311 @@ static void common_output(int level,char* buf)
 	s_intout(buf,level);
     buf[n] = '\0';
     s_thr = 0;
+}
+
+#ifdef ASYNC_OUTPUT
+
+#define ASYNC_OUT   0x01 // Message goes to the output callbacks
+#define ASYNC_ALARM 0x02 // Message goes to the alarm hook
+#define ASYNC_INFO  0x04 // Alarm has an info text
+#define ASYNC_WRAP  0x08 // Rest of buffer is unused, continue from its start
+
+// Header of a queued message, followed by the message text, 2 spare
+//  characters and, for alarms, the component and info texts
+struct AsyncRecord
+{
+    unsigned int seq;                    // Order of the message among all threads
+    short int level;                     // Level of the message
+    unsigned short int flags;            // Destination of the message
+    unsigned int len;                    // Length of the data after the header
+    unsigned int alarm;                  // Offset of the alarm text in data
+};
+
+// Round a record length to keep headers aligned
+#define ASYNC_ALIGN(len) ((sizeof(AsyncRecord) + (len) + 15) & ~15)
+
+// Messages queued by one thread, written only by that thread and read only
+//  by the thread holding out_mux
+class AsyncRing
+{
+public:
+    AsyncRing(unsigned int size);
+    ~AsyncRing();
+    bool put(int level, unsigned int flags, const char* buf, unsigned int alarm,
+	const char* comp, const char* info);
+    AsyncRecord* get();
+    void pop(const AsyncRecord* rec);
+    inline bool empty() const
+	{ return m_tail == m_head; }
+    AsyncRing* m_next;
+    volatile bool m_orphan;
+private:
+    char* m_data;
+    unsigned int m_mask;
+    volatile unsigned int m_head;        // Advanced by the owner thread
+    volatile unsigned int m_tail;        // Advanced by the output writer
+};
+
+class AsyncWriter : public Thread
+{
+public:
+    AsyncWriter();
+    virtual void run();
+    virtual void cleanup();
+};
+
+static pthread_key_t s_ringKey;
+static bool s_ringKeyOk = false;
+static AsyncRing* volatile s_rings = 0;
+static volatile unsigned int s_ringSize = 0;
+static volatile unsigned int s_seq = 0;
+static volatile unsigned int s_dropped = 0;
+static unsigned int s_dropReported = 0;
+static volatile bool s_writing = false;
+static volatile bool s_writerIdle = false;
+static Semaphore s_writerSem(1,"DebugWriter");
+
+AsyncRing::AsyncRing(unsigned int size)
+    : m_next(0), m_orphan(false),
+      m_data(new char[size]), m_mask(size - 1), m_head(0), m_tail(0)
+{
+}
+
+AsyncRing::~AsyncRing()
+{
+    delete[] m_data;
+}
+
+// Copy a message in the buffer, fail if there is no room for it
+bool AsyncRing::put(int level, unsigned int flags, const char* buf, unsigned int alarm,
+    const char* comp, const char* info)
+{
+    unsigned int n = ::strlen(buf) + 2;
+    unsigned int lc = comp ? ::strlen(comp) + 1 : 0;
+    unsigned int li = info ? ::strlen(info) + 1 : 0;
+    unsigned int need = ASYNC_ALIGN(n + lc + li);
+    unsigned int head = m_head;
+    unsigned int offs = head & m_mask;
+    unsigned int skip = m_mask + 1 - offs;
+    if (need <= skip)
+	skip = 0;
+    if (need + skip > m_mask + 1 - (head - m_tail))
+	return false;
+    if (skip) {
+	reinterpret_cast<AsyncRecord*>(m_data + offs)->flags = ASYNC_WRAP;
+	offs = 0;
+    }
+    AsyncRecord* rec = reinterpret_cast<AsyncRecord*>(m_data + offs);
+    rec->seq = __sync_fetch_and_add(&s_seq,1);
+    rec->level = level;
+    rec->flags = flags;
+    rec->len = n + lc + li;
+    rec->alarm = alarm;
+    char* data = reinterpret_cast<char*>(rec + 1);
+    ::memcpy(data,buf,n - 1);
+    if (lc)
+	::memcpy(data + n,comp,lc);
+    if (li)
+	::memcpy(data + n + lc,info,li);
+    // make the message visible before the new head
+    __sync_synchronize();
+    m_head = head + skip + need;
+    return true;
+}
+
+// Retrieve the oldest message without removing it
+AsyncRecord* AsyncRing::get()
+{
+    unsigned int tail = m_tail;
+    if (tail == m_head)
+	return 0;
+    __sync_synchronize();
+    AsyncRecord* rec = reinterpret_cast<AsyncRecord*>(m_data + (tail & m_mask));
+    if (rec->flags & ASYNC_WRAP) {
+	m_tail = tail + m_mask + 1 - (tail & m_mask);
+	rec = reinterpret_cast<AsyncRecord*>(m_data);
+    }
+    return rec;
+}
+
+// Free the space of the message returned by get()
+void AsyncRing::pop(const AsyncRecord* rec)
+{
+    unsigned int len = ASYNC_ALIGN(rec->len);
+    // finish reading the message before the producer can overwrite it
+    __sync_synchronize();
+    m_tail = m_tail + len;
+}
+
+// Thread local destructor, the ring is freed after the writer empties it
+static void dbg_ring_orphan(void* ring)
+{
+    __sync_synchronize();
+    static_cast<AsyncRing*>(ring)->m_orphan = true;
+}
+
+// Write all queued messages in the order they were produced, out_mux must be locked
+// Messages queued at the same time by different threads may come out swapped
+static unsigned int dbg_drain()
+{
+    unsigned int count = 0;
+    for (;;) {
+	AsyncRing* ring = 0;
+	AsyncRecord* rec = 0;
+	for (AsyncRing* r = s_rings; r; r = r->m_next) {
+	    AsyncRecord* tmp = r->get();
+	    if (tmp && !(rec && ((int)(tmp->seq - rec->seq) > 0))) {
+		ring = r;
+		rec = tmp;
+	    }
+	}
+	if (!rec)
+	    break;
+	char* buf = reinterpret_cast<char*>(rec + 1);
+	const char* comp = buf + ::strlen(buf) + 2;
+	if (rec->flags & ASYNC_OUT)
+	    dbg_write(rec->level,buf);
+	if ((rec->flags & ASYNC_ALARM) && s_alarms)
+	    s_alarms(buf + rec->alarm,rec->level,comp,
+		(rec->flags & ASYNC_INFO) ? comp + ::strlen(comp) + 1 : 0);
+	ring->pop(rec);
+	count++;
+    }
+    unsigned int dropped = s_dropped;
+    if (dropped != s_dropReported) {
+	char buf[OUT_BUFFER_SIZE];
+	unsigned int n = Debugger::formatTime(buf,s_fmtstamp);
+	::snprintf(buf + n,sizeof(buf) - n - 2,"<WARN> Dropped %u debug messages, thread buffers full",
+	    dropped - s_dropReported);
+	s_dropReported = dropped;
+	dbg_write(DebugWarn,buf);
+    }
+    // free buffers of exited threads, producers only replace the list head
+    AsyncRing* prev = s_rings;
+    if (prev && prev->m_orphan) {
+	__sync_synchronize();
+	if (prev->empty() && __sync_bool_compare_and_swap(&s_rings,prev,prev->m_next)) {
+	    delete prev;
+	    prev = s_rings;
+	}
+    }
+    while (AsyncRing* r = prev ? prev->m_next : 0) {
+	if (r->m_orphan) {
+	    __sync_synchronize();
+	    if (r->empty()) {
+		prev->m_next = r->m_next;
+		delete r;
+		continue;
+	    }
+	}
+	prev = r;
+    }
+    return count;
+}
+
+// Check if any thread has queued messages, out_mux must be locked
+static bool dbg_pending()
+{
+    for (AsyncRing* r = s_rings; r; r = r->m_next)
+	if (!r->empty())
+	    return true;
+    return false;
+}
+
+// Queue a message in the buffer of the current thread
+// The size is the one read by the caller, a buffer is never created empty
+static void dbg_queue(unsigned int size, int level, unsigned int flags, const char* buf,
+    unsigned int alarm, const char* comp, const char* info)
+{
+    AsyncRing* ring = static_cast<AsyncRing*>(::pthread_getspecific(s_ringKey));
+    if (!ring) {
+	ring = new AsyncRing(size);
+	::pthread_setspecific(s_ringKey,ring);
+	do
+	    ring->m_next = s_rings;
+	while (!__sync_bool_compare_and_swap(&s_rings,ring->m_next,ring));
+    }
+    if (!ring->put(level,flags,buf,alarm,comp,info)) {
+	__sync_fetch_and_add(&s_dropped,1);
+	return;
+    }
+    if (s_writerIdle)
+	s_writerSem.unlock();
+}
+
+AsyncWriter::AsyncWriter()
+    : Thread("DebugWriter")
+{
+}
+
+void AsyncWriter::run()
+{
+    for (;;) {
+	out_mux.lock();
+	unsigned int n = dbg_drain();
+	out_mux.unlock();
+	if (n)
+	    continue;
+	if (!s_ringSize)
+	    break;
+	s_writerIdle = true;
+	__sync_synchronize();
+	// buffers are freed by any thread draining them so the list is walked locked
+	out_mux.lock();
+	bool pending = dbg_pending();
+	out_mux.unlock();
+	if (!pending)
+	    s_writerSem.lock(100000);
+	s_writerIdle = false;
+    }
+}
+
+void AsyncWriter::cleanup()
+{
+    s_writing = false;
+}
+
+#endif // ASYNC_OUTPUT
+
+// Write a message to the output callbacks after any queued ones
+static void common_output(int level,char* buf)
+{
+    // serialize the output strings
+    out_mux.lock();
+#ifdef ASYNC_OUTPUT
+    if (s_rings)
+	dbg_drain();
+#endif
+    dbg_write(level,buf);
     out_mux.unlock();
 }
 
+// Send a message to the output and alarm callbacks, directly or through
+//  the writer thread. Fatal messages are never queued
+static void dbg_send(int level, char* buf, bool out,
+    const char* alarmMsg = 0, const char* alarmComp = 0, const char* alarmInfo = 0)
+{
+#ifdef ASYNC_OUTPUT
+    // read the size once, it is cleared when output becomes synchronous
+    unsigned int size = s_ringSize;
+    if (size && (level != DebugFail)) {
+	unsigned int flags = out ? ASYNC_OUT : 0;
+	if (alarmMsg)
+	    flags |= alarmInfo ? (ASYNC_ALARM | ASYNC_INFO) : ASYNC_ALARM;
+	dbg_queue(size,level,flags,buf,alarmMsg ? (alarmMsg - buf) : 0,alarmComp,alarmInfo);
+	return;
+    }
+#endif
+    if (out)
+	common_output(level,buf);
+    if (alarmMsg) {
+	out_mux.lock();
+	if (s_alarms)
+	    s_alarms(alarmMsg,level,alarmComp,alarmInfo);
+	out_mux.unlock();
+    }
+}
+
 static void dbg_output(int level,const char* prefix, const char* format, va_list ap,
     const char* alarmComp = 0, const char* alarmInfo = 0)
 {
@@ -226,14 +538,7 @@ static void dbg_output(int level,const char* prefix, const char* format, va_list
 	::vsnprintf(msg,l,format,ap);
 	buf[OUT_BUFFER_SIZE - 2] = 0;
     }
-    if (out)
-	common_output(level,buf);
-    if (alarm) {
-	out_mux.lock();
-	if (s_alarms)
-	    s_alarms(msg,level,alarmComp,alarmInfo);
-	out_mux.unlock();
-    }
+    dbg_send(level,buf,out,alarm ? msg : 0,alarmComp,alarmInfo);
 }
 
 void Output(const char* format, ...)
@@ -247,7 +552,7 @@ void Output(const char* format, ...)
     va_start(va,format);
     ::vsnprintf(buf,sizeof(buf)-2,format,va);
     va_end(va);
-    common_output(-1,buf);
+    dbg_send(-1,buf,true);
 }
 
 void Debug(int level, const char* format, ...)
@@ -264,9 +569,7 @@ void Debug(int level, const char* format, ...)
     ::sprintf(buf,"<%s> ",dbg_level(level));
     va_list va;
     va_start(va,format);
-    ind_mux.lock();
     dbg_output(level,buf,format,va);
-    ind_mux.unlock();
     va_end(va);
     if (s_abort && (level == DebugFail))
 	abort();
@@ -286,9 +589,7 @@ void Debug(const char* facility, int level, const char* format, ...)
     ::snprintf(buf,sizeof(buf),"<%s:%s> ",facility,dbg_level(level));
     va_list va;
     va_start(va,format);
-    ind_mux.lock();
     dbg_output(level,buf,format,va);
-    ind_mux.unlock();
     va_end(va);
     if (s_abort && (level == DebugFail))
 	abort();
@@ -319,9 +620,7 @@ void Debug(const DebugEnabler* local, int level, const char* format, ...)
 	::sprintf(buf,"<%s> ",dbg_level(level));
     va_list va;
     va_start(va,format);
-    ind_mux.lock();
     dbg_output(level,buf,format,va);
-    ind_mux.unlock();
     va_end(va);
     if (s_abort && (level == DebugFail))
 	abort();
@@ -337,9 +636,7 @@ void Alarm(const char* component, int level, const char* format, ...)
     ::snprintf(buf,sizeof(buf),"<%s:%s> ",component,dbg_level(level));
     va_list va;
     va_start(va,format);
-    ind_mux.lock();
     dbg_output(level,buf,format,va,component);
-    ind_mux.unlock();
     va_end(va);
     if (s_abort && (level == DebugFail))
 	abort();
@@ -355,9 +652,7 @@ void Alarm(const DebugEnabler* component, int level, const char* format, ...)
     ::snprintf(buf,sizeof(buf),"<%s:%s> ",name,dbg_level(level));
     va_list va;
     va_start(va,format);
-    ind_mux.lock();
     dbg_output(level,buf,format,va,name);
-    ind_mux.unlock();
     va_end(va);
     if (s_abort && (level == DebugFail))
 	abort();
@@ -373,9 +668,7 @@ void Alarm(const char* component, const char* info, int level, const char* forma
     ::snprintf(buf,sizeof(buf),"<%s:%s> ",component,dbg_level(level));
     va_list va;
     va_start(va,format);
-    ind_mux.lock();
     dbg_output(level,buf,format,va,component,info);
-    ind_mux.unlock();
     va_end(va);
     if (s_abort && (level == DebugFail))
 	abort();
@@ -391,9 +684,7 @@ void Alarm(const DebugEnabler* component, const char* info, int level, const cha
     ::snprintf(buf,sizeof(buf),"<%s:%s> ",name,dbg_level(level));
     va_list va;
     va_start(va,format);
-    ind_mux.lock();
     dbg_output(level,buf,format,va,name,info);
-    ind_mux.unlock();
     va_end(va);
     if (s_abort && (level == DebugFail))
 	abort();
@@ -567,6 +858,63 @@ void Debugger::setAlarmHook(void (*alarmFunc)(const char*,int,const char*,const
     out_mux.unlock();
 }
 
+bool Debugger::setAsync(unsigned int size)
+{
+#ifdef ASYNC_OUTPUT
+    if (size) {
+	if (size < ASYNC_MIN_BUFFER)
+	    size = ASYNC_MIN_BUFFER;
+	if (size > ASYNC_MAX_BUFFER)
+	    size = ASYNC_MAX_BUFFER;
+	// round up to a power of 2
+	unsigned int pow2 = ASYNC_MIN_BUFFER;
+	while (pow2 < size)
+	    pow2 <<= 1;
+	size = pow2;
+	Lock lck(out_mux);
+	if (!s_ringKeyOk)
+	    s_ringKeyOk = (0 == ::pthread_key_create(&s_ringKey,dbg_ring_orphan));
+	if (!s_ringKeyOk)
+	    return false;
+	s_ringSize = size;
+	if (!s_writing) {
+	    AsyncWriter* w = new AsyncWriter;
+	    s_writing = true;
+	    if (!w->startup()) {
+		s_writing = false;
+		s_ringSize = 0;
+		delete w;
+		return false;
+	    }
+	}
+	return true;
+    }
+    if (!s_ringSize)
+	return true;
+    s_ringSize = 0;
+    __sync_synchronize();
+    // let the writer empty the buffers and exit
+    s_writerSem.unlock();
+    for (int i = 0; s_writing && (i < 5000); i++)
+	Thread::msleep(1);
+    out_mux.lock();
+    dbg_drain();
+    out_mux.unlock();
+    return true;
+#else
+    return !size;
+#endif
+}
+
+unsigned int Debugger::dropped()
+{
+#ifdef ASYNC_OUTPUT
+    return s_dropped;
+#else
+    return 0;
+#endif
+}
+
 void Debugger::enableOutput(bool enable, bool colorize)
 {
     s_debugging = enable;
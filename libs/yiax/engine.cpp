@@ -57,10 +57,15 @@ IAXEngine::IAXEngine(const char* iface, int port, u_int32_t format, u_int32_t ca
     : Mutex(true,"IAXEngine"),
     m_trunking(0),
     m_name(name),
-    m_lastGetEvIndex(0),
+    m_freeCallNoHead(0),
+    m_freeCallNoCount(0),
+    m_transCount(0),
+    m_readyMutex(true,"IAXEngine::Ready"),
+    m_timerHeap(0),
+    m_timerCount(0),
+    m_timerAlloc(0),
     m_exiting(false),
     m_maxFullFrameDataLen(1400),
-    m_startLocalCallNo(0),
     m_transListCount(64),
     m_challengeTout(IAX2_CHALLENGETOUT_DEF),
     m_callToken(false),
@@ -97,17 +102,28 @@ IAXEngine::IAXEngine(const char* iface, int port, u_int32_t format, u_int32_t ca
 	for (unsigned int i = 0; i < 3; i++)
 	    m_callTokenSecret << (int)(Random::random() ^ Time::now());
     bind(iface,port,forceBind);
-    m_startLocalCallNo = 1 + (u_int16_t)(Random::random() % IAX2_MAX_CALLNO);
-    if (m_startLocalCallNo < IAX2_MIN_CALLNO)
-	m_startLocalCallNo = IAX2_MIN_CALLNO;
+    // Queue free call numbers starting with a random one
+    unsigned int range = IAX2_MAX_CALLNO - IAX2_MIN_CALLNO + 1;
+    unsigned int start = Random::random() % range;
+    for (unsigned int i = 0; i < range; i++)
+	m_freeCallNo[m_freeCallNoCount++] = IAX2_MIN_CALLNO + (start + i) % range;
     initialize(params ? *params : NamedList::empty());
 }
 
 IAXEngine::~IAXEngine()
 {
-    for (int i = 0; i < m_transListCount; i++)
+    // Transactions destroyed with the lists must not be queued any more
+    ObjList* o = m_incompleteTransList.skipNull();
+    for (; o; o = o->skipNext())
+	setListed(static_cast<IAXTransaction*>(o->get()),false);
+    m_incompleteTransList.clear();
+    for (int i = 0; i < m_transListCount; i++) {
+	for (o = m_transList[i]->skipNull(); o; o = o->skipNext())
+	    setListed(static_cast<IAXTransaction*>(o->get()),false);
 	TelEngine::destruct(m_transList[i]);
+    }
     delete[] m_transList;
+    delete[] m_timerHeap;
 }
 
 IAXTransaction* IAXEngine::addFrame(const SocketAddr& addr, IAXFrame* frame)
@@ -221,8 +237,10 @@ IAXTransaction* IAXEngine::addFrame(const SocketAddr& addr, IAXFrame* frame)
     if (lcn) {
 	// Create and add transaction
 	tr = IAXTransaction::factoryIn(this,full,lcn,addr);
-	if (tr)
+	if (tr) {
 	    m_transList[frame->sourceCallNo() % m_transListCount]->append(tr);
+	    setListed(tr,true);
+	}
 	else
 	    releaseCallNo(lcn);
     }
@@ -471,17 +489,19 @@ void IAXEngine::removeTransaction(IAXTransaction* transaction)
     if (!transaction)
 	return;
     Lock lock(this);
+    // Don't release the call number twice, it may belong to another transaction
+    if (!transaction->m_listed) {
+	DDebug(this,DebugAll,
+	    "Trying to remove transaction(%u,%u) but does not exist [%p]",
+	    transaction->localCallNo(),transaction->remoteCallNo(),this);
+	return;
+    }
+    setListed(transaction,false);
     releaseCallNo(transaction->localCallNo());
     if (!m_incompleteTransList.remove(transaction,false)) {
-	if (m_transList[transaction->remoteCallNo() % m_transListCount]->remove(transaction,false)) {
-	    DDebug(this,DebugAll,"Transaction(%u,%u) removed [%p]",
-		transaction->localCallNo(),transaction->remoteCallNo(),this);
-	}
-	else {
-	    DDebug(this,DebugAll,
-		"Trying to remove transaction(%u,%u) but does not exist [%p]",
-		transaction->localCallNo(),transaction->remoteCallNo(),this);
-	}
+	m_transList[transaction->remoteCallNo() % m_transListCount]->remove(transaction,false);
+	DDebug(this,DebugAll,"Transaction(%u,%u) removed [%p]",
+	    transaction->localCallNo(),transaction->remoteCallNo(),this);
     }
     else {
 	DDebug(this,DebugAll,"Transaction(%u,%u) (incomplete outgoing) removed [%p]",
@@ -493,27 +513,13 @@ void IAXEngine::removeTransaction(IAXTransaction* transaction)
 bool IAXEngine::haveTransactions()
 {
     Lock lock(this);
-    // Incomplete transactions
-    if (m_incompleteTransList.skipNull())
-	return true;
-    // Complete transactions
-    for (int i = 0; i < m_transListCount; i++)
-	if (m_transList[i]->skipNull())
-	    return true;
-    return false;
+    return m_transCount != 0;
 }
 
 u_int32_t IAXEngine::transactionCount()
 {
-    u_int32_t n = 0;
-
     Lock lock(this);
-    // Incomplete transactions
-    n += m_incompleteTransList.count();
-    // Complete transactions
-    for (int i = 0; i < m_transListCount; i++)
-	n += m_transList[i]->count();
-    return n;
+    return m_transCount;
 }
 
 void IAXEngine::keepAlive(const SocketAddr& addr)
@@ -583,68 +589,55 @@ void IAXEngine::processEvent(IAXEvent* event)
 
 IAXEvent* IAXEngine::getEvent(const Time& now)
 {
-    IAXTransaction* tr;
-    IAXEvent* ev;
-    ObjList* l;
-
-    lock();
-    // Find for incomplete transactions
-    l = m_incompleteTransList.skipNull();
-    for (; l; l = l->next()) {
+    for (;;) {
 	if (Thread::check(false))
-	    break;
-	tr = static_cast<IAXTransaction*>(l->get());
-	if (tr && 0 != (ev = tr->getEvent(now))) {
-	    unlock();
-	    return ev;
+	    return 0;
+	Lock lck(m_readyMutex);
+	// Queue transactions whose timer expired
+	while (m_timerCount && m_timerHeap[0]->m_timerTime <= now) {
+	    IAXTransaction* tr = m_timerHeap[0];
+	    schedule(tr,0);
+	    wakeup(tr);
 	}
-    }
-    // Find for complete transactions, start with current index
-    while (m_lastGetEvIndex < m_transListCount) {
-	if (Thread::check(false))
-	    break;
-	l = m_transList[m_lastGetEvIndex++]->skipNull();
+	ObjList* l = m_readyList.skipNull();
 	if (!l)
+	    return 0;
+	IAXTransaction* tr = static_cast<IAXTransaction*>(l->get());
+	// transaction goes back in the queue if it signals more work
+	tr->m_ready = false;
+	l->remove(false);
+	// keep transaction referenced but unlock the queue
+	RefPointer<IAXTransaction> t = tr;
+	lck.drop();
+	// dead pointer?
+	if (!t)
 	    continue;
-	ListIterator iter(*l);
-	for (;;) {
-	    tr = static_cast<IAXTransaction*>(iter.get());
-	    // end of iteration?
-	    if (!tr)
-		break;
-	    RefPointer<IAXTransaction> t = tr;
-	    // dead pointer?
-	    if (!t)
-		continue;
-	    unlock();
-	    if (0 != (ev = t->getEvent(now)))
-		return ev;
-	    lock();
+	IAXEvent* ev = t->getEvent(now);
+	if (ev) {
+	    // poll it again later, it may have more events queued
+	    wakeup(tr);
+	    return ev;
 	}
+	// Keep the transaction locked while scheduling it so a concurrent
+	//  poll can't replace its timer with an older one
+	Lock lckTr(tr);
+	u_int64_t time = tr->nextEventTime();
+	// getEvent() may leave a timer expired, check it later
+	if (time && time <= now)
+	    time = now + 1000;
+	schedule(tr,time);
     }
-    m_lastGetEvIndex = 0;
-    unlock();
-    return 0;
 }
 
-//TODO: Optimize generateCallNo & releaseCallNo
 u_int16_t IAXEngine::generateCallNo()
 {
-    u_int16_t i;
-
-    m_startLocalCallNo++;
-    if (m_startLocalCallNo > IAX2_MAX_CALLNO)
-	m_startLocalCallNo = IAX2_MIN_CALLNO;
-    for (i = m_startLocalCallNo; i <= IAX2_MAX_CALLNO; i++)
-	if (!m_lUsedCallNo[i]) {
-	    m_lUsedCallNo[i] = true;
-	    return i;
-	}
-    for (i = IAX2_MIN_CALLNO; i < m_startLocalCallNo; i++)
-	if (!m_lUsedCallNo[i]) {
-	    m_lUsedCallNo[i] = true;
-	    return i;
-	}
+    if (m_freeCallNoCount) {
+	u_int16_t callNo = m_freeCallNo[m_freeCallNoHead];
+	m_freeCallNoHead = (m_freeCallNoHead + 1) % (IAX2_MAX_CALLNO + 1);
+	m_freeCallNoCount--;
+	m_lUsedCallNo[callNo] = true;
+	return callNo;
+    }
     Debug(this,DebugWarn,"Unable to generate call number. Transaction count: %u [%p]",
 	transactionCount(),this);
     return 0;
@@ -652,7 +645,120 @@ u_int16_t IAXEngine::generateCallNo()
 
 void IAXEngine::releaseCallNo(u_int16_t lcallno)
 {
+    if (lcallno > IAX2_MAX_CALLNO || !m_lUsedCallNo[lcallno])
+	return;
     m_lUsedCallNo[lcallno] = false;
+    // Released numbers are reused last
+    unsigned int tail = (m_freeCallNoHead + m_freeCallNoCount) % (IAX2_MAX_CALLNO + 1);
+    m_freeCallNo[tail] = lcallno;
+    m_freeCallNoCount++;
+}
+
+// Queue a transaction to be polled by getEvent()
+void IAXEngine::wakeup(IAXTransaction* trans)
+{
+    Lock lck(m_readyMutex);
+    if (trans->m_ready || !trans->m_listed)
+	return;
+    trans->m_ready = true;
+    m_readyList.append(trans)->setDelete(false);
+}
+
+// Put a transaction in the timer heap or change its position
+void IAXEngine::schedule(IAXTransaction* trans, u_int64_t time)
+{
+    Lock lck(m_readyMutex);
+    if (!trans->m_listed)
+	time = 0;
+    int index = trans->m_timerIndex;
+    if (!time) {
+	if (index < 0)
+	    return;
+	// Replace it with the last entry
+	trans->m_timerIndex = -1;
+	IAXTransaction* last = m_timerHeap[--m_timerCount];
+	if ((unsigned int)index == m_timerCount)
+	    return;
+	m_timerHeap[index] = last;
+	last->m_timerIndex = index;
+	timerUp(index);
+	timerDown(last->m_timerIndex);
+	return;
+    }
+    trans->m_timerTime = time;
+    if (index < 0) {
+	if (m_timerCount == m_timerAlloc) {
+	    m_timerAlloc = m_timerAlloc ? 2 * m_timerAlloc : 64;
+	    IAXTransaction** heap = new IAXTransaction*[m_timerAlloc];
+	    for (unsigned int i = 0; i < m_timerCount; i++)
+		heap[i] = m_timerHeap[i];
+	    delete[] m_timerHeap;
+	    m_timerHeap = heap;
+	}
+	index = m_timerCount++;
+	m_timerHeap[index] = trans;
+	trans->m_timerIndex = index;
+    }
+    timerUp(index);
+    timerDown(trans->m_timerIndex);
+}
+
+// Start or stop polling a transaction
+void IAXEngine::setListed(IAXTransaction* trans, bool listed)
+{
+    Lock lck(m_readyMutex);
+    if (trans->m_listed == listed)
+	return;
+    if (listed) {
+	trans->m_listed = true;
+	m_transCount++;
+	wakeup(trans);
+	return;
+    }
+    schedule(trans,0);
+    trans->m_listed = false;
+    m_transCount--;
+    if (trans->m_ready) {
+	trans->m_ready = false;
+	m_readyList.remove(trans,false);
+    }
+}
+
+// Move a timer heap entry towards the top
+void IAXEngine::timerUp(unsigned int index)
+{
+    IAXTransaction* trans = m_timerHeap[index];
+    while (index) {
+	unsigned int parent = (index - 1) / 2;
+	if (m_timerHeap[parent]->m_timerTime <= trans->m_timerTime)
+	    break;
+	m_timerHeap[index] = m_timerHeap[parent];
+	m_timerHeap[index]->m_timerIndex = index;
+	index = parent;
+    }
+    m_timerHeap[index] = trans;
+    trans->m_timerIndex = index;
+}
+
+// Move a timer heap entry towards the bottom
+void IAXEngine::timerDown(unsigned int index)
+{
+    IAXTransaction* trans = m_timerHeap[index];
+    for (;;) {
+	unsigned int child = 2 * index + 1;
+	if (child >= m_timerCount)
+	    break;
+	if (child + 1 < m_timerCount &&
+	    m_timerHeap[child + 1]->m_timerTime < m_timerHeap[child]->m_timerTime)
+	    child++;
+	if (trans->m_timerTime <= m_timerHeap[child]->m_timerTime)
+	    break;
+	m_timerHeap[index] = m_timerHeap[child];
+	m_timerHeap[index]->m_timerIndex = index;
+	index = child;
+    }
+    m_timerHeap[index] = trans;
+    trans->m_timerIndex = index;
 }
 
 IAXTransaction* IAXEngine::startLocalTransaction(IAXTransaction::Type type,
@@ -668,6 +774,7 @@ IAXTransaction* IAXEngine::startLocalTransaction(IAXTransaction::Type type,
     if (tr) {
 	if (!refTrans || tr->ref()) {
 	    m_incompleteTransList.append(tr);
+	    setListed(tr,true);
 	    if (startTrans)
 		tr->start();
 	}
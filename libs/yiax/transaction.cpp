@@ -121,7 +121,11 @@ IAXTransaction::IAXTransaction(IAXEngine* engine, IAXFullFrame* frame, u_int16_t
     m_trunkInTsDelta(0),
     m_trunkInTsDiffRestart(5000),
     m_trunkInFirstTs(0),
-    m_startIEs(0)
+    m_startIEs(0),
+    m_listed(false),
+    m_ready(false),
+    m_timerIndex(-1),
+    m_timerTime(0)
 {
     switch (frame->subclass()) {
 	case IAXControl::New:
@@ -196,7 +200,11 @@ IAXTransaction::IAXTransaction(IAXEngine* engine, Type type, u_int16_t lcallno,
     m_trunkInTsDelta(0),
     m_trunkInTsDiffRestart(5000),
     m_trunkInFirstTs(0),
-    m_startIEs(0)
+    m_startIEs(0),
+    m_listed(false),
+    m_ready(false),
+    m_timerIndex(-1),
+    m_timerTime(0)
 {
     // Init data members
     if (!m_addr.port()) {
@@ -281,6 +289,13 @@ IAXTransaction* IAXTransaction::factoryOut(IAXEngine* engine, Type type, u_int16
     return 0;
 }
 
+// Set the destroy flag, let the engine poll the transaction to terminate it
+void IAXTransaction::setDestroy()
+{
+    m_destroy = true;
+    m_engine->wakeup(this);
+}
+
 // Start an outgoing transaction
 void IAXTransaction::start()
 {
@@ -395,6 +410,7 @@ IAXTransaction* IAXTransaction::processFrame(IAXFrame* frame)
 	"Transaction(%u,%u) enqueued Frame(%u,%u) iseq=%u oseq=%u stamp=%u [%p]",
 	localCallNo(),remoteCallNo(),frame->type(),full->subclass(),
 	full->iSeqNo(),full->oSeqNo(),frame->timeStamp(),this);
+    m_engine->wakeup(this);
     return this;
 }
 
@@ -1301,6 +1317,7 @@ bool IAXTransaction::changeState(State newState)
     Debug(m_engine,DebugAll,"Transaction(%u,%u) state changed %s --> %s [%p]",
 	localCallNo(),remoteCallNo(),stateName(),lookup(newState,s_stateName),this);
     m_state = newState;
+    m_engine->wakeup(this);
     switch (m_state) {
 	case Terminated:
 	case Terminating:
@@ -2117,6 +2134,7 @@ void IAXTransaction::eventTerminated(IAXEvent* event)
 	XDebug(m_engine,DebugAll,"Transaction(%u,%u). Event (%p) terminated. [%p]",
 	    localCallNo(),remoteCallNo(),event,this);
 	m_currentEvent = 0;
+	m_engine->wakeup(this);
     }
 }
 
@@ -2149,6 +2167,7 @@ void IAXTransaction::postFrame(IAXFrameOut* frame)
     incrementSeqNo(frame,false);
     m_outFrames.append(frame);
     sendFrame(frame);
+    m_engine->wakeup(this);
 }
 
 void IAXTransaction::receivedVoiceMiniBeforeFull()
@@ -2180,6 +2199,36 @@ void IAXTransaction::setPendingEvent(IAXEvent* ev)
     if (m_pendingEvent)
 	delete m_pendingEvent;
     m_pendingEvent = ev;
+    if (ev)
+	m_engine->wakeup(this);
+}
+
+// Retrieve the earliest time getEvent() has a timer to check
+u_int64_t IAXTransaction::nextEventTime()
+{
+    Lock lock(this);
+    // Nothing to check until the state changes or the current event is processed
+    if (state() == Terminated || m_destroy || m_currentEvent ||
+	(outgoing() && state() == Unknown))
+	return 0;
+    u_int64_t t = 0;
+    if (state() == Terminating) {
+	t = m_timeout;
+	// Outgoing frames are not checked if remote requested termination
+	if (!m_localReqEnd)
+	    return t;
+    }
+    else if (m_timeToNextPing)
+	t = m_timeToNextPing + 1;
+    for (ObjList* o = m_outFrames.skipNull(); o; o = o->skipNext()) {
+	IAXFrameOut* frame = static_cast<IAXFrameOut*>(o->get());
+	if (!t || frame->nextTransTime() < t)
+	    t = frame->nextTransTime();
+	// getEvent() stops at the first frame waiting for its final timeout
+	if (!frame->retransCount())
+	    break;
+    }
+    return t;
 }
 
 void IAXTransaction::init()
@@ -1398,6 +1398,13 @@ public:
     inline bool timeForRetrans(u_int64_t time) const
         { return time >= m_nextTransTime; }
 
+    /**
+     * Get the time of the next retransmission or timeout of this frame
+     * @return Next transmission time
+     */
+    inline u_int64_t nextTransTime() const
+        { return m_nextTransTime; }
+
     /**
      * Set the retransmission flag of this frame
      */
@@ -2012,8 +2019,7 @@ public:
     /**
      * Set the destroy flag
      */
-    inline void setDestroy()
-	{ m_destroy = true; }
+    void setDestroy();
 
     /**
      * Start an outgoing transaction.
@@ -2604,6 +2610,8 @@ private:
     void resetTrunk();
     void init();
     void setPendingEvent(IAXEvent* ev = 0);
+    // Earliest time a timer checked by getEvent() expires, 0 if none
+    u_int64_t nextEventTime();
     inline void restartTrunkIn(u_int64_t now, u_int32_t ts) {
 	    m_trunkInStartTime = now;
 	    u_int64_t dt = (now - m_lastVoiceFrameIn) / 1000;
@@ -2687,6 +2695,11 @@ private:
     u_int32_t m_trunkInFirstTs;                 // Incoming trunk without timestamp: first trunk timestamp
     // Postponed start
     IAXIEList* m_startIEs;                      // Postponed start
+    // Engine scheduling, changed only by the engine
+    bool m_listed;                              // Transaction is in the engine lists
+    bool m_ready;                               // Transaction is queued to be polled
+    int m_timerIndex;                           // Position in the engine timer heap or -1
+    u_int64_t m_timerTime;                      // Time to poll the transaction for timers
 };
 
 /**
@@ -2840,6 +2853,7 @@ private:
  */
 class YIAX_API IAXEngine : public DebugEnabler, public Mutex
 {
+    friend class IAXTransaction;
 public:
     /**
      * Constructor
@@ -3278,13 +3292,13 @@ protected:
     IAXEvent* getEvent(const Time& now = Time());
 
     /**
-     * Generate call number. Update used call numbers list
+     * Generate call number. Take it from the free call numbers queue
      * @return Call number or 0 if none available
      */
     u_int16_t generateCallNo();
 
     /**
-     * Release a call number
+     * Release a call number. Put it at the end of the free call numbers queue
      * @param lcallno Call number to release
      */
     void releaseCallNo(u_int16_t lcallno);
@@ -3314,17 +3328,34 @@ protected:
     int m_trunking;                             // Trunking capability: negative: ok, otherwise: not enabled
 
 private:
+    // Queue a transaction to be polled by getEvent()
+    void wakeup(IAXTransaction* trans);
+    // Set the time to poll a transaction for its timers, 0 to remove it from timer heap
+    void schedule(IAXTransaction* trans, u_int64_t time);
+    // Start or stop polling a transaction added to or removed from engine lists
+    void setListed(IAXTransaction* trans, bool listed);
+    // Restore timer heap order after changing an entry
+    void timerUp(unsigned int index);
+    void timerDown(unsigned int index);
+
     String m_name;                              // Engine name
     Socket m_socket;				// Socket
     SocketAddr m_addr;                          // Address we are bound on
     ObjList** m_transList;			// Full transactions
     ObjList m_incompleteTransList;		// Incomplete transactions (no remote call number)
     bool m_lUsedCallNo[IAX2_MAX_CALLNO + 1];	// Used local call numnmbers flags
-    int m_lastGetEvIndex;			// getEvent: keep last array entry
+    u_int16_t m_freeCallNo[IAX2_MAX_CALLNO + 1];	// Free local call numbers queue
+    unsigned int m_freeCallNoHead;		// First free call number in queue
+    unsigned int m_freeCallNoCount;		// Free call numbers count
+    u_int32_t m_transCount;			// Transactions count
+    Mutex m_readyMutex;				// Protects the ready queue and the timer heap
+    ObjList m_readyList;			// Transactions to be polled by getEvent
+    IAXTransaction** m_timerHeap;		// Transactions ordered by timer expire time
+    unsigned int m_timerCount;			// Timer heap entries
+    unsigned int m_timerAlloc;			// Timer heap allocated entries
     bool m_exiting;                             // Exiting flag
     // Parameters
     int m_maxFullFrameDataLen;			// Max full frame data (IE list) length
-    u_int16_t m_startLocalCallNo;		// Start index of local call number allocation
     u_int16_t m_transListCount;			// m_transList count
     unsigned int m_challengeTout;		// Sent challenge timeout interval
     bool m_callToken;                           // Call token required on incoming calls
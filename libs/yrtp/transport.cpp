@@ -20,7 +20,16 @@
 
 #include <yatertp.h>
 
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#include <errno.h>
+#endif
+
 #define BUF_SIZE 1500
+// Number of RTP packets read from a socket at once
+#define RECV_BATCH 8
+// Maximum number of socket events retrieved at once by a group
+#define POLL_EVENTS 64
 
 using namespace TelEngine;
 
@@ -44,7 +53,7 @@ static inline void setScopeId(const SocketAddr& local, SocketAddr& sa1,
 
 RTPGroup::RTPGroup(int msec, Priority prio)
     : Mutex(true,"RTPGroup"),
-      Thread("RTP Group",prio), m_listChanged(false)
+      Thread("RTP Group",prio), m_listChanged(false), m_changes(0), m_poll(-1)
 {
     DDebug(DebugInfo,"RTPGroup::RTPGroup() [%p]",this);
     if (msec < 1)
@@ -52,11 +61,21 @@ RTPGroup::RTPGroup(int msec, Priority prio)
     if (msec > 50)
 	msec = 50;
     m_sleep = msec;
+#ifdef HAVE_EPOLL
+    m_poll = ::epoll_create1(EPOLL_CLOEXEC);
+    if (m_poll < 0)
+	Debug(DebugMild,"RTPGroup could not create epoll descriptor: %d, polling sockets [%p]",
+	    errno,this);
+#endif
 }
 
 RTPGroup::~RTPGroup()
 {
     DDebug(DebugInfo,"RTPGroup::~RTPGroup() [%p]",this);
+#ifdef HAVE_EPOLL
+    if (m_poll >= 0)
+	::close(m_poll);
+#endif
 }
 
 void RTPGroup::cleanup()
@@ -78,30 +97,73 @@ void RTPGroup::cleanup()
     unlock();
 }
 
+// Tick all processors, return false if there are none left
+bool RTPGroup::tick(const Time& when)
+{
+    bool ok = false;
+    m_listChanged = false;
+    for (ObjList* l = &m_processors; l; l = l->next()) {
+	RTPProcessor* p = static_cast<RTPProcessor*>(l->get());
+	if (p) {
+	    ok = true;
+	    p->timerTick(when);
+	    // the list is protected from other threads but can be changed
+	    //  from this one so if it happened we just break out and try
+	    //  again later rather than using an expensive ListIterator
+	    if (m_listChanged)
+		break;
+	}
+    }
+    return ok;
+}
+
 void RTPGroup::run()
 {
     DDebug(DebugInfo,"RTPGroup::run() [%p]",this);
     bool ok = true;
+    u_int64_t next = 0;
     while (ok) {
 	unsigned long msec = m_sleep;
 	if (msec < s_sleep)
 	    msec = s_sleep;
-	lock();
-	Time t;
-	ObjList* l = &m_processors;
-	m_listChanged = false;
-	for (ok = false;l;l = l->next()) {
-	    RTPProcessor* p = static_cast<RTPProcessor*>(l->get());
-	    if (p) {
-		ok = true;
-		p->timerTick(t);
-		// the list is protected from other threads but can be changed
-		//  from this one so if it happened we just break out and try
-		//  again later rather than using an expensive ListIterator
-		if (m_listChanged)
-		    break;
+#ifdef HAVE_EPOLL
+	if (m_poll >= 0) {
+	    // wait for incoming data until the next periodic tick is due
+	    u_int64_t now = Time::now();
+	    int wait = (next > now) ? (int)((next - now + 999) / 1000) : 0;
+	    unsigned int changes = m_changes;
+	    struct epoll_event ev[POLL_EVENTS];
+	    int n = ::epoll_wait(m_poll,ev,POLL_EVENTS,wait);
+	    if ((n < 0) && (errno != EINTR)) {
+		Debug(DebugWarn,"RTPGroup epoll_wait failed: %d [%p]",errno,this);
+		Thread::msleep(msec);
+	    }
+	    lock();
+	    Time t;
+	    for (int i = 0; i < n; i++) {
+		RTPTransport* trans = static_cast<RTPTransport*>(ev[i].data.ptr);
+		// a transport may have left the group while we were waiting
+		if ((changes != m_changes) && !m_watched.find(trans))
+		    continue;
+		trans->m_readable = true;
+		trans->timerTick(t);
+		trans->m_readable = false;
+	    }
+	    if (t >= next) {
+		ok = tick(t);
+		// keep the period steady unless we fell behind
+		next += 1000 * (u_int64_t)msec;
+		if (next <= t)
+		    next = t + 1000 * (u_int64_t)msec;
 	    }
+	    unlock();
+	    Thread::check();
+	    continue;
 	}
+#endif
+	lock();
+	Time t;
+	ok = tick(t);
 	unlock();
 	Thread::msleep(msec,true);
     }
@@ -123,10 +185,56 @@ void RTPGroup::part(RTPProcessor* proc)
     DDebug(DebugAll,"RTPGroup::part(%p) [%p]",proc,this);
     lock();
     m_listChanged = true;
+    m_changes++;
     m_processors.remove(proc,false);
+    if (m_watched.find(proc))
+	unwatch(static_cast<RTPTransport*>(proc));
     unlock();
 }
 
+// Start watching a transport socket for incoming data
+// Return true if the socket is watched and needs to be read only when signaled
+bool RTPGroup::watch(RTPTransport* trans, Socket& sock, SOCKET& handle)
+{
+#ifdef HAVE_EPOLL
+    if (m_poll < 0)
+	return false;
+    if (handle == sock.handle())
+	return true;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = trans;
+    if (::epoll_ctl(m_poll,EPOLL_CTL_ADD,sock.handle(),&ev)) {
+	DDebug(DebugMild,"RTPGroup could not watch socket %d: %d [%p]",
+	    (int)sock.handle(),errno,this);
+	return false;
+    }
+    handle = sock.handle();
+    if (!m_watched.find(trans))
+	m_watched.append(trans)->setDelete(false);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Stop watching the sockets of a transport, they must still be open
+void RTPGroup::unwatch(RTPTransport* trans)
+{
+    if (!m_watched.remove(trans,false))
+	return;
+    m_changes++;
+#ifdef HAVE_EPOLL
+    struct epoll_event ev;
+    if (trans->m_rtpWatch != Socket::invalidHandle())
+	::epoll_ctl(m_poll,EPOLL_CTL_DEL,trans->m_rtpWatch,&ev);
+    if (trans->m_rtcpWatch != Socket::invalidHandle())
+	::epoll_ctl(m_poll,EPOLL_CTL_DEL,trans->m_rtcpWatch,&ev);
+#endif
+    trans->m_rtpWatch = Socket::invalidHandle();
+    trans->m_rtcpWatch = Socket::invalidHandle();
+}
+
 void RTPGroup::setMinSleep(int msec)
 {
     if (msec < 1)
@@ -177,7 +285,8 @@ void RTPProcessor::getStats(String& stats) const
 RTPTransport::RTPTransport(RTPTransport::Type type)
     : RTPProcessor(),
       m_type(type), m_processor(0), m_monitor(0), m_autoRemote(false),
-      m_warnSendErrorRtp(true), m_warnSendErrorRtcp(true)
+      m_warnSendErrorRtp(true), m_warnSendErrorRtcp(true), m_readable(false),
+      m_rtpWatch(Socket::invalidHandle()), m_rtcpWatch(Socket::invalidHandle())
 {
     DDebug(DebugAll,"RTPTransport::RTPTransport(%d) [%p]",type,this);
 }
@@ -204,56 +313,80 @@ void RTPTransport::destruct()
 void RTPTransport::timerTick(const Time& when)
 {
     XDebug(DebugAll,"RTPTransport::timerTick() group=%p [%p]",group(),this);
+    // sockets watched by the group are read only when they have data
     if (m_rtpSock.valid()) {
-	char buf[BUF_SIZE];
-	int len;
-	while ((len = m_rtpSock.recvFrom(buf,sizeof(buf),m_rxAddrRTP)) > 0) {
-	    XDebug(DebugAll,"RTP/UDPTL from '%s:%d' length %d [%p]",
-		m_rxAddrRTP.host().c_str(),m_rxAddrRTP.port(),len,this);
-	    switch (m_type) {
-		case RTP:
-		    if (len < 12)
-			continue;
-		    if (((unsigned char)buf[0] & 0xc0) != 0x80)
-			continue;
-		    break;
-		case UDPTL:
-		    if (len < 6)
-			continue;
-		    break;
-		default:
-		    break;
-	    }
-	    if (!m_remoteAddr.valid())
-		continue;
-	    // looks like it's RTP or UDPTL, at least by length and version
-	    bool preferred = false;
-	    if ((m_autoRemote || (preferred = (m_rxAddrRTP == m_remotePref))) && (m_rxAddrRTP != m_remoteAddr)) {
-		Debug(DebugInfo,"Auto changing RTP address from %s:%d to%s %s:%d",
-		    m_remoteAddr.host().c_str(),m_remoteAddr.port(),
-		    (preferred ? " preferred" : ""),
-		    m_rxAddrRTP.host().c_str(),m_rxAddrRTP.port());
-		// if we received from the preferred address don't auto change any more
-		if (preferred)
-		    m_remotePref.clear();
-		remoteAddr(m_rxAddrRTP);
+	bool read = m_readable || !(group() && group()->watch(this,m_rtpSock,m_rtpWatch));
+	while (read) {
+	    char data[RECV_BATCH][BUF_SIZE];
+	    void* bufs[RECV_BATCH];
+	    int lens[RECV_BATCH];
+	    SocketAddr from[RECV_BATCH];
+	    for (int i = 0; i < RECV_BATCH; i++) {
+		bufs[i] = data[i];
+		lens[i] = BUF_SIZE;
 	    }
-	    m_autoRemote = false;
-	    if (m_rxAddrRTP == m_remoteAddr) {
-		if (m_processor)
-		    m_processor->rtpData(buf,len);
-		if (m_monitor)
-		    m_monitor->rtpData(buf,len);
+	    int n = m_rtpSock.recvMany(bufs,lens,from,RECV_BATCH);
+	    // stop when the socket was drained
+	    read = (n == RECV_BATCH);
+	    for (int i = 0; i < n; i++) {
+		const char* buf = data[i];
+		int len = lens[i];
+		SocketAddr& rxAddr = from[i];
+		if (len <= 0) {
+		    // zero length datagram ends the loop as in single reads
+		    if (!len)
+			read = false;
+		    continue;
+		}
+		XDebug(DebugAll,"RTP/UDPTL from '%s:%d' length %d [%p]",
+		    rxAddr.host().c_str(),rxAddr.port(),len,this);
+		switch (m_type) {
+		    case RTP:
+			if (len < 12)
+			    continue;
+			if (((unsigned char)buf[0] & 0xc0) != 0x80)
+			    continue;
+			break;
+		    case UDPTL:
+			if (len < 6)
+			    continue;
+			break;
+		    default:
+			break;
+		}
+		if (!m_remoteAddr.valid())
+		    continue;
+		// looks like it's RTP or UDPTL, at least by length and version
+		bool preferred = false;
+		if ((m_autoRemote || (preferred = (rxAddr == m_remotePref))) && (rxAddr != m_remoteAddr)) {
+		    Debug(DebugInfo,"Auto changing RTP address from %s:%d to%s %s:%d",
+			m_remoteAddr.host().c_str(),m_remoteAddr.port(),
+			(preferred ? " preferred" : ""),
+			rxAddr.host().c_str(),rxAddr.port());
+		    // if we received from the preferred address don't auto change any more
+		    if (preferred)
+			m_remotePref.clear();
+		    remoteAddr(rxAddr);
+		}
+		m_autoRemote = false;
+		if (rxAddr == m_remoteAddr) {
+		    if (m_processor)
+			m_processor->rtpData(buf,len);
+		    if (m_monitor)
+			m_monitor->rtpData(buf,len);
+		}
+		else if (m_processor)
+		    m_processor->incWrongSrc();
 	    }
-	    else if (m_processor)
-		m_processor->incWrongSrc();
 	}
 	m_rtpSock.timerTick(when);
     }
     if (m_rtcpSock.valid()) {
 	char buf[BUF_SIZE];
-	int len;
-	while (((len = m_rtcpSock.recvFrom(buf,sizeof(buf),m_rxAddrRTCP)) >= 8) && (m_rxAddrRTCP == m_remoteRTCP)) {
+	int len = 0;
+	if (!m_readable && group() && group()->watch(this,m_rtcpSock,m_rtcpWatch))
+	    len = -1;
+	while ((len >= 0) && ((len = m_rtcpSock.recvFrom(buf,sizeof(buf),m_rxAddrRTCP)) >= 8) && (m_rxAddrRTCP == m_remoteRTCP)) {
 	    XDebug(DebugAll,"RTCP from '%s:%d' length %d [%p]",
 		m_rxAddrRTCP.host().c_str(),m_rxAddrRTCP.port(),len,this);
 	    if (m_processor)
@@ -343,6 +476,8 @@ void RTPTransport::setMonitor(RTPProcessor* monitor)
 
 bool RTPTransport::localAddr(SocketAddr& addr, bool rtcp)
 {
+    // keep the group from watching sockets that may still be swapped
+    Lock lock(group());
     // check if sockets are already created and bound
     if (m_rtpSock.valid())
 	return false;
@@ -137,11 +137,15 @@ private:
 /**
  * Several possibly related RTP processors share the same RTP group which
  *  holds the thread that keeps them running.
+ * Where supported the thread waits for data on the sockets of the group's
+ *  transports and reads them as soon as it arrives, all processors are
+ *  ticked at a fixed period regardless of incoming traffic.
  * @short A group of RTP processors handled by the same thread
  */
 class YRTP_API RTPGroup : public GenObject, public Mutex, public Thread
 {
     friend class RTPProcessor;
+    friend class RTPTransport;
 
 public:
     /**
@@ -185,9 +189,15 @@ public:
     void part(RTPProcessor* proc);
 
 private:
+    bool tick(const Time& when);
+    bool watch(RTPTransport* trans, Socket& sock, SOCKET& handle);
+    void unwatch(RTPTransport* trans);
     ObjList m_processors;
+    ObjList m_watched;
     bool m_listChanged;
+    unsigned int m_changes;
     unsigned long m_sleep;
+    int m_poll;
 };
 
 /**
@@ -196,6 +206,7 @@ private:
  */
 class YRTP_API RTPTransport : public RTPProcessor
 {
+    friend class RTPGroup;
 public:
     /**
      * Activation status of the transport
@@ -339,11 +350,13 @@ private:
     SocketAddr m_remoteAddr;
     SocketAddr m_remoteRTCP;
     SocketAddr m_remotePref;
-    SocketAddr m_rxAddrRTP;
     SocketAddr m_rxAddrRTCP;
     bool m_autoRemote;
     bool m_warnSendErrorRtp;
     bool m_warnSendErrorRtcp;
+    bool m_readable;
+    SOCKET m_rtpWatch;
+    SOCKET m_rtcpWatch;
 };
 
 /**
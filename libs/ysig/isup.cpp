@@ -2225,6 +2225,7 @@ SS7ISUPCall::SS7ISUPCall(SS7ISUP* controller, SignallingCircuit* cic,
     m_terminate(false),
     m_gracefully(true),
     m_circuitChanged(false),
+    m_indexCic(-1),
     m_circuitTesting(false),
     m_inbandAvailable(false),
     m_replaceCounter(3),
@@ -2266,6 +2267,8 @@ SS7ISUPCall::SS7ISUPCall(SS7ISUP* controller, SignallingCircuit* cic,
 
 SS7ISUPCall::~SS7ISUPCall()
 {
+    if (controller())
+	isup()->indexCall(this,false);
     TelEngine::destruct(m_iamMsg);
     TelEngine::destruct(m_sgmMsg);
     const char* timeout = 0;
@@ -3706,6 +3709,7 @@ SignallingCall* SS7ISUP::call(SignallingMessage* msg, String& reason)
 	call = new SS7ISUPCall(this,cic,*m_defPoint,dest,true,sls,range);
 	call->ref();
 	m_calls.append(call);
+	indexCall(call);
 	SignallingEvent* event = new SignallingEvent(SignallingEvent::NewCall,msg,call);
 	// (re)start RSC timer if not currently reseting
 	if (!m_rscCic && m_rscTimer.interval())
@@ -3789,6 +3793,7 @@ int SS7ISUP::transmitMessage(SS7MsgISUP* msg, const SS7Label& label, bool recvLb
 void SS7ISUP::cleanup(const char* reason)
 {
     lock();
+    m_callIndex.clear();
     for (ObjList* o = m_calls.skipNull(); o; o = o->skipNext()) {
 	SS7ISUPCall* call = static_cast<SS7ISUPCall*>(o->get());
 	call->setTerminate(true,reason);
@@ -3803,6 +3808,7 @@ void SS7ISUP::cleanup(const char* reason)
 void SS7ISUP::destroyed()
 {
     lock();
+    m_callIndex.clear();
     clearCalls();
     unlock();
     SignallingCallControl::attach(0);
@@ -5025,6 +5031,7 @@ void SS7ISUP::processCallMsg(SS7MsgISUP* msg, const SS7Label& label, int sls)
 	    // Accept the incoming request. Change the call's circuit
 	    reserveCircuit(circuit,call->cicRange(),SignallingCircuit::LockLockedBusy);
 	    call->replaceCircuit(circuit);
+	    indexCall(call);
 	    circuit = 0;
 	    call = 0;
 	}
@@ -5051,6 +5058,7 @@ void SS7ISUP::processCallMsg(SS7MsgISUP* msg, const SS7Label& label, int sls)
 	    call = new SS7ISUPCall(this,circuit,label.dpc(),label.opc(),false,label.sls(),
 		0,msg->type() == SS7MsgISUP::CCR);
 	    m_calls.append(call);
+	    indexCall(call);
 	    break;
 	}
 	// Congestion: send REL
@@ -5505,6 +5513,7 @@ bool SS7ISUP::resetCircuit(unsigned int cic, bool remote, bool checkCall)
 	        SignallingCircuit* newCircuit = 0;
 		reserveCircuit(newCircuit,call->cicRange(),SignallingCircuit::LockLockedBusy);
 		call->replaceCircuit(newCircuit);
+		indexCall(call);
 	    }
 	    else
 		call->setTerminate(false,"normal");
@@ -5564,12 +5573,36 @@ bool SS7ISUP::blockCircuit(unsigned int cic, bool block, bool remote, bool hwFai
 
 SS7ISUPCall* SS7ISUP::findCall(unsigned int cic)
 {
-    for (ObjList* o = m_calls.skipNull(); o; o = o->skipNext()) {
-	SS7ISUPCall* call = static_cast<SS7ISUPCall*>(o->get());
-	if (call->id() == cic)
-	    return call;
+    if (cic >= m_callIndex.length() / sizeof(SS7ISUPCall*))
+	return 0;
+    SS7ISUPCall* call = ((SS7ISUPCall**)m_callIndex.data())[cic];
+    // the call may have released or replaced its circuit since indexed
+    return (call && call->id() == cic) ? call : 0;
+}
+
+void SS7ISUP::indexCall(SS7ISUPCall* call, bool add)
+{
+    if (!call)
+	return;
+    Lock mylock(this);
+    SS7ISUPCall** calls = (SS7ISUPCall**)m_callIndex.data();
+    unsigned int len = m_callIndex.length() / sizeof(SS7ISUPCall*);
+    if (call->m_indexCic >= 0 && (unsigned int)call->m_indexCic < len &&
+	calls[call->m_indexCic] == call)
+	calls[call->m_indexCic] = 0;
+    call->m_indexCic = -1;
+    if (!(add && call->m_circuit))
+	return;
+    unsigned int cic = call->id();
+    if (cic >= len) {
+	DataBlock tmp(0,(cic + 1 - len) * sizeof(SS7ISUPCall*));
+	m_callIndex += tmp;
+	if (m_callIndex.length() <= cic * sizeof(SS7ISUPCall*))
+	    return;
+	calls = (SS7ISUPCall**)m_callIndex.data();
     }
-    return 0;
+    calls[cic] = call;
+    call->m_indexCic = cic;
 }
 
 // Utility used in sendLocalLock()
@@ -6177,6 +6210,7 @@ void SS7ISUP::replaceCircuit(unsigned int cic, const String& map, bool rel)
 	}
 	unlock();
 	call->replaceCircuit(newCircuit,m);
+	indexCall(call);
 	if (m) {
 	    SignallingMessageTimer* t = 0;
 	    if (rel)
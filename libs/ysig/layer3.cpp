@@ -169,6 +169,8 @@ bool SS7Layer3::buildRoutes(const NamedList& params)
 {
     Lock lock(m_routeMutex);
     for (unsigned int i = 0; i < YSS7_PCTYPE_COUNT; i++) {
+	for (unsigned int h = 0; h < YSS7_ROUTE_HASH; h++)
+	    m_routeHash[i][h].clear();
 	m_route[i].clear();
 	m_local[i] = 0;
     }
@@ -233,7 +235,7 @@ bool SS7Layer3::buildRoutes(const NamedList& params)
 	    continue;
 	}
 	added = true;
-	m_route[(unsigned int)type - 1].append(new SS7Route(packed,type,prio,shift,maxLength));
+	appendRoute(new SS7Route(packed,type,prio,shift,maxLength),type);
 	DDebug(this,DebugAll,"Added route '%s'",ns->c_str());
     }
     if (!added)
@@ -448,7 +450,7 @@ SS7Route* SS7Layer3::findRoute(SS7PointCode::Type type, unsigned int packed)
     if (index >= YSS7_PCTYPE_COUNT)
 	return 0;
     Lock lock(m_routeMutex);
-    for (ObjList* o = m_route[index].skipNull(); o; o = o->skipNext()) {
+    for (ObjList* o = m_routeHash[index][packed % YSS7_ROUTE_HASH].skipNull(); o; o = o->skipNext()) {
 	SS7Route* route = static_cast<SS7Route*>(o->get());
 	if (route->packed() == packed)
 	    return route;
@@ -456,6 +458,26 @@ SS7Route* SS7Layer3::findRoute(SS7PointCode::Type type, unsigned int packed)
     return 0;
 }
 
+// Append a route to the routing table and to the point code hash
+void SS7Layer3::appendRoute(SS7Route* route, SS7PointCode::Type type)
+{
+    unsigned int index = (unsigned int)type - 1;
+    if (!route || index >= YSS7_PCTYPE_COUNT)
+	return;
+    m_route[index].append(route);
+    m_routeHash[index][route->packed() % YSS7_ROUTE_HASH].append(route)->setDelete(false);
+}
+
+// Remove a route from the point code hash and from the routing table
+void SS7Layer3::removeRoute(SS7Route* route, SS7PointCode::Type type)
+{
+    unsigned int index = (unsigned int)type - 1;
+    if (!route || index >= YSS7_PCTYPE_COUNT)
+	return;
+    m_routeHash[index][route->packed() % YSS7_ROUTE_HASH].remove(route,false);
+    m_route[index].remove(route,true);
+}
+
 void SS7Layer3::printRoutes()
 {
     String s;
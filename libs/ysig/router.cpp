@@ -1001,7 +1001,7 @@ void SS7Router::updateRoutes(SS7Layer3* network)
 	    }
 	    else {
 		dest = new SS7Route(*src);
-		m_route[i].append(dest);
+		appendRoute(dest,type);
 	    }
 	    DDebug(this,DebugAll,"Add route type=%s packed=%u for network (%p,'%s') [%p]",
 		SS7PointCode::lookup(type),src->m_packed,network,network->toString().safe(),this);
@@ -1036,7 +1036,7 @@ void SS7Router::removeRoutes(SS7Layer3* network)
 			route->m_state = SS7Route::Prohibited;
 			routeChanged(route,type,0,network);
 		}
-		m_route[i].remove(route,true);
+		removeRoute(route,type);
 	    }
 	}
     }
@@ -764,15 +764,24 @@ SignallingCircuit* SignallingCircuitGroup::find(unsigned int cic, bool local)
 	cic -= m_base;
     }
     Lock mylock(this);
-    if (cic >= m_range.m_last)
+    if (cic >= m_range.m_last || cic >= m_cicIndex.length() / sizeof(SignallingCircuit*))
 	return 0;
-    ObjList* l = m_circuits.skipNull();
-    for (; l; l = l->skipNext()) {
-	SignallingCircuit* c = static_cast<SignallingCircuit*>(l->get());
-	if (c->code() == cic)
-	    return c;
+    return ((SignallingCircuit**)m_cicIndex.data())[cic];
+}
+
+// Set or clear the circuit index entry of a code, grow the index if needed
+void SignallingCircuitGroup::indexCircuit(unsigned int code, SignallingCircuit* circuit)
+{
+    unsigned int len = m_cicIndex.length() / sizeof(SignallingCircuit*);
+    if (code >= len) {
+	if (!circuit)
+	    return;
+	DataBlock tmp(0,(code + 1 - len) * sizeof(SignallingCircuit*));
+	m_cicIndex += tmp;
+	if (m_cicIndex.length() <= code * sizeof(SignallingCircuit*))
+	    return;
     }
-    return 0;
+    ((SignallingCircuit**)m_cicIndex.data())[code] = circuit;
 }
 
 // Find a range of circuits owned by this group
@@ -803,6 +812,7 @@ bool SignallingCircuitGroup::insert(SignallingCircuit* circuit)
 	return false;
     circuit->m_group = this;
     m_circuits.append(circuit);
+    indexCircuit(circuit->code(),circuit);
     m_range.add(circuit->code());
     return true;
 }
@@ -815,6 +825,7 @@ void SignallingCircuitGroup::remove(SignallingCircuit* circuit)
     Lock mylock(this);
     if (!m_circuits.remove(circuit,false))
 	return;
+    indexCircuit(circuit->code(),0);
     circuit->m_group = 0;
     m_range.remove(circuit->code());
     // TODO: remove from all ranges
@@ -1111,6 +1122,7 @@ void SignallingCircuitGroup::clearAll()
 	c->m_group = 0;
     }
     m_circuits.clear();
+    m_cicIndex.clear();
     m_ranges.clear();
 }
 
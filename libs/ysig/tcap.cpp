@@ -265,6 +265,7 @@ SS7TCAP::SS7TCAP(const NamedList& params)
       m_remoteTypePC(SS7PointCode::Other),
       m_trTimeout(300),
       m_transactionsMtx(true,"TCAPTransactions"),
+      m_transactions(1021),
       m_tcapType(UnknownTCAP),
       m_idsPool(0)
 {
@@ -609,7 +610,7 @@ SS7TCAPTransaction* SS7TCAP::getTransaction(const String& tid)
 void SS7TCAP::removeTransaction(SS7TCAPTransaction* tr)
 {
     Lock lock(m_transactionsMtx);
-    m_transactions.remove(tr);
+    m_transactions.remove(tr,true,true);
 }
 
 void SS7TCAP::timerTick(const Time& when)
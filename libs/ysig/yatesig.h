@@ -2354,8 +2354,10 @@ protected:
 private:
     unsigned int advance(unsigned int n, int strategy, SignallingCircuitRange& range);
     void clearAll();
+    void indexCircuit(unsigned int code, SignallingCircuit* circuit);
 
     ObjList m_circuits;                  // The circuits belonging to this group
+    DataBlock m_cicIndex;                // Circuits indexed by their code
     ObjList m_spans;                     // The spans belonging to this group
     ObjList m_ranges;                    // Additional circuit ranges
     SignallingCircuitRange m_range;      // Range containing all circuits belonging to this group
@@ -3685,6 +3687,9 @@ private:
 // The number of valid point code types
 #define YSS7_PCTYPE_COUNT (SS7PointCode::DefinedTypes-1)
 
+// Number of buckets used to look up routes by packed point code
+#define YSS7_ROUTE_HASH 32
+
 /**
  * Operator to write a point code to a string
  * @param str String to append to
@@ -6614,12 +6619,30 @@ protected:
     inline const ObjList* getRoutes(SS7PointCode::Type type) const
 	{ return (type < SS7PointCode::DefinedTypes) ? &m_route[type-1] : 0; }
 
+    /**
+     * Append a route to the routing table, the routing mutex must be locked
+     * @param route The route to append, the table takes ownership of it
+     * @param type Point code type of the route
+     */
+    void appendRoute(SS7Route* route, SS7PointCode::Type type);
+
+    /**
+     * Remove a route from the routing table and destroy it,
+     *  the routing mutex must be locked
+     * @param route The route to remove
+     * @param type Point code type of the route
+     */
+    void removeRoute(SS7Route* route, SS7PointCode::Type type);
+
     /** Mutex to lock routing list operations */
     Mutex m_routeMutex;
 
     /** Outgoing point codes serviced by a network (for each point code type) */
     ObjList m_route[YSS7_PCTYPE_COUNT];
 
+    /** Routes hashed by packed point code, entries are not owned */
+    ObjList m_routeHash[YSS7_PCTYPE_COUNT][YSS7_ROUTE_HASH];
+
 private:
     Mutex m_l3userMutex;                 // Mutex to lock L3 user pointer
     SS7L3User* m_l3user;
@@ -8793,6 +8816,7 @@ private:
     bool m_terminate;                    // Termination flag
     bool m_gracefully;                   // Terminate gracefully: send RLC
     bool m_circuitChanged;               // Circuit change flag
+    int m_indexCic;                      // Circuit code the controller indexed this call by
     bool m_circuitTesting;               // The circuit is tested for continuity
     bool m_inbandAvailable;              // Inband data is available
     int m_replaceCounter;                // Circuit replace counter
@@ -9148,6 +9172,9 @@ private:
     // Find a call by its circuit identification code
     // This method is not thread safe
     SS7ISUPCall* findCall(unsigned int cic);
+    // Index a call by the code of its current circuit, remove the old index entry
+    // @param add False to only remove the call from index
+    void indexCall(SS7ISUPCall* call, bool add = true);
     // Find a call by its circuit identification code
     // This method is thread safe
     inline void findCall(unsigned int cic, RefPointer<SS7ISUPCall>& call) {
@@ -9192,6 +9219,7 @@ private:
     void cicHwBlocked(unsigned int cic, const String& map);
 
     SS7PointCode::Type m_type;           // Point code type of this call controller
+    DataBlock m_callIndex;               // Calls indexed by circuit code
     ObjList m_pointCodes;                // Point codes serviced by this call controller
     SS7PointCode* m_defPoint;            // Default point code for outgoing calls
     SS7PointCode* m_remotePoint;         // Default remote point code for outgoing calls and maintenance
@@ -11157,9 +11185,9 @@ protected:
     SS7PointCode::Type m_remoteTypePC;
     u_int64_t m_trTimeout;
 
-    // list of current TCAP transactions
+    // current TCAP transactions hashed by local ID
     Mutex m_transactionsMtx;
-    ObjList m_transactions;
+    HashList m_transactions;
     // type of TCAP
     TCAPType m_tcapType;
 
@@ -27,8 +27,54 @@
 #include <stdio.h>
 
 
+// Resolution of the transaction timer wheel in microseconds
+#define SIP_TIMER_TICK 10000
+// Number of slots in the timer wheel, one turn must cover the short timers
+#define SIP_TIMER_SLOTS 1024
+
 using namespace TelEngine;
 
+namespace { // anonymous
+
+// Entry of a transaction in one of the engine's matching indexes
+class TransIndex : public String
+{
+public:
+    inline TransIndex(const String& key, SIPTransaction* trans)
+	: String(key), m_trans(trans)
+	{ }
+    inline SIPTransaction* trans() const
+	{ return m_trans; }
+private:
+    SIPTransaction* m_trans;
+};
+
+}; // anonymous namespace
+
+// Index a transaction, keeping the relative order of the transaction list
+static void indexAdd(HashList& index, const String& key, SIPTransaction* trans, bool first)
+{
+    TransIndex* ti = new TransIndex(key,trans);
+    index.append(ti);
+    if (first) {
+	ObjList* l = index.getHashList(key);
+	l->remove(ti,false);
+	l->insert(ti);
+    }
+}
+
+// Remove the index entry of a transaction
+static void indexRemove(HashList& index, const String& key, SIPTransaction* trans)
+{
+    ObjList* l = index.getHashList(key);
+    for (l = l ? l->skipNull() : 0; l; l = l->skipNext()) {
+	if (static_cast<TransIndex*>(l->get())->trans() == trans) {
+	    l->remove();
+	    return;
+	}
+    }
+}
+
 static TokenDict sip_responses[] = {
     { "Trying", 100 },
     { "Ringing", 180 },
@@ -169,6 +215,9 @@ SIPEvent::~SIPEvent()
 
 SIPEngine::SIPEngine(const char* userAgent)
     : Mutex(true,"SIPEngine"),
+      m_branchIndex(1021), m_callidIndex(1021),
+      m_timerWheel(0), m_timerTick(Time::now() / SIP_TIMER_TICK),
+      m_transCount(0), m_eventCount(0), m_scanCount(0),
       m_t1(500000), m_t4(5000000), m_reqTransCount(5), m_rspTransCount(6),
       m_maxForwards(70),
       m_cseq(0), m_flags(0), m_lazyTrying(false),
@@ -184,11 +233,151 @@ SIPEngine::SIPEngine(const char* userAgent)
     char tmp[32];
     ::snprintf(tmp,sizeof(tmp),"%08x",(int)(Random::random() ^ Time::now()));
     m_nonce_secret = tmp;
+    m_timerWheel = new ObjList[SIP_TIMER_SLOTS];
 }
 
 SIPEngine::~SIPEngine()
 {
     DDebug(this,DebugInfo,"SIPEngine::~SIPEngine() [%p]",this);
+    clearTransactions();
+    delete[] m_timerWheel;
+}
+
+void SIPEngine::remove(SIPTransaction* transaction)
+{
+    if (!transaction)
+	return;
+    Lock lock(this);
+    if (transaction->m_ready) {
+	transaction->m_ready = false;
+	m_readyList.remove(transaction,false);
+    }
+    if (transaction->m_slot >= 0) {
+	m_timerWheel[transaction->m_slot].remove(transaction,false);
+	transaction->m_slot = -1;
+    }
+    if (!transaction->m_listed)
+	return;
+    transaction->m_listed = false;
+    m_transCount--;
+    m_transList.remove(transaction,false);
+    if (transaction->getBranch())
+	indexRemove(m_branchIndex,transaction->getBranch(),transaction);
+    indexRemove(m_callidIndex,transaction->getCallID(),transaction);
+}
+
+void SIPEngine::append(SIPTransaction* transaction)
+{
+    if (!transaction)
+	return;
+    Lock lock(this);
+    m_transList.append(transaction);
+    transaction->m_listed = true;
+    m_transCount++;
+    if (transaction->getBranch())
+	indexAdd(m_branchIndex,transaction->getBranch(),transaction,false);
+    indexAdd(m_callidIndex,transaction->getCallID(),transaction,false);
+    wakeup(transaction);
+    schedule(transaction);
+}
+
+void SIPEngine::insert(SIPTransaction* transaction)
+{
+    if (!transaction)
+	return;
+    Lock lock(this);
+    m_transList.insert(transaction);
+    transaction->m_listed = true;
+    m_transCount++;
+    if (transaction->getBranch())
+	indexAdd(m_branchIndex,transaction->getBranch(),transaction,true);
+    indexAdd(m_callidIndex,transaction->getCallID(),transaction,true);
+    wakeup(transaction);
+    schedule(transaction);
+}
+
+void SIPEngine::reindex(SIPTransaction* transaction, const String& oldBranch)
+{
+    if (!transaction || (oldBranch == transaction->getBranch()))
+	return;
+    Lock lock(this);
+    if (!transaction->m_listed)
+	return;
+    if (oldBranch)
+	indexRemove(m_branchIndex,oldBranch,transaction);
+    if (transaction->getBranch())
+	indexAdd(m_branchIndex,transaction->getBranch(),transaction,false);
+}
+
+void SIPEngine::clearTransactions()
+{
+    Lock lock(this);
+    for (ObjList* l = m_transList.skipNull(); l; l = l->skipNext()) {
+	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	t->m_listed = false;
+	t->m_ready = false;
+	t->m_slot = -1;
+    }
+    m_readyList.clear();
+    for (unsigned int i = 0; i < SIP_TIMER_SLOTS; i++)
+	m_timerWheel[i].clear();
+    m_branchIndex.clear();
+    m_callidIndex.clear();
+    m_transCount = 0;
+    m_transList.clear();
+}
+
+// Queue a transaction to be polled for events
+void SIPEngine::wakeup(SIPTransaction* transaction)
+{
+    Lock lock(this);
+    if (transaction->m_ready || !transaction->m_listed)
+	return;
+    transaction->m_ready = true;
+    m_readyList.append(transaction)->setDelete(false);
+}
+
+// Put a transaction in the timer wheel slot of its timeout
+void SIPEngine::schedule(SIPTransaction* transaction)
+{
+    Lock lock(this);
+    if (transaction->m_slot >= 0) {
+	m_timerWheel[transaction->m_slot].remove(transaction,false);
+	transaction->m_slot = -1;
+    }
+    if (!(transaction->m_timeout && transaction->m_listed))
+	return;
+    u_int64_t tick = transaction->m_timeout / SIP_TIMER_TICK;
+    // the current slot is checked again on each call so it is safe to use
+    if (tick < m_timerTick)
+	tick = m_timerTick;
+    transaction->m_slot = (int)(tick % SIP_TIMER_SLOTS);
+    m_timerWheel[transaction->m_slot].append(transaction)->setDelete(false);
+}
+
+// Move transactions whose timer has expired to the ready list
+void SIPEngine::expireTimers(u_int64_t time)
+{
+    u_int64_t tick = time / SIP_TIMER_TICK;
+    unsigned int slots = SIP_TIMER_SLOTS;
+    if (tick - m_timerTick < slots)
+	slots = (unsigned int)(tick - m_timerTick) + 1;
+    for (unsigned int i = 0; i < slots; i++) {
+	ObjList* l = &m_timerWheel[(m_timerTick + i) % SIP_TIMER_SLOTS];
+	while (l) {
+	    SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	    // entries due in a later turn of the wheel stay where they are
+	    if (!t || (t->m_timeout > time)) {
+		l = l->next();
+		continue;
+	    }
+	    t->m_slot = -1;
+	    l->remove(false);
+	    wakeup(t);
+	}
+    }
+    // stay on the current slot, it may still hold timers due later in this tick
+    m_timerTick = tick;
 }
 
 SIPTransaction* SIPEngine::addMessage(SIPParty* ep, const char* buf, int len)
@@ -227,20 +416,46 @@ SIPTransaction* SIPEngine::addMessage(SIPMessage* message)
 	branch = *br;
     Lock lock(this);
     SIPTransaction* forked = 0;
-    ObjList* l = &m_transList;
-    for (; l; l = l->next()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
-	if (!t)
-	    continue;
-	switch (t->processMessage(message,branch)) {
-	    case SIPTransaction::Matched:
-		return t;
-	    case SIPTransaction::NoDialog:
-		forked = t;
-		break;
-	    case SIPTransaction::NoMatch:
-	    default:
-		break;
+    // a transaction can only match messages with the same branch or Call-ID
+    // forked answers to INVITE share the branch so they are found here too
+    if (branch) {
+	ObjList* l = m_branchIndex.getHashList(branch);
+	for (l = l ? l->skipNull() : 0; l; l = l->skipNext()) {
+	    TransIndex* ti = static_cast<TransIndex*>(l->get());
+	    if (*ti != branch)
+		continue;
+	    switch (ti->trans()->processMessage(message,branch)) {
+		case SIPTransaction::Matched:
+		    return ti->trans();
+		case SIPTransaction::NoDialog:
+		    forked = ti->trans();
+		    break;
+		case SIPTransaction::NoMatch:
+		default:
+		    break;
+	    }
+	}
+    }
+    // messages with no RFC 3261 branch and ACKs to 2xx are matched by Call-ID
+    if (branch.null() || message->isACK()) {
+	const String& callid = message->getHeaderValue("Call-ID");
+	ObjList* l = m_callidIndex.getHashList(callid);
+	for (l = l ? l->skipNull() : 0; l; l = l->skipNext()) {
+	    TransIndex* ti = static_cast<TransIndex*>(l->get());
+	    SIPTransaction* t = ti->trans();
+	    // skip transactions already tried by branch
+	    if ((*ti != callid) || (branch && (branch == t->getBranch())))
+		continue;
+	    switch (t->processMessage(message,branch)) {
+		case SIPTransaction::Matched:
+		    return t;
+		case SIPTransaction::NoDialog:
+		    forked = t;
+		    break;
+		case SIPTransaction::NoMatch:
+		default:
+		    break;
+	    }
 	}
     }
     if (forked)
@@ -278,34 +493,32 @@ bool SIPEngine::process()
 SIPEvent* SIPEngine::getEvent()
 {
     Lock lock(this);
-    ObjList* l = m_transList.skipNull();
-    if (!l)
-	return 0;
     u_int64_t time = Time::now();
-    for (; l; l = l->skipNext()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
-	SIPEvent* e = t->getEvent(true,time);
-	if (e) {
-	    DDebug(this,DebugInfo,"Got pending event %p (state %s) from transaction %p [%p]",
-		e,SIPTransaction::stateName(e->getState()),t,this);
-	    if (t->getState() == SIPTransaction::Invalid)
-		m_transList.remove(t);
-	    return e;
-	}
-    }
-    time = Time::now();
-    for (l = m_transList.skipNull(); l; l = l->skipNext()) {
+    expireTimers(time);
+    for (;;) {
+	ObjList* l = m_readyList.skipNull();
+	if (!l)
+	    return 0;
 	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	// transaction goes back in the queue if it signals more work
+	t->m_ready = false;
+	l->remove(false);
+	m_scanCount++;
 	SIPEvent* e = t->getEvent(false,time);
-	if (e) {
-	    DDebug(this,DebugInfo,"Got event %p (state %s) from transaction %p [%p]",
-		e,SIPTransaction::stateName(e->getState()),t,this);
-	    if (t->getState() == SIPTransaction::Invalid)
-		m_transList.remove(t);
-	    return e;
+	if (!e)
+	    continue;
+	m_eventCount++;
+	DDebug(this,DebugInfo,"Got event %p (state %s) from transaction %p [%p]",
+	    e,SIPTransaction::stateName(e->getState()),t,this);
+	if (t->getState() == SIPTransaction::Invalid) {
+	    remove(t);
+	    TelEngine::destruct(t);
 	}
+	else
+	    // poll it again later, it may have more events queued
+	    wakeup(t);
+	return e;
     }
-    return 0;
 }
 
 void SIPEngine::processEvent(SIPEvent *event)
@@ -602,15 +602,17 @@ const String& SIPMessage::getHeaders() const
 const DataBlock& SIPMessage::getBuffer() const
 {
     if (isValid() && m_data.null()) {
-	m_data.assign((void*)(getHeaders().c_str()),getHeaders().length());
+	String s;
 	if (body) {
-	    String s;
 	    body->buildHeaders(s);
 	    s << "Content-Length: " << body->getBody().length() << "\r\n\r\n";
-	    m_data += s;
 	}
 	else
-	    m_data += "Content-Length: 0\r\n\r\n";
+	    s = "Content-Length: 0\r\n\r\n";
+	// allocate the buffer only once
+	m_data.reserve(getHeaders().length() + s.length() + (body ? body->getBody().length() : 0));
+	m_data += getHeaders();
+	m_data += s;
 	if (body)
 	    m_data += body->getBody();
 #ifdef DEBUG
@@ -616,6 +616,7 @@ public:
  */
 class YSIP_API SIPTransaction : public RefObject
 {
+    friend class SIPEngine;
 public:
     /**
      * Current state of the transaction
@@ -792,8 +793,7 @@ public:
      * Set the (re)transmission flag that allows the latest outgoing message
      *  to be send over the wire
      */
-    inline void setTransmit()
-	{ m_transmit = true; }
+    void setTransmit();
 
     /**
      * Change transaction status to Cleared
@@ -997,6 +997,11 @@ protected:
     String m_callid;
     String m_tag;
     void *m_private;
+private:
+    // bookkeeping of the engine's ready queue and timer wheel
+    bool m_listed;
+    bool m_ready;
+    int m_slot;
 };
 
 /**
@@ -1088,6 +1093,7 @@ protected:
  */
 class YSIP_API SIPEngine : public DebugEnabler, public Mutex
 {
+    friend class SIPTransaction;
 public:
     /**
      * Create the SIP Engine
@@ -1169,6 +1175,7 @@ public:
      * This method mainly looks into the transaction list and get all kind of 
      * events, like an incoming request (INVITE, REGISTRATION), a timer, an
      * outgoing message.
+     * Only transactions that were signaled or whose timer expired are polled.
      * This method is thread safe
      */
     SIPEvent *getEvent();
@@ -1343,29 +1350,88 @@ public:
      * Remove a transaction from the list without dereferencing it
      * @param transaction Pointer to transaction to remove
      */
-    inline void remove(SIPTransaction* transaction)
-	{ lock(); m_transList.remove(transaction,false); unlock(); }
+    void remove(SIPTransaction* transaction);
 
     /**
      * Append a transaction to the end of the list
      * @param transaction Pointer to transaction to append
      */
-    inline void append(SIPTransaction* transaction)
-	{ lock(); m_transList.append(transaction); unlock(); }
+    void append(SIPTransaction* transaction);
 
     /**
      * Insert a transaction at the start of the list
      * @param transaction Pointer to transaction to insert
      */
-    inline void insert(SIPTransaction* transaction)
-	{ lock(); m_transList.insert(transaction); unlock(); }
+    void insert(SIPTransaction* transaction);
+
+    /**
+     * Update the matching index of a transaction whose branch was changed
+     * @param transaction Pointer to transaction that got a new branch
+     * @param oldBranch Branch the transaction was indexed with before
+     */
+    void reindex(SIPTransaction* transaction, const String& oldBranch);
+
+    /**
+     * Remove and dereference all transactions
+     */
+    void clearTransactions();
+
+    /**
+     * Get the number of transactions in the engine
+     * @return Count of transactions
+     */
+    inline unsigned int transactionCount() const
+	{ return m_transCount; }
+
+    /**
+     * Get the number of events returned by @ref getEvent() so far
+     * @return Count of events
+     */
+    inline u_int64_t eventCount() const
+	{ return m_eventCount; }
+
+    /**
+     * Get the number of times a transaction was polled for events
+     * @return Count of transaction polls
+     */
+    inline u_int64_t scanCount() const
+	{ return m_scanCount; }
 
 protected:
+    /**
+     * Transactions indexed by their RFC 3261 Via branch
+     */
+    HashList m_branchIndex;
+
+    /**
+     * All transactions indexed by Call-ID, used to match legacy messages
+     */
+    HashList m_callidIndex;
+
     /**
      * The list that holds all the SIP transactions.
      */
     ObjList m_transList;
 
+    /**
+     * Transactions that may have an event to return
+     */
+    ObjList m_readyList;
+
+    /**
+     * Timer wheel holding transactions with a timeout set
+     */
+    ObjList* m_timerWheel;
+
+    /**
+     * Last timer wheel tick that was processed
+     */
+    u_int64_t m_timerTick;
+
+    unsigned int m_transCount;
+    u_int64_t m_eventCount;
+    u_int64_t m_scanCount;
+
     u_int64_t m_t1;
     u_int64_t m_t4;
     int m_reqTransCount;
@@ -1382,6 +1448,11 @@ protected:
     u_int32_t m_nonce_time;
     Mutex m_nonce_mutex;
     bool m_autoChangeParty;
+
+private:
+    void wakeup(SIPTransaction* transaction);
+    void schedule(SIPTransaction* transaction);
+    void expireTimers(u_int64_t time);
 };
 
 }
@@ -352,6 +352,52 @@ protected:
      */
     void skipBlanks();
 
+    /**
+     * Retrieve a character from the unparsed part of the main buffer
+     * @param index Offset of the character from the current parsing position
+     * @return The character, 0 if past the end of the buffer
+     */
+    inline char bufAt(int index) const
+	{
+	    index += m_bufPos;
+	    return ((unsigned int)index < m_buf.length()) ? m_buf.c_str()[index] : 0;
+	}
+
+    /**
+     * Retrieve the length of the unparsed part of the main buffer
+     * @return Number of characters left to parse
+     */
+    inline unsigned int bufLength() const
+	{ return m_buf.length() - m_bufPos; }
+
+    /**
+     * Extract a substring of the unparsed part of the main buffer
+     * @param offs Offset of the substring from the current parsing position
+     * @param len Length of the substring, -1 for everything to the end
+     * @return A copy of the requested substring
+     */
+    inline String bufSubstr(int offs, int len = -1) const
+	{ return m_buf.substr(m_bufPos + offs,len); }
+
+    /**
+     * Check if the unparsed part of the main buffer starts with a given text
+     * @param what Text to compare with
+     * @return True if the unparsed data starts with the text
+     */
+    bool bufStartsWith(const char* what) const;
+
+    /**
+     * Consume characters from the main buffer by advancing the parsing position.
+     * The buffer is compacted only once at the end of each parse() call
+     * @param len Number of characters to consume
+     */
+    inline void bufSkip(unsigned int len)
+	{
+	    m_bufPos += len;
+	    if (m_bufPos > m_buf.length())
+		m_bufPos = m_buf.length();
+	}
+
     /**
      * Check if a character is an angle bracket
      * @param c The character to verify
@@ -497,6 +543,11 @@ protected:
      */
     String m_buf;
 
+    /**
+     * Offset in the main buffer of the first character not parsed yet
+     */
+    unsigned int m_bufPos;
+
     /**
      * The parser data holder.
      * Keeps the parsed data when an incomplete xml object is found
@@ -507,6 +558,18 @@ protected:
      * The last parsed xml object code
      */
     Type m_unparsed;
+
+private:
+    // Parse the main buffer from the current position
+    bool parseBuffer();
+    // Validate new data, keeps the state of a sequence split between calls
+    bool checkUtf8(const char* text);
+    // Remove the already parsed data from the main buffer
+    void compactBuffer();
+    unsigned int m_utf8More;             // Continuation bytes still expected
+    uint32_t m_utf8Min;                  // Minimum value of the pending character
+    uint32_t m_utf8Val;                  // Value accumulated so far
+    bool m_utf8Bad;                      // Invalid UTF-8 was received
 };
 
 /**
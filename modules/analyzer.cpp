@@ -133,6 +133,7 @@ public:
     virtual bool msgRinging(Message& msg);
     virtual bool msgAnswered(Message& msg);
     virtual void checkTimers(Message& msg, const Time& tmr);
+    virtual u_int64_t nextTimer() const;
     void startChannel(NamedList& params);
     void addSource();
     void addConsumer();
@@ -652,6 +653,14 @@ void AnalyzerChan::checkTimers(Message& msg, const Time& tmr)
 	Channel::checkTimers(msg,tmr);
 }
 
+u_int64_t AnalyzerChan::nextTimer() const
+{
+    u_int64_t when = Channel::nextTimer();
+    if (m_stopTime && (!when || (m_stopTime < when)))
+	when = m_stopTime;
+    return when;
+}
+
 void AnalyzerChan::startChannel(NamedList& params)
 {
     Message* m = message("chan.startup",params);
@@ -677,8 +686,10 @@ void AnalyzerChan::startChannel(NamedList& params)
 void AnalyzerChan::setDuration(NamedList& params)
 {
     int t = params.getIntValue("duration",120000);
-    if (t > 0)
+    if (t > 0) {
 	m_stopTime = Time::now() + 1000 * (uint64_t)t;
+	scheduleTimers();
+    }
 }
 
 void AnalyzerChan::addSource()
@@ -19,7 +19,7 @@
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
  */
 
-#include <yatengine.h>
+#include <yatephone.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -33,56 +33,131 @@
 #define EOLN "\n"
 #endif
 
+// default, minimum and maximum size of the record buffer
+#define RING_DEFAULT 1048576
+#define RING_MIN 16384
+#define RING_MAX 67108864
+
 using namespace TelEngine;
 namespace { // anonymous
 
 class CdrFileHandler;
 
-class CdrFilePlugin : public Plugin
+class CdrFilePlugin : public Module
 {
 public:
     CdrFilePlugin();
     ~CdrFilePlugin();
     virtual void initialize();
+protected:
+    virtual bool received(Message& msg, int id);
+    virtual void statusParams(String& str);
 private:
     CdrFileHandler *m_handler;
 };
 
 INIT_PLUGIN(CdrFilePlugin);
 
+// Formats the CDRs into a ring buffer that is written to file by a thread
 class CdrFileHandler : public MessageHandler, public Mutex
 {
+    friend class CdrFileWriter;
 public:
-    CdrFileHandler(const char *name)
-	: MessageHandler(name,100,__plugin.name()),
-	  Mutex(false,"CdrFileHandler"),
-	  m_file(-1), m_combined(false)
-	{ }
+    CdrFileHandler(const char *name, unsigned int ringSize);
     virtual ~CdrFileHandler();
     virtual bool received(Message &msg);
-    void init(const char *fname, bool tabsep, bool combined, const char* format);
+    void init(const char *fname, bool tabsep, bool combined, const char* format,
+	int fsync, unsigned int maxSize);
+    void statusParams(String& str);
+    void stop();
 private:
+    void run();
+    void openFile();
+    unsigned int writeFile(const char* data, unsigned int len);
     int m_file;
     bool m_combined;
     String m_format;
+    String m_fileName;
+    bool m_reopen;
+    bool m_stop;
+    int m_fsync;
+    unsigned int m_maxSize;
+    u_int64_t m_size;
+    DataBlock m_ring;
+    unsigned int m_head;
+    unsigned int m_used;
+    unsigned int m_queued;
+    unsigned int m_written;
+    unsigned int m_dropped;
+    Semaphore m_wake;
+    Semaphore m_done;
+    Thread* m_writer;
+};
+
+// Thread that drains the ring buffer of the handler
+class CdrFileWriter : public Thread
+{
+public:
+    CdrFileWriter(CdrFileHandler* handler)
+	: Thread("CDR File",Thread::Low), m_handler(handler)
+	{ }
+    virtual void run()
+	{ m_handler->run(); }
+    virtual void cleanup()
+	{
+	    m_handler->lock();
+	    m_handler->m_writer = 0;
+	    m_handler->unlock();
+	    m_handler->m_done.unlock();
+	}
+private:
+    CdrFileHandler* m_handler;
 };
 
+CdrFileHandler::CdrFileHandler(const char *name, unsigned int ringSize)
+    : MessageHandler(name,100,__plugin.name()),
+      Mutex(true,"CdrFileHandler"),
+      m_file(-1), m_combined(false), m_reopen(false), m_stop(false),
+      m_fsync(0), m_maxSize(0), m_size(0),
+      m_ring(0,ringSize), m_head(0), m_used(0),
+      m_queued(0), m_written(0), m_dropped(0),
+      m_wake(1,"CdrFileWriter"), m_done(1,"CdrFileDone"), m_writer(0)
+{
+    m_done.lock(0);
+    CdrFileWriter* writer = new CdrFileWriter(this);
+    if (writer->startup())
+	m_writer = writer;
+    else {
+	Alarm("cdrfile","system",DebugWarn,"Failed to start the CDR writer thread");
+	delete writer;
+    }
+}
+
 CdrFileHandler::~CdrFileHandler()
 {
-    Lock lock(this);
+    stop();
     if (m_file >= 0) {
 	::close(m_file);
 	m_file = -1;
     }
 }
 
-void CdrFileHandler::init(const char *fname, bool tabsep, bool combined, const char* format)
+// Ask the writer thread to flush the buffer and exit, wait for it
+void CdrFileHandler::stop()
+{
+    Lock lock(this);
+    if (!m_writer || m_stop)
+	return;
+    m_stop = true;
+    lock.drop();
+    m_wake.unlock();
+    m_done.lock();
+}
+
+void CdrFileHandler::init(const char *fname, bool tabsep, bool combined, const char* format,
+    int fsync, unsigned int maxSize)
 {
     Lock lock(this);
-    if (m_file >= 0) {
-	::close(m_file);
-	m_file = -1;
-    }
     m_format = format;
     m_combined = combined;
     if (m_format.null()) {
@@ -104,12 +179,13 @@ void CdrFileHandler::init(const char *fname, bool tabsep, bool combined, const c
 		    ",${billtime},${ringtime},${duration},\"${direction}\",\"${status}\",\"${reason}\""
 	      );
     }
-    if (fname) {
-	m_file = ::open(fname,O_WRONLY|O_CREAT|O_APPEND|O_LARGEFILE,0640);
-	if (m_file < 0)
-	    Alarm("cdrfile","system",DebugWarn,"Failed to open or create '%s': %s (%d)",
-		fname,::strerror(errno),errno);
-    }
+    m_fsync = fsync;
+    m_maxSize = maxSize;
+    // the writer thread (re)opens the file, this is how rotated files get reopened
+    m_fileName = fname;
+    m_reopen = true;
+    lock.drop();
+    m_wake.unlock();
 }
 
 bool CdrFileHandler::received(Message &msg)
@@ -122,18 +198,209 @@ bool CdrFileHandler::received(Message &msg)
     if (!msg.getBoolValue("cdrwrite",true))
         return false;
 
+    lock();
+    String str = m_format;
+    unlock();
+    if (str.null())
+	return false;
+    str += EOLN;
+    msg.replaceParams(str);
+    unsigned int len = str.length();
+    unsigned int lines = 0;
+    for (const char* p = str.c_str(); (p = ::strchr(p,'\n')); p++)
+	lines++;
     Lock lock(this);
-    if ((m_file >= 0) && m_format) {
-	String str = m_format;
-	str += EOLN;
-	msg.replaceParams(str);
-	::write(m_file,str.c_str(),str.length());
+    if (!m_writer) {
+	// writer has exited or never started, write the record directly
+	if (m_reopen || (m_file < 0)) {
+	    m_reopen = false;
+	    openFile();
+	}
+	if (writeFile(str,len) == len)
+	    m_written += lines;
+	else if (!(m_dropped++ % 1000))
+	    Alarm("cdrfile","system",DebugWarn,
+		"CDR writer not running and file not writable, dropped %u records so far",
+		m_dropped);
+	return false;
     }
+    unsigned int size = m_ring.length();
+    if (len > size - m_used) {
+	if (!(m_dropped++ % 1000))
+	    Alarm("cdrfile","system",DebugWarn,"CDR buffer full, dropped %u records so far",
+		m_dropped);
+	return false;
+    }
+    // copy the record in the free space, wrap around the end of the buffer
+    unsigned int tail = (m_head + m_used) % size;
+    unsigned int n = size - tail;
+    if (n > len)
+	n = len;
+    char* ring = (char*)m_ring.data();
+    ::memcpy(ring + tail,str.c_str(),n);
+    if (n < len)
+	::memcpy(ring,str.c_str() + n,len - n);
+    bool wake = !m_used;
+    m_used += len;
+    m_queued += lines;
+    lock.drop();
+    if (wake)
+	m_wake.unlock();
     return false;
 };
 
+void CdrFileHandler::statusParams(String& str)
+{
+    Lock lock(this);
+    str.append("queue=",",") << m_queued;
+    str << ",buffered=" << m_used << ",buffer=" << m_ring.length();
+    str << ",written=" << m_written << ",dropped=" << m_dropped;
+    str << ",open=" << String::boolText(m_file >= 0);
+}
+
+// Writer thread, opens the file and writes contiguous chunks of the ring
+void CdrFileHandler::run()
+{
+    u_int64_t synced = 0;
+    bool dirty = false;
+    for (;;) {
+	m_wake.lock(Thread::idleUsec() * 100);
+	Lock lock(this);
+	bool reopen = m_reopen;
+	m_reopen = false;
+	lock.drop();
+	if (reopen)
+	    openFile();
+	for (;;) {
+	    lock.acquire(this);
+	    bool stop = m_stop;
+	    unsigned int head = m_head;
+	    unsigned int len = m_used;
+	    unsigned int size = m_ring.length();
+	    if (stop && !len) {
+		// records arriving from now on are written directly
+		m_writer = 0;
+		return;
+	    }
+	    // producers only write in the free space so the data is safe unlocked
+	    const char* data = (const char*)m_ring.data() + head;
+	    lock.drop();
+	    if (head + len > size)
+		len = size - head;
+	    if (!len)
+		break;
+	    unsigned int done = writeFile(data,len);
+	    unsigned int lines = 0;
+	    for (unsigned int i = 0; i < done; i++)
+		if (data[i] == '\n')
+		    lines++;
+	    unsigned int lost = 0;
+	    if ((done < len) && stop) {
+		// no retry while stopping, give up the rest of the block
+		for (unsigned int i = done; i < len; i++)
+		    if (data[i] == '\n')
+			lost++;
+		done = len;
+	    }
+	    if (done) {
+		lock.acquire(this);
+		m_head = (head + done) % size;
+		m_used -= done;
+		m_queued -= lines + lost;
+		m_written += lines;
+		m_dropped += lost;
+		lock.drop();
+		dirty = true;
+	    }
+	    if (lost)
+		Alarm("cdrfile","system",DebugWarn,
+		    "Failed to write CDR file while stopping, lost %u records",lost);
+	    if (done < len) {
+		// keep the rest buffered and try again later
+		Thread::msleep(1000);
+		break;
+	    }
+	}
+	if (dirty && (m_file >= 0) && m_fsync) {
+	    u_int64_t now = Time::now();
+	    if ((m_fsync < 0) || (now >= synced + 1000 * (u_int64_t)m_fsync)) {
+		::fsync(m_file);
+		synced = now;
+		dirty = false;
+	    }
+	}
+	if (m_maxSize && (m_size >= m_maxSize) && (m_file >= 0)) {
+	    lock.acquire(this);
+	    String fname = m_fileName;
+	    lock.drop();
+	    String rotated = fname;
+	    rotated << "." << Time::secNow();
+	    // several rotations in the same second must not overwrite each other
+	    for (unsigned int seq = 1; File::exists(rotated); seq++) {
+		rotated = fname;
+		rotated << "." << Time::secNow() << "-" << seq;
+	    }
+	    ::close(m_file);
+	    m_file = -1;
+	    int code = 0;
+	    if (!File::rename(fname,rotated,&code))
+		Alarm("cdrfile","system",DebugWarn,"Failed to rename '%s' to '%s': %s (%d)",
+		    fname.c_str(),rotated.c_str(),::strerror(code),code);
+	    openFile();
+	}
+    }
+}
+
+// Close the old file and open the current one
+// Called from the writer or with the handler locked once the writer has exited
+void CdrFileHandler::openFile()
+{
+    lock();
+    String fname = m_fileName;
+    unlock();
+    if (m_file >= 0) {
+	::close(m_file);
+	m_file = -1;
+    }
+    m_size = 0;
+    if (fname.null())
+	return;
+    int file = ::open(fname,O_WRONLY|O_CREAT|O_APPEND|O_LARGEFILE,0640);
+    if (file < 0) {
+	Alarm("cdrfile","system",DebugWarn,"Failed to open or create '%s': %s (%d)",
+	    fname.c_str(),::strerror(errno),errno);
+	return;
+    }
+    struct stat st;
+    if (!::fstat(file,&st))
+	m_size = st.st_size;
+    m_file = file;
+}
+
+// Write a block of data to file, return how many bytes were written
+// Called from the writer or with the handler locked once the writer has exited
+unsigned int CdrFileHandler::writeFile(const char* data, unsigned int len)
+{
+    if (m_file < 0)
+	return 0;
+    unsigned int done = 0;
+    while (done < len) {
+	int w = ::write(m_file,data + done,len - done);
+	if (w < 0) {
+	    if (errno == EINTR)
+		continue;
+	    Alarm("cdrfile","system",DebugWarn,"Failed to write CDR file: %s (%d)",
+		::strerror(errno),errno);
+	    break;
+	}
+	done += w;
+	m_size += w;
+    }
+    return done;
+}
+
 CdrFilePlugin::CdrFilePlugin()
-    : Plugin("cdrfile",true),
+    : Module("cdrfile","misc",true),
       m_handler(0)
 {
     Output("Loaded module CdrFile");
@@ -151,12 +418,33 @@ void CdrFilePlugin::initialize()
     String file = cfg.getValue("general","file");
     Engine::self()->runParams().replaceParams(file);
     if (file && !m_handler) {
-	m_handler = new CdrFileHandler("call.cdr");
+	setup();
+	// run after cdrbuild finalizes the remaining calls on engine.halt
+	installRelay(Halt,200);
+	int ring = cfg.getIntValue("general","buffer",RING_DEFAULT,RING_MIN,RING_MAX);
+	m_handler = new CdrFileHandler("call.cdr",ring);
 	Engine::install(m_handler);
     }
     if (m_handler)
 	m_handler->init(file,cfg.getBoolValue("general","tabs",true),
-	    cfg.getBoolValue("general","combined",false),cfg.getValue("general","format"));
+	    cfg.getBoolValue("general","combined",false),cfg.getValue("general","format"),
+	    cfg.getIntValue("general","fsync",0),
+	    cfg.getIntValue("general","maxsize",0,0));
+}
+
+bool CdrFilePlugin::received(Message& msg, int id)
+{
+    // flush pending records before the engine stops
+    if ((id == Halt) && m_handler)
+	m_handler->stop();
+    return Module::received(msg,id);
+}
+
+void CdrFilePlugin::statusParams(String& str)
+{
+    Module::statusParams(str);
+    if (m_handler)
+	m_handler->statusParams(str);
 }
 
 }; // anonymous namespace
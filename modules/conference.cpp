@@ -23,6 +23,15 @@
 
 #include <yatephone.h>
 
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 using namespace TelEngine;
 namespace { // anonymous
 
@@ -42,6 +51,12 @@ namespace { // anonymous
 #define MAX_SPEAKERS 8
 #define DEF_SPEAKERS 3
 
+// maximum number of loudest channels we can restrict the mix to
+#define MAX_MIXED 64
+
+// maximum number of samples mixed at once
+#define MAX_SAMPLES (MAX_BUFFER / 2)
+
 // Speaking detector energy square hysteresis
 #define SPEAK_HIST_MIN 16384
 #define SPEAK_HIST_MAX 32768
@@ -71,6 +86,77 @@ namespace { // anonymous
 #error SHIFT_RAISE must be higher than SHIFT_LEVEL
 #endif
 
+// Add signed linear samples into the mixing buffer
+static void mixAdd(int* buf, const int16_t* src, unsigned int n)
+{
+    unsigned int i = 0;
+#ifdef __AVX2__
+    for (; i + 16 <= n; i += 16) {
+	__m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+	__m256i* d = (__m256i*)(buf + i);
+	_mm256_storeu_si256(d,_mm256_add_epi32(_mm256_loadu_si256(d),
+	    _mm256_cvtepi16_epi32(_mm256_castsi256_si128(s))));
+	_mm256_storeu_si256(d + 1,_mm256_add_epi32(_mm256_loadu_si256(d + 1),
+	    _mm256_cvtepi16_epi32(_mm256_extracti128_si256(s,1))));
+    }
+#endif
+#ifdef __SSE2__
+    for (; i + 8 <= n; i += 8) {
+	__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+	__m128i* d = (__m128i*)(buf + i);
+	// sign extend by unpacking with self and shifting right
+	_mm_storeu_si128(d,_mm_add_epi32(_mm_loadu_si128(d),
+	    _mm_srai_epi32(_mm_unpacklo_epi16(s,s),16)));
+	_mm_storeu_si128(d + 1,_mm_add_epi32(_mm_loadu_si128(d + 1),
+	    _mm_srai_epi32(_mm_unpackhi_epi16(s,s),16)));
+    }
+#endif
+    for (; i < n; i++)
+	buf[i] += src[i];
+}
+
+// Saturate symmetrically the mix into signed linear samples
+// If own data is provided it is substracted from the mix first
+static void mixStore(int16_t* dst, const int* buf, const int16_t* own, unsigned int n)
+{
+    unsigned int i = 0;
+#ifdef __AVX2__
+    const __m256i min16 = _mm256_set1_epi16(-32767);
+    for (; i + 16 <= n; i += 16) {
+	__m256i lo = _mm256_loadu_si256((const __m256i*)(buf + i));
+	__m256i hi = _mm256_loadu_si256((const __m256i*)(buf + i + 8));
+	if (own) {
+	    __m256i s = _mm256_loadu_si256((const __m256i*)(own + i));
+	    lo = _mm256_sub_epi32(lo,_mm256_cvtepi16_epi32(_mm256_castsi256_si128(s)));
+	    hi = _mm256_sub_epi32(hi,_mm256_cvtepi16_epi32(_mm256_extracti128_si256(s,1)));
+	}
+	// packing works on 128 bit lanes, restore the order of quadwords
+	__m256i r = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo,hi),0xd8);
+	_mm256_storeu_si256((__m256i*)(dst + i),_mm256_max_epi16(r,min16));
+    }
+#endif
+#ifdef __SSE2__
+    const __m128i min8 = _mm_set1_epi16(-32767);
+    for (; i + 8 <= n; i += 8) {
+	__m128i lo = _mm_loadu_si128((const __m128i*)(buf + i));
+	__m128i hi = _mm_loadu_si128((const __m128i*)(buf + i + 4));
+	if (own) {
+	    __m128i s = _mm_loadu_si128((const __m128i*)(own + i));
+	    lo = _mm_sub_epi32(lo,_mm_srai_epi32(_mm_unpacklo_epi16(s,s),16));
+	    hi = _mm_sub_epi32(hi,_mm_srai_epi32(_mm_unpackhi_epi16(s,s),16));
+	}
+	// packing saturates to -32768, raise it to keep symmetry
+	_mm_storeu_si128((__m128i*)(dst + i),_mm_max_epi16(_mm_packs_epi32(lo,hi),min8));
+    }
+#endif
+    for (; i < n; i++) {
+	int val = buf[i];
+	if (own)
+	    val -= own[i];
+	dst[i] = (val < -32767) ? -32767 : ((val > 32767) ? 32767 : val);
+    }
+}
+
 class ConfConsumer;
 class ConfSource;
 class ConfChan;
@@ -124,6 +210,8 @@ public:
     void update(const NamedList& params);
 private:
     ConfRoom(const String& name, const NamedList& params);
+    // Set the number of loudest channels to mix, zero to mix all
+    void setMaxMix(int count);
     // Set the expire time from 'lonely' parameter value
     // Set the lonely flag if called the first time (no users in conference)
     void setLonelyTimeout(const String& value);
@@ -148,6 +236,8 @@ private:
     int m_trackInterval;
     u_int64_t m_nextNotify;
     u_int64_t m_nextSpeakers;
+    int m_maxMix;
+    int m_mixBuf[MAX_SAMPLES];
 };
 
 // A conference channel is just a dumb holder of its data channels
@@ -190,7 +280,7 @@ class ConfConsumer : public DataConsumer
     YCLASS(ConfConsumer,DataConsumer);
 public:
     ConfConsumer(ConfRoom* room, bool smart = false)
-	: m_room(room), m_src(0), m_muted(false), m_smart(smart), m_speak(false),
+	: m_room(room), m_src(0), m_muted(false), m_smart(smart), m_speak(false), m_mixed(false),
 	  m_energy2(ENERGY_MIN), m_noise2(ENERGY_MIN), m_envelope2(ENERGY_MIN)
 	{ DDebug(DebugAll,"ConfConsumer::ConfConsumer(%p,%s) [%p]",room,String::boolText(smart),this); m_format = room->getFormat(); }
     ~ConfConsumer()
@@ -224,10 +314,12 @@ private:
     bool m_muted;
     bool m_smart;
     bool m_speak;
+    bool m_mixed;
     unsigned int m_energy2;
     unsigned int m_noise2;
     unsigned int m_envelope2;
     DataBlock m_buffer;
+    DataBlock m_forward;
 };
 
 // Per channel data source with that channel's data removed from the mix
@@ -331,7 +423,8 @@ ConfRoom* ConfRoom::get(const String& name, const NamedList* params)
 ConfRoom::ConfRoom(const String& name, const NamedList& params)
     : m_name(name), m_lonely(false), m_created(true), m_record(0),
       m_rate(8000), m_users(0), m_maxusers(10), m_maxLock(200),
-      m_expire(0), m_lonelyInterval(0), m_nextNotify(0), m_nextSpeakers(0)
+      m_expire(0), m_lonelyInterval(0), m_nextNotify(0), m_nextSpeakers(0),
+      m_maxMix(0)
 {
     DDebug(&__plugin,DebugAll,"ConfRoom::ConfRoom('%s',%p) [%p]",
 	name.c_str(),&params,this);
@@ -352,6 +445,7 @@ ConfRoom::ConfRoom(const String& name, const NamedList& params)
     else if (m_trackInterval < MIN_INTERVAL)
 	m_trackInterval = MIN_INTERVAL;
     setLonelyTimeout(params["lonely"]);
+    setMaxMix(params.getIntValue("maxmix",0));
     if (m_rate != 8000)
 	m_format << "/" << m_rate;
     for (int i = 0; i < MAX_SPEAKERS; i++)
@@ -546,6 +640,8 @@ void ConfRoom::msgStatus(Message& msg)
     msg.retValue() << ",expire=" << (int)exp;
     msg.retValue() << ",rate=" << m_rate;
     msg.retValue() << ",users=" << m_users;
+    if (m_maxMix)
+	msg.retValue() << ",maxmix=" << m_maxMix;
     msg.retValue() << ",chans=" << m_chans.count();
     msg.retValue() << ",owners=" << m_owners.count();
     if (m_notify)
@@ -653,7 +749,11 @@ void ConfRoom::mix(ConfConsumer* cons)
     unsigned int len = MAX_BUFFER;
     unsigned int mlen = 0;
     Lock mylock(this);
+    unsigned int loudVol[MAX_MIXED];
+    ConfConsumer* loudCons[MAX_MIXED];
+    int loud = 0;
     // find out the minimum and maximum amount of data in buffers
+    // also pick the channels we are going to mix in
     ObjList* l = m_chans.skipNull();
     for (; l; l = l->skipNext()) {
 	ConfChan* ch = static_cast<ConfChan*>(l->get());
@@ -664,8 +764,32 @@ void ConfRoom::mix(ConfConsumer* cons)
 		len = buffered;
 	    if (mlen < buffered)
 		mlen = buffered;
+	    // avoid mixing in noise
+	    co->m_mixed = co->shouldMix();
+	    if (!(m_maxMix && co->m_mixed))
+		continue;
+	    // keep only the loudest ones, sorted by decreasing volume
+	    co->m_mixed = false;
+	    unsigned int vol = co->envelope2();
+	    int i = loud;
+	    for (; i > 0; i--) {
+		if (vol <= loudVol[i-1])
+		    break;
+		if (i < m_maxMix) {
+		    loudVol[i] = loudVol[i-1];
+		    loudCons[i] = loudCons[i-1];
+		}
+	    }
+	    if (i < m_maxMix) {
+		loudVol[i] = vol;
+		loudCons[i] = co;
+		if (loud < m_maxMix)
+		    loud++;
+	    }
 	}
     }
+    while (loud--)
+	loudCons[loud]->m_mixed = true;
     XDebug(DebugAll,"ConfRoom::mix() buffer %u - %u [%p]",len,mlen,this);
     mlen += MIN_BUFFER;
     // do we have at least minimum amount of data in buffer?
@@ -686,14 +810,15 @@ void ConfRoom::mix(ConfConsumer* cons)
 	speakChan[spk] = 0;
     }
     len = chunks * DATA_CHUNK / sizeof(int16_t);
-    DataBlock mixbuf(0,len*sizeof(int));
-    int* buf = (int*)mixbuf.data();
+    if (len > MAX_SAMPLES)
+	len = MAX_SAMPLES;
+    int* buf = m_mixBuf;
+    ::memset(buf,0,len*sizeof(int));
     for (l = m_chans.skipNull(); l; l = l->skipNext()) {
 	ConfChan* ch = static_cast<ConfChan*>(l->get());
 	ConfConsumer* co = static_cast<ConfConsumer*>(ch->getConsumer());
 	if (co) {
-	    // avoid mixing in noise
-	    if (co->shouldMix()) {
+	    if (co->m_mixed) {
 		unsigned int n = co->m_buffer.length() / 2;
 #ifdef XDEBUG
 		if (ch->debugAt(DebugAll)) {
@@ -711,9 +836,7 @@ void ConfRoom::mix(ConfConsumer* cons)
 #endif
 		if (n > len)
 		    n = len;
-		const int16_t* p = (const int16_t*)co->m_buffer.data();
-		for (unsigned int i=0; i < n; i++)
-		    buf[i] += *p++;
+		mixAdd(buf,(const int16_t*)co->m_buffer.data(),n);
 	    }
 	    if (m_trackSpeakers && m_notify && !ch->isUtility() && co->speaking()) {
 		int vol = co->envelope();
@@ -737,14 +860,10 @@ void ConfRoom::mix(ConfConsumer* cons)
 	if (co)
 	    co->consumed(buf,len);
     }
+    // the room output is forwarded unlocked so it needs its own block
     DataBlock data(0,len*sizeof(int16_t));
-    int16_t* p = (int16_t*)data.data();
-    for (unsigned int i=0; i < len; i++) {
-	int val = buf[i];
-	// saturate symmetrically the result of addition
-	*p++ = (val < -32767) ? -32767 : ((val > 32767) ? 32767 : val);
-    }
-    mixbuf.clear();
+    if (data.data())
+	mixStore((int16_t*)data.data(),buf,0,len);
     Message* m = 0;
     while (m_trackSpeakers && m_notify) {
 	u_int64_t now = Time::now();
@@ -827,6 +946,19 @@ void ConfRoom::update(const NamedList& params)
     String* l = params.getParam("lonely");
     if (l)
 	setLonelyTimeout(*l);
+    l = params.getParam("maxmix");
+    if (l)
+	setMaxMix(l->toInteger());
+}
+
+// Set the number of loudest channels to mix
+void ConfRoom::setMaxMix(int count)
+{
+    if (count < 0)
+	count = 0;
+    else if (count > MAX_MIXED)
+	count = MAX_MIXED;
+    m_maxMix = count;
 }
 
 // Set the expire time from 'lonely' parameter value
@@ -973,19 +1105,20 @@ void ConfConsumer::dataForward(const int* mixed, unsigned int samples)
     if (!src)
 	return;
 
-    int16_t* d = (int16_t*)m_buffer.data();
-    unsigned int n = m_buffer.length() / 2;
-    DataBlock data(0,samples*sizeof(int16_t));
-    int16_t* p = (int16_t*)data.data();
-    for (unsigned int i=0; i < samples; i++) {
-	int val = *mixed++;
-	// substract our own data if we contributed - only as much as we have
-	if ((i < n) && shouldMix())
-	    val -= d[i];
-	// saturate symmetrically the result of additions and substraction
-	*p++ = (val < -32767) ? -32767 : ((val > 32767) ? 32767 : val);
-    }
-    src->Forward(data);
+    // substract our own data if we contributed - only as much as we have
+    unsigned int n = m_mixed ? m_buffer.length() / 2 : 0;
+    if (n > samples)
+	n = samples;
+    // room is locked so we can reuse the forward buffer
+    if (m_forward.length() != samples*sizeof(int16_t))
+	m_forward.assign(0,samples*sizeof(int16_t));
+    int16_t* p = (int16_t*)m_forward.data();
+    if (!p)
+	return;
+    if (n)
+	mixStore(p,mixed,(const int16_t*)m_buffer.data(),n);
+    mixStore(p + n,mixed + n,0,samples - n);
+    src->Forward(m_forward);
 }
 
 unsigned int ConfConsumer::energy() const
@@ -427,7 +427,7 @@ static void setMessage(const String& match, Message& msg, String& line, Message*
 }
 
 // helper function to set the default regexp
-static void setDefault(Regexp& reg)
+static void setDefault(String& reg)
 {
     if (s_defRule.null())
 	return;
@@ -442,69 +442,304 @@ static void setDefault(Regexp& reg)
     }
 }
 
-// helper function to process one match attempt
-static bool oneMatch(Message& msg, Regexp& reg, String& match, const String& context, unsigned int rule)
+// One match clause of a rule, parsed and compiled at load time
+class RouteMatch : public GenObject
 {
+public:
+    enum Connector {
+	None = 0,
+	And,
+	Or
+    };
+    RouteMatch(const String& rule, int conn, const String& context, unsigned int line);
+    bool matches(Message& msg, const String& str, String& match) const;
+    inline int connector() const
+	{ return m_conn; }
+    inline bool valid() const
+	{ return m_valid; }
+private:
+    int m_conn;
+    bool m_valid;
+    bool m_reverse;
+    String m_param;
+    String m_default;
+    String m_func;
+    Regexp m_regexp;
+};
+
+// One line of a context with its secondary if/and/or clauses split out
+class RouteRule : public GenObject
+{
+public:
+    RouteRule(const NamedString& line, const String& context, unsigned int index);
+    bool matches(Message& msg, const String& str, String& match);
+    inline unsigned int line() const
+	{ return m_line; }
+    inline const String& name() const
+	{ return m_name; }
+    inline const String& value() const
+	{ return m_value; }
+    inline const String& action() const
+	{ return m_action; }
+    inline bool blockStart() const
+	{ return m_blockStart; }
+    inline bool blockEnd() const
+	{ return m_blockEnd; }
+    inline u_int64_t hits() const
+	{ return m_hits; }
+    inline u_int64_t usec() const
+	{ return m_usec; }
+    inline void resetStats()
+	{ m_hits = m_usec = 0; }
+private:
+    unsigned int m_line;
+    bool m_blockStart;
+    bool m_blockEnd;
+    bool m_broken;
+    String m_name;
+    String m_value;
+    String m_action;
+    ObjList m_clauses;
+    u_int64_t m_hits;
+    u_int64_t m_usec;
+};
+
+// All the rules of one configuration section, in file order
+class RouteContext : public String
+{
+public:
+    RouteContext(const NamedList& sect);
+    inline const ObjList& rules() const
+	{ return m_rules; }
+    void stats(String& out, bool reset);
+private:
+    ObjList m_rules;
+};
+
+// Immutable set of compiled contexts, replaced as a whole on reload
+class RouteProgram : public RefObject
+{
+public:
+    RouteProgram(const Configuration& cfg);
+    inline RouteContext* find(const String& name) const
+	{ return static_cast<RouteContext*>(m_index[name]); }
+    inline const ObjList& contexts() const
+	{ return m_contexts; }
+    void stats(String& out, const String& context, bool reset);
+private:
+    ObjList m_contexts;
+    HashList m_index;
+};
+
+static RefPointer<RouteProgram> s_program;
+static bool s_ruleTimes = false;
+
+RouteMatch::RouteMatch(const String& rule, int conn, const String& context, unsigned int line)
+    : m_conn(conn), m_valid(false), m_reverse(false),
+      m_regexp("",s_extended,s_insensitive)
+{
+    String reg(rule);
     if (reg.startsWith("${")) {
 	// handle special matching by param ${paramname}regexp
 	int p = reg.find('}');
 	if (p < 3) {
 	    Debug("RegexRoute",DebugWarn,"Invalid parameter match '%s' in rule #%u in context '%s'",
-		reg.c_str(),rule,context.c_str());
-	    return false;
+		reg.c_str(),line,context.c_str());
+	    return;
 	}
-	match = reg.substr(2,p-2);
+	m_param = reg.substr(2,p-2);
 	reg = reg.substr(p+1);
-	match.trimBlanks();
+	m_param.trimBlanks();
 	reg.trimBlanks();
-	String def;
-	p = match.find('$');
+	p = m_param.find('$');
 	if (p >= 0) {
 	    // param is in ${<name>$<default>} format
-	    def = match.substr(p+1);
-	    match = match.substr(0,p);
-	    match.trimBlanks();
+	    m_default = m_param.substr(p+1);
+	    m_param = m_param.substr(0,p);
+	    m_param.trimBlanks();
 	}
 	setDefault(reg);
-	if (match.null() || reg.null()) {
+	if (m_param.null() || reg.null()) {
 	    Debug("RegexRoute",DebugWarn,"Missing parameter or rule in rule #%u in context '%s'",
-		rule,context.c_str());
-	    return false;
+		line,context.c_str());
+	    return;
 	}
-	DDebug("RegexRoute",DebugAll,"Using message parameter '%s' default '%s'",
-	    match.c_str(),def.c_str());
-	match = msg.getValue(match,def);
     }
     else if (reg.startsWith("$(")) {
 	// handle special matching by param $(function)regexp
 	int p = reg.find(')');
 	if (p < 3) {
 	    Debug("RegexRoute",DebugWarn,"Invalid function match '%s' in rule #%u in context '%s'",
-		reg.c_str(),rule,context.c_str());
-	    return false;
+		reg.c_str(),line,context.c_str());
+	    return;
 	}
-	match = reg.substr(0,p+1);
+	m_func = reg.substr(0,p+1);
 	reg = reg.substr(p+1);
 	reg.trimBlanks();
 	setDefault(reg);
 	if (reg.null()) {
 	    Debug("RegexRoute",DebugWarn,"Missing rule in rule #%u in context '%s'",
-		rule,context.c_str());
-	    return false;
+		line,context.c_str());
+	    return;
 	}
-	DDebug("RegexRoute",DebugAll,"Using function '%s'",match.c_str());
+    }
+    if (reg.endsWith("^")) {
+	// reverse match on final ^ (makes no sense in a regexp)
+	m_reverse = true;
+	reg = reg.substr(0,reg.length()-1);
+    }
+    m_regexp = reg;
+    if (!m_regexp.compile()) {
+	Debug("RegexRoute",DebugWarn,"Invalid regexp '%s' in rule #%u in context '%s'",
+	    m_regexp.c_str(),line,context.c_str());
+	return;
+    }
+    m_valid = true;
+}
+
+// process one match attempt
+bool RouteMatch::matches(Message& msg, const String& str, String& match) const
+{
+    if (!m_valid)
+	return false;
+    if (m_param)
+	match = msg.getValue(m_param,m_default);
+    else if (m_func) {
+	match = m_func;
 	msg.replaceParams(match);
 	replaceFuncs(match,msg);
     }
+    else
+	match = str;
     match.trimBlanks();
+    return (match.matches(m_regexp) != m_reverse);
+}
 
-    bool doMatch = true;
-    if (reg.endsWith("^")) {
-	// reverse match on final ^ (makes no sense in a regexp)
-	doMatch = false;
-	reg = reg.substr(0,reg.length()-1);
+RouteRule::RouteRule(const NamedString& line, const String& context, unsigned int index)
+    : m_line(index), m_blockStart(false), m_blockEnd(false), m_broken(false),
+      m_name(line.name()), m_value(line), m_hits(0), m_usec(0)
+{
+    String reg(line.name());
+    if (reg.startSkip("}")) {
+	m_blockEnd = true;
+	if (reg.trimBlanks().null())
+	    reg = ".*";
+    }
+    static const Regexp s_blockStart("\\(=[[:space:]]*\\)\\?{$");
+    m_blockStart = s_blockStart.matches(line);
+    m_clauses.append(new RouteMatch(reg,RouteMatch::None,context,index));
+    String val(line);
+    for (;;) {
+	int conn = RouteMatch::And;
+	if (val.startSkip("or"))
+	    conn = RouteMatch::Or;
+	else if (!(val.startSkip("if") || val.startSkip("and")))
+	    break;
+	int p = val.find('=');
+	if (p < 0) {
+	    Debug("RegexRoute",DebugWarn,"Malformed condition in rule #%u in context '%s'",
+		index,context.c_str());
+	    // a bad line fails as a whole, an 'or' must not rescue it
+	    m_broken = true;
+	    val.clear();
+	    break;
+	}
+	reg = val.substr(0,p);
+	val = val.substr(p+1);
+	reg.trimBlanks();
+	val.trimBlanks();
+	if (reg.null()) {
+	    Debug("RegexRoute",DebugWarn,"Missing 'if' in rule #%u in context '%s'",
+		index,context.c_str());
+	    m_broken = true;
+	}
+	else
+	    m_clauses.append(new RouteMatch(reg,conn,context,index));
+    }
+    for (ObjList* l = m_clauses.skipNull(); l; l = l->skipNext())
+	if (!static_cast<const RouteMatch*>(l->get())->valid())
+	    m_broken = true;
+    m_action = val;
+}
+
+// evaluate the clauses left to right, 'and' and 'or' having equal precedence
+bool RouteRule::matches(Message& msg, const String& str, String& match)
+{
+    if (m_broken)
+	return false;
+    u_int64_t t = s_ruleTimes ? Time::now() : 0;
+    ObjList* l = m_clauses.skipNull();
+    bool ok = static_cast<const RouteMatch*>(l->get())->matches(msg,str,match);
+    while ((l = l->skipNext())) {
+	const RouteMatch* m = static_cast<const RouteMatch*>(l->get());
+	if (ok) {
+	    // a true clause followed by 'or' decides the rule
+	    if (RouteMatch::Or == m->connector())
+		break;
+	}
+	else if (RouteMatch::Or != m->connector())
+	    break;
+	ok = m->matches(msg,str,match);
+    }
+    if (t)
+	m_usec += Time::now() - t;
+    if (ok)
+	m_hits++;
+    return ok;
+}
+
+RouteContext::RouteContext(const NamedList& sect)
+    : String(sect)
+{
+    ObjList* last = &m_rules;
+    unsigned int len = sect.length();
+    for (unsigned int i = 0; i < len; i++) {
+	const NamedString* n = sect.getParam(i);
+	if (n)
+	    last = last->append(new RouteRule(*n,*this,i+1));
+    }
+}
+
+void RouteContext::stats(String& out, bool reset)
+{
+    out << "[" << *this << "] rules=" << m_rules.count() << "\r\n";
+    for (ObjList* l = m_rules.skipNull(); l; l = l->skipNext()) {
+	RouteRule* r = static_cast<RouteRule*>(l->get());
+	if (!(r->hits() || r->usec()))
+	    continue;
+	out << "  #" << r->line() << " hits=" << r->hits();
+	if (s_ruleTimes)
+	    out << " usec=" << r->usec();
+	out << " " << r->name() << "=" << r->value() << "\r\n";
+	if (reset)
+	    r->resetStats();
+    }
+}
+
+RouteProgram::RouteProgram(const Configuration& cfg)
+    : m_index(61)
+{
+    ObjList* last = &m_contexts;
+    unsigned int n = cfg.sections();
+    for (unsigned int i = 0; i < n; i++) {
+	const NamedList* sect = cfg.getSection(i);
+	// settings and variables are not routing contexts
+	if (!sect || sect->startsWith("$") || (*sect == YSTRING("priorities")) ||
+		(*sect == YSTRING("extra")))
+	    continue;
+	RouteContext* ctx = new RouteContext(*sect);
+	last = last->append(ctx);
+	m_index.append(ctx)->setDelete(false);
+    }
+}
+
+void RouteProgram::stats(String& out, const String& context, bool reset)
+{
+    for (ObjList* l = m_contexts.skipNull(); l; l = l->skipNext()) {
+	RouteContext* ctx = static_cast<RouteContext*>(l->get());
+	if (context.null() || (context == *ctx))
+	    ctx->stats(out,reset);
     }
-    return (match.matches(reg) == doMatch);
 }
 
 enum BlockState {
@@ -523,36 +758,30 @@ static bool oneContext(Message &msg, String &str, const String &context, String
 	Debug("RegexRoute",DebugWarn,"Possible loop detected, current context '%s'",context.c_str());
 	return false;
     }
-    NamedList *l = s_cfg.getSection(context);
-    if (l) {
+    const RouteContext* ctx = s_program ? s_program->find(context) : 0;
+    if (ctx) {
 	unsigned int blockDepth = 0;
 	BlockState blockStack[BLOCK_STACK];
-	unsigned int len = l->length();
-	for (unsigned int i = 0; i < len; i++) {
-	    const NamedString* n = l->getParam(i);
-	    if (!n)
-		continue;
+	for (ObjList* l = ctx->rules().skipNull(); l; l = l->skipNext()) {
+	    RouteRule* rule = static_cast<RouteRule*>(l->get());
+	    unsigned int line = rule->line();
 	    BlockState blockThis = (blockDepth > 0) ? blockStack[blockDepth-1] : BlockRun;
 	    BlockState blockLast = BlockSkip;
-	    Regexp reg(n->name(),s_extended,s_insensitive);
-	    if (reg.startSkip("}")) {
+	    if (rule->blockEnd()) {
 		if (!blockDepth) {
 		    Debug("RegexRoute",DebugWarn,"Got '}' outside block in line #%u in context '%s'",
-			i+1,context.c_str());
+			line,context.c_str());
 		    continue;
 		}
-		if (reg.trimBlanks().null())
-		    reg = ".*";
 		blockDepth--;
 		blockLast = blockThis;
 		blockThis = (blockDepth > 0) ? blockStack[blockDepth-1] : BlockRun;
 	    }
-	    static Regexp s_blockStart("\\(=[[:space:]]*\\)\\?{$");
-	    if (s_blockStart.matches(*n)) {
+	    if (rule->blockStart()) {
 		// start of a new block
 		if (blockDepth >= BLOCK_STACK) {
 		    Debug("RegexRoute",DebugWarn,"Block stack overflow in line #%u in context '%s'",
-			i+1,context.c_str());
+			line,context.c_str());
 		    return false;
 		}
 		// assume block is done
@@ -566,58 +795,16 @@ static bool oneContext(Message &msg, String &str, const String &context, String
 		}
 		blockStack[blockDepth++] = blockEnter;
 	    }
-	    XDebug("RegexRoute",DebugAll,"%s:%d(%u:%s) %s=%s",context.c_str(),i+1,
+	    XDebug("RegexRoute",DebugAll,"%s:%d(%u:%s) %s=%s",context.c_str(),line,
 		blockDepth,String::boolText(BlockRun == blockThis),
-		n->name().c_str(),n->c_str());
+		rule->name().c_str(),rule->value().c_str());
 	    if (BlockRun != blockThis)
 		continue;
 
-	    String val(*n);
 	    String match;
-	    bool ok;
-	    do {
-		match = str;
-		ok = oneMatch(msg,reg,match,context,i+1);
-		if (ok) {
-		    if (val.startSkip("or")) {
-			do {
-			    int p = val.find('=');
-			    if (p < 0) {
-				Debug("RegexRoute",DebugWarn,"Malformed 'or' rule #%u in context '%s'",
-				    i+1,context.c_str());
-				ok = false;
-				break;
-			    }
-			    val = val.substr(p+1);
-			    val.trimBlanks();
-			} while (ok && (val.startSkip("or") || val.startSkip("if") || val.startSkip("and")));
-			break;
-		    }
-		    if (!(val.startSkip("if") || val.startSkip("and")))
-			break;
-		}
-		else if (val.startSkip("or"))
-		    ok = true;
-		if (ok) {
-		    int p = val.find('=');
-		    if (p >= 1) {
-			reg = val.substr(0,p);
-			val = val.substr(p+1);
-			reg.trimBlanks();
-			val.trimBlanks();
-			if (!reg.null()) {
-			    NDebug("RegexRoute",DebugAll,"Secondary match rule '%s' by rule #%u in context '%s'",
-				reg.c_str(),i+1,context.c_str());
-			    continue;
-			}
-		    }
-		    Debug("RegexRoute",DebugWarn,"Missing 'if' in rule #%u in context '%s'",
-			i+1,context.c_str());
-		    ok = false;
-		}
-	    } while (ok);
-	    if (!ok)
+	    if (!rule->matches(msg,str,match))
 		continue;
+	    String val(rule->action());
 
 	    if (val.startSkip("echo") || val.startSkip("output")) {
 		// special case: display the line but don't set params
@@ -633,7 +820,7 @@ static bool oneContext(Message &msg, String &str, const String &context, String
 		    blockStack[blockDepth-1] = BlockRun;
 		else
 		    Debug("RegexRoute",DebugWarn,"Got '{' outside block in line #%u in context '%s'",
-			i+1,context.c_str());
+			line,context.c_str());
 		continue;
 	    }
 	    bool disp = val.startSkip("dispatch");
@@ -649,7 +836,7 @@ static bool oneContext(Message &msg, String &str, const String &context, String
 			m->userData(msg.userData());
 			NDebug("RegexRoute",DebugAll,"%s new message '%s' by rule #%u '%s' in context '%s'",
 			    (disp ? "Dispatching" : "Enqueueing"),
-			    val.c_str(),i+1,n->name().c_str(),context.c_str());
+			    val.c_str(),line,rule->name().c_str(),context.c_str());
 			if (disp) {
 			    s_dispatching++;
 			    Engine::dispatch(m);
@@ -680,13 +867,13 @@ static bool oneContext(Message &msg, String &str, const String &context, String
 	    else if (val.startSkip("goto") || val.startSkip("jump") ||
 		((val.startSkip("@goto") || val.startSkip("@jump")) && !(warn = false))) {
 		NDebug("RegexRoute",DebugAll,"Jumping to context '%s' by rule #%u '%s'",
-		    val.c_str(),i+1,n->name().c_str());
+		    val.c_str(),line,rule->name().c_str());
 		return oneContext(msg,str,val,ret,warn,depth+1);
 	    }
 	    else if (val.startSkip("include") || val.startSkip("call") ||
 		((val.startSkip("@include") || val.startSkip("@call")) && !(warn = false))) {
 		NDebug("RegexRoute",DebugAll,"Including context '%s' by rule #%u '%s'",
-		    val.c_str(),i+1,n->name().c_str());
+		    val.c_str(),line,rule->name().c_str());
 		if (oneContext(msg,str,val,ret,warn,depth+1)) {
 		    DDebug("RegexRoute",DebugAll,"Returning true from context '%s'", context.c_str());
 		    return true;
@@ -695,20 +882,20 @@ static bool oneContext(Message &msg, String &str, const String &context, String
 	    else if (val.startSkip("match") || val.startSkip("newmatch")) {
 		if (!val.null()) {
 		    NDebug("RegexRoute",DebugAll,"Setting match string '%s' by rule #%u '%s' in context '%s'",
-			val.c_str(),i+1,n->name().c_str(),context.c_str());
+			val.c_str(),line,rule->name().c_str(),context.c_str());
 		    str = val;
 		}
 	    }
 	    else if (val.startSkip("rename")) {
 		if (!val.null()) {
 		    NDebug("RegexRoute",DebugAll,"Renaming message '%s' to '%s' by rule #%u '%s' in context '%s'",
-			msg.c_str(),val.c_str(),i+1,n->name().c_str(),context.c_str());
+			msg.c_str(),val.c_str(),line,rule->name().c_str(),context.c_str());
 		    msg = val;
 		}
 	    }
 	    else {
 		DDebug("RegexRoute",DebugAll,"Returning '%s' for '%s' in context '%s' by rule #%u '%s'",
-		    val.c_str(),str.c_str(),context.c_str(),i+1,n->name().c_str());
+		    val.c_str(),str.c_str(),context.c_str(),line,rule->name().c_str());
 		ret = val;
 		return true;
 	    }
@@ -815,6 +1002,57 @@ bool GenericHandler::received(Message &msg)
 }
 
 
+class CommandHandler : public MessageHandler
+{
+public:
+    CommandHandler()
+	: MessageHandler("engine.command",100,s_trackName)
+	{ }
+    virtual bool received(Message &msg);
+};
+
+bool CommandHandler::received(Message &msg)
+{
+    static const String name("regexroute");
+    String line(msg.getValue(YSTRING("line")));
+    if (line.null()) {
+	const String* partial = msg.getParam(YSTRING("partline"));
+	const String& word = msg[YSTRING("partword")];
+	if (TelEngine::null(partial)) {
+	    if (word.null() || name.startsWith(word))
+		msg.retValue().append(name,"\t");
+	}
+	else if (*partial == name) {
+	    static const char* s_cmds[] = { "stats", "reset", 0 };
+	    for (const char** c = s_cmds; *c; c++)
+		if (word.null() || String(*c).startsWith(word))
+		    msg.retValue().append(*c,"\t");
+	}
+	else if ((*partial == YSTRING("regexroute stats")) || (*partial == YSTRING("regexroute reset"))) {
+	    Lock lock(s_mutex);
+	    if (s_program) {
+		for (ObjList* l = s_program->contexts().skipNull(); l; l = l->skipNext()) {
+		    const String* ctx = static_cast<const String*>(l->get());
+		    if (word.null() || ctx->startsWith(word))
+			msg.retValue().append(*ctx,"\t");
+		}
+	    }
+	}
+	return false;
+    }
+    if (!line.startSkip(name))
+	return false;
+    // regexroute {stats|reset} [context]
+    bool reset = line.startSkip("reset");
+    if (!(reset || line.startSkip("stats")))
+	return false;
+    Lock lock(s_mutex);
+    if (s_program)
+	s_program->stats(msg.retValue(),line.trimBlanks(),reset);
+    return true;
+}
+
+
 class RegexRoutePlugin : public Plugin
 {
 public:
@@ -854,6 +1092,7 @@ void RegexRoutePlugin::initialize()
     Lock lock(s_mutex);
     s_cfg = Engine::configFile("regexroute");
     s_cfg.load();
+    bool first = m_first;
     if (m_first) {
 	m_first = false;
 	initVars(s_cfg.getSection("$once"));
@@ -864,6 +1103,20 @@ void RegexRoutePlugin::initialize()
     s_extended = s_cfg.getBoolValue("priorities","extended",false);
     s_insensitive = s_cfg.getBoolValue("priorities","insensitive",false);
     s_prerouteall = s_cfg.getBoolValue("priorities","prerouteall",false);
+    int depth = s_cfg.getIntValue("priorities","maxdepth",5);
+    if (depth < 5)
+	depth = 5;
+    else if (depth > 100)
+	depth = 100;
+    s_maxDepth = depth;
+    s_defRule = s_cfg.getValue("priorities","defaultrule",DEFAULT_RULE);
+    s_ruleTimes = s_cfg.getBoolValue("priorities","ruletimes",false);
+    // compile all contexts once, replacing the previous program
+    RouteProgram* prog = new RouteProgram(s_cfg);
+    s_program = prog;
+    TelEngine::destruct(prog);
+    if (first)
+	Engine::install(new CommandHandler);
     unsigned priority = s_cfg.getIntValue("priorities","preroute",100);
     if (priority) {
 	m_preroute = new PrerouteHandler(priority);
@@ -874,13 +1127,6 @@ void RegexRoutePlugin::initialize()
 	m_route = new RouteHandler(priority);
 	Engine::install(m_route);
     }
-    int depth = s_cfg.getIntValue("priorities","maxdepth",5);
-    if (depth < 5)
-	depth = 5;
-    else if (depth > 100)
-	depth = 100;
-    s_maxDepth = depth;
-    s_defRule = s_cfg.getValue("priorities","defaultrule",DEFAULT_RULE);
     NamedList* l = s_cfg.getSection("extra");
     if (l) {
 	unsigned int len = l->length();
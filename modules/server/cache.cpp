@@ -290,6 +290,7 @@ static unsigned int s_maxChunks = 1000;  // Maximum number of chunks to load in
 static Thread::Priority s_loadPrio = Thread::Normal; // Cache load thread priority
 static unsigned int s_cacheTtlSec = 0;   // Default cache item time to live (in seconds)
 static u_int64_t s_checkToutInterval = 0;// Interval to check cache timeout
+static bool s_templates = false;         // Send queries as templates with their values
 
 // Used strings: avoid allocation
 static const String s_id = "id";
@@ -400,6 +401,29 @@ static void fillList(NamedList& list, String& buf)
 	list.addParam(static_cast<NamedString*>(gen));
 }
 
+// Set the query of a database message as a named template with the values it uses
+// The database module substitutes the ${name} placeholders, as prepared statement
+//  parameters if it can
+static void bindQuery(Message& m, const String& name, const String& query,
+    const NamedList& params)
+{
+    // values named like the database message parameters cannot be bound
+    static const char* const s_reserved[] = {
+	"account", "query", "template", "results", "async", "notify", 0
+    };
+    NamedList values("");
+    bool ok = s_templates && (params.collectParams(query,values,s_reserved) >= 0);
+    if (!ok) {
+	String tmp = query;
+	params.replaceParams(tmp);
+	m.addParam("query",tmp);
+	return;
+    }
+    m.addParam("template","cache." + name);
+    m.addParam("query",query);
+    m.copyParams(values);
+}
+
 
 /*
  * Cache
@@ -497,13 +521,11 @@ bool Cache::copyParams(const String& id, NamedList& list, const String* cpParams
     CacheItem* item = findPrefix(id);
     if (!item && m_account && m_queryLoadItem) {
 	// Load from database
-	String query = m_queryLoadItem;
 	NamedList p("");
 	p.addParam("id",id);
-	p.replaceParams(query);
 	Message m("database");
 	m.addParam("account",m_account);
-	m.addParam("query",query);
+	bindQuery(m,m_name + ".loaditem",m_queryLoadItem,p);
 	unlock();
 	bool ok = Engine::dispatch(m);
 	lock();
@@ -602,13 +624,11 @@ void Cache::expire(const Time& time)
 	return;
     XDebug(&__plugin,DebugAll,"Cache(%s) expiring items [%p]",m_name.c_str(),this);
     if (m_account && m_queryExpire) {
-	String query = m_queryExpire;
 	NamedList p("");
 	p.setParam("time",String(time.sec()));
-	p.replaceParams(query);
 	Message* m = new Message("database");
 	m->addParam("account",m_account);
-	m->addParam("query",query);
+	bindQuery(*m,m_name + ".expire",m_queryExpire,p);
 	m->addParam("results",String::boolText(false));
 	Engine::enqueue(m);
     }
@@ -975,14 +995,12 @@ CacheItem* Cache::addUnsafe(const String& id, const NamedList& params, const Str
     if (len > 0 && len <= 32)
 	m_prefixMask |= (1 << (len - 1));
     if (dbSave && m_account && m_querySave) {
-	String query = m_querySave;
 	NamedList p(*item);
 	p.setParam("id",item->toString());
 	p.setParam("expires",String((unsigned int)(m_cacheTtl / 1000000)));
-	p.replaceParams(query);
 	Message* m = new Message("database");
 	m->addParam("account",m_account);
-	m->addParam("query",query);
+	bindQuery(*m,m_name + ".save",m_querySave,p);
 	m->addParam("results",String::boolText(false));
 	Engine::enqueue(m);
     }
@@ -1272,9 +1290,10 @@ void CacheModule::loadCache(const String& name, bool async, ObjList* items)
 	m.addParam("account",account);
 	if (!items) {
 	    if (chunk) {
-		String tmp = query;
-		Cache::setLimits(tmp,chunk,offset);
-		m.addParam("query",tmp);
+		NamedList p("");
+		p.addParam("chunk",String(chunk));
+		p.addParam("offset",String(offset));
+		bindQuery(m,name + ".load",query,p);
 	    }
 	    else
 		m.addParam("query",query);
@@ -1286,9 +1305,7 @@ void CacheModule::loadCache(const String& name, bool async, ObjList* items)
 		continue;
 	    NamedList p("");
 	    p.addParam("id",*id);
-	    String tmp = query;
-	    p.replaceParams(tmp);
-	    m.addParam("query",tmp);
+	    bindQuery(m,name + ".loaditemcmd",query,p);
 	}
 	else
 	    break;
@@ -1361,6 +1378,7 @@ void CacheModule::initialize()
     s_size = adjustedCacheSize(cfg.getIntValue("general","size",17));
     s_limit = adjustedCacheLimit(cfg.getIntValue("general","limit",s_limit),s_size);
     s_loadChunk = adjustedCacheLoadChunk(cfg.getIntValue("general","loadchunk"));
+    s_templates = cfg.getBoolValue("general","templates",false);
     s_maxChunks = safeValue(cfg.getIntValue("general","maxchunks",1000));
     if (!s_maxChunks)
 	s_maxChunks = 1;
@@ -22,6 +22,8 @@
 #include <yatephone.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <mysql.h>
 
 #ifndef CLIENT_MULTI_STATEMENTS
@@ -37,6 +39,9 @@
 #define mysql_library_end mysql_server_end
 #endif
 
+// Number of queue wait times kept for percentile computation
+#define WAIT_SAMPLES 1024
+
 using namespace TelEngine;
 namespace { // anonymous
 
@@ -99,11 +104,19 @@ public:
 	{ return 0 != m_connections.skipNull(); }
 
     void appendQuery(DbQuery* query);
+    // Count a use of a query template
+    void templateHit(const String& name);
+    // List the templates with their statistics, return how many they are
+    unsigned int listTemplates(String& str);
 
     void incTotal();
     void incFailed();
     void incErrorred();
     void incQueryTime(u_int64_t with);
+    void incWaitTime(u_int64_t with);
+    // Compute queue wait time percentiles in milliseconds
+    void waitTimes(unsigned int& p50, unsigned int& p90, unsigned int& p99);
+    unsigned int queued();
     void lostConn();
     void resetConn();
     inline unsigned int total()
@@ -143,6 +156,7 @@ private:
     int m_poolSize;
     ObjList m_connections;
     ObjList m_queryQueue;
+    ObjList m_templates;
 
     Semaphore m_queueSem;
     Mutex m_queueMutex;
@@ -153,6 +167,8 @@ private:
     unsigned int m_errorQueries;
     u_int64_t m_queryTime;
     unsigned int m_failedConns;
+    u_int32_t m_waits[WAIT_SAMPLES];
+    unsigned int m_waitCount;
     Mutex m_incMutex;
 };
 
@@ -213,6 +229,19 @@ private:
     bool m_init;
 };
 
+/**
+  * Class MyTemplate
+  * Usage counter of a query template
+  */
+class MyTemplate : public String
+{
+public:
+    inline MyTemplate(const String& name)
+	: String(name), m_hits(0)
+	{ }
+    unsigned int m_hits;
+};
+
 /**
   * Class DbQuery
   * A MySQL query
@@ -221,28 +250,31 @@ class DbQuery : public String, public Semaphore
 {
     friend class MyConn;
 public:
-    inline DbQuery(const String& query, Message* msg)
+    inline DbQuery(const String& query, Message* msg, bool async = false)
 	: String(query),
 	  Semaphore(1,"MySQL::query"),
-	  m_msg(msg), m_finished(false)
+	  m_msg(msg), m_finished(false), m_async(async), m_queued(Time::now())
 	{ DDebug( DebugAll, "DbQuery object [%p] created for query '%s'", this, c_str()); }
 
     inline ~DbQuery()
-	{ m_msg = 0;
+	{ if (m_async)
+	    TelEngine::destruct(m_msg);
+	  m_msg = 0;
 	  DDebug( DebugAll, "DbQuery object [%p] with query '%s' was destroyed", this, c_str()); }
 
     inline bool finished()
 	{ return m_finished; }
 
-    inline void setFinished() 
-	{ m_finished = true;
-	  if (!m_msg)
-	      destruct();
-	}
+    inline u_int64_t queued() const
+	{ return m_queued; }
+
+    void setFinished();
 
 private:
     Message* m_msg;
     bool m_finished;
+    bool m_async;
+    u_int64_t m_queued;
 };
 
 static MyModule module;
@@ -299,6 +331,7 @@ void MyConn::runQueries()
 	    continue;
 	m_owner->incTotal();
 	mylock.drop();
+	m_owner->incWaitTime(Time::now() - query->queued());
 
 	DDebug(&module,DebugAll,"Connection '%s' will try to execute '%s'",
 	    c_str(),query->c_str());
@@ -433,7 +466,7 @@ MyAcct::MyAcct(const NamedList* sect)
       m_queueSem(m_poolSize,"MySQL::queue"),
       m_queueMutex(false,"MySQL::queue"),
       m_totalQueries(0), m_failedQueries(0), m_errorQueries(0),
-      m_queryTime(0), m_failedConns(0),
+      m_queryTime(0), m_failedConns(0), m_waitCount(0),
       m_incMutex(false,"MySQL::inc")
 {
     int tout = sect->getIntValue("timeout",10000);
@@ -620,6 +653,42 @@ void MyAcct::incQueryTime(u_int64_t with)
     module.changed();
 }
 
+void MyAcct::incWaitTime(u_int64_t with)
+{
+    m_incMutex.lock();
+    m_waits[m_waitCount++ % WAIT_SAMPLES] = (with > 0xffffffff) ? 0xffffffff : (u_int32_t)with;
+    m_incMutex.unlock();
+}
+
+static int waitCompare(const void* a, const void* b)
+{
+    u_int32_t wa = *(const u_int32_t*)a;
+    u_int32_t wb = *(const u_int32_t*)b;
+    return (wa < wb) ? -1 : (wa > wb);
+}
+
+void MyAcct::waitTimes(unsigned int& p50, unsigned int& p90, unsigned int& p99)
+{
+    u_int32_t waits[WAIT_SAMPLES];
+    m_incMutex.lock();
+    unsigned int n = (m_waitCount < WAIT_SAMPLES) ? m_waitCount : WAIT_SAMPLES;
+    ::memcpy(waits,m_waits,n * sizeof(u_int32_t));
+    m_incMutex.unlock();
+    p50 = p90 = p99 = 0;
+    if (!n)
+	return;
+    ::qsort(waits,n,sizeof(u_int32_t),waitCompare);
+    p50 = waits[(n - 1) * 50 / 100] / 1000;
+    p90 = waits[(n - 1) * 90 / 100] / 1000;
+    p99 = waits[(n - 1) * 99 / 100] / 1000;
+}
+
+unsigned int MyAcct::queued()
+{
+    Lock mylock(m_queueMutex);
+    return m_queryQueue.count();
+}
+
 void MyAcct::lostConn()
 {
     DDebug(&module,DebugAll,"MyAcct::lostConn() [%p]",this);
@@ -638,6 +707,29 @@ void MyAcct::resetConn()
     m_incMutex.unlock();
 }
 
+void MyAcct::templateHit(const String& name)
+{
+    Lock mylock(m_incMutex);
+    MyTemplate* tpl = static_cast<MyTemplate*>(m_templates[name]);
+    if (!tpl) {
+	tpl = new MyTemplate(name);
+	m_templates.append(tpl);
+    }
+    tpl->m_hits++;
+}
+
+unsigned int MyAcct::listTemplates(String& str)
+{
+    Lock mylock(m_incMutex);
+    unsigned int n = 0;
+    for (ObjList* o = m_templates.skipNull(); o; o = o->skipNext()) {
+	MyTemplate* tpl = static_cast<MyTemplate*>(o->get());
+	str.append(*this + "/" + *tpl,",") << "=" << tpl->m_hits;
+	n++;
+    }
+    return n;
+}
+
 void MyAcct::appendQuery(DbQuery* query)
 {
     DDebug(&module, DebugAll, "Account '%s' received a new query %p",c_str(),query);
@@ -647,6 +739,30 @@ void MyAcct::appendQuery(DbQuery* query)
     m_queueSem.unlock();
 }
 
+/**
+  * DbQuery
+  */
+void DbQuery::setFinished()
+{
+    m_finished = true;
+    if (m_async) {
+	// answer with a message named by the "notify" parameter
+	Message* msg = m_msg;
+	m_msg = 0;
+	msg->clearParam("async");
+	msg->setParam("dbtype","mysqldb");
+	const String& notify = (*msg)["notify"];
+	if (notify) {
+	    *msg = notify;
+	    Engine::enqueue(msg);
+	}
+	else
+	    TelEngine::destruct(msg);
+    }
+    if (!m_msg)
+	destruct();
+}
+
 /**
   * DbThread
   */
@@ -692,8 +808,21 @@ bool MyHandler::received(Message& msg)
     lock.drop();
 
     str = msg.getParam("query");
+    String text;
+    const String& tpl = msg[YSTRING("template")];
+    if (tpl && !TelEngine::null(str)) {
+	// prepared statements are not used, the values are escaped in the text
+	db->templateHit(tpl);
+	text = *str;
+	msg.replaceParams(text,true);
+	str = &text;
+    }
     if (!TelEngine::null(str)) {
-	if (msg.getBoolValue("results",true)) {
+	if (msg.getBoolValue("async")) {
+	    db->appendQuery(new DbQuery(*str,new Message(msg),true));
+	    msg.setParam("queued",String::boolText(true));
+	}
+	else if (msg.getBoolValue("results",true)) {
 	    DbQuery* q = new DbQuery(*str,&msg);
 	    db->appendQuery(q);
 
@@ -784,7 +913,7 @@ MyModule::~MyModule()
 void MyModule::statusModule(String& str)
 {
     Module::statusModule(str);
-    str.append("format=Total|Failed|Errors|AvgExecTime",",");
+    str.append("format=Total|Failed|Errors|AvgExecTime|Queued|WaitP50|WaitP90|WaitP99",",");
 }
 
 void MyModule::statusParams(String& str)
@@ -802,6 +931,9 @@ void MyModule::statusDetail(String& str)
 	    str << (acc->queryTime() / (acc->total() - acc->failed()) / 1000); //miliseconds
         else
 	    str << "0";
+	unsigned int p50, p90, p99;
+	acc->waitTimes(p50,p90,p99);
+	str << "|" << acc->queued() << "|" << p50 << "|" << p90 << "|" << p99;
     }
 }
 
@@ -843,6 +975,24 @@ bool MyModule::received(Message& msg, int id)
 	if (m_initThread)
 	    m_initThread->cancel(true);
     }
+    else if (id == Status) {
+	// status mysqldb templates: list the query templates of all accounts
+	String target = msg.getValue(YSTRING("module"));
+	if (target.startSkip(name()) && (target == YSTRING("templates"))) {
+	    String str;
+	    unsigned int n = 0;
+	    s_acctMutex.lock();
+	    for (ObjList* o = s_conns.skipNull(); o; o = o->skipNext())
+		n += static_cast<MyAcct*>(o->get())->listTemplates(str);
+	    s_acctMutex.unlock();
+	    msg.retValue() << "name=" << name() << ",type=" << type()
+		<< ",format=Hits;templates=" << n;
+	    if (str)
+		msg.retValue() << ";" << str;
+	    msg.retValue() << "\r\n";
+	    return true;
+	}
+    }
     return Module::received(msg,id);
 }
 
@@ -858,6 +1008,12 @@ void MyModule::genUpdate(Message& msg)
 	msg.setParam(String("errorred.") << index,String(acc->errorred()));
 	msg.setParam(String("hasconn.") << index,String::boolText(acc->hasConn()));
 	msg.setParam(String("querytime.") << index,String(acc->queryTime()));
+	unsigned int p50, p90, p99;
+	acc->waitTimes(p50,p90,p99);
+	msg.setParam(String("queued.") << index,String(acc->queued()));
+	msg.setParam(String("waittime50.") << index,String(p50));
+	msg.setParam(String("waittime90.") << index,String(p90));
+	msg.setParam(String("waittime99.") << index,String(p99));
 	index++;
     }
     msg.setParam("count",String(index));
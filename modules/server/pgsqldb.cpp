@@ -22,18 +22,49 @@
 #include <yatephone.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <libpq-fe.h>
 
+// Number of connection wait times kept for percentile computation
+#define WAIT_SAMPLES 1024
+// Time an idle asynchronous query thread is kept around
+#define ASYNC_IDLE 10000000
+
 using namespace TelEngine;
 namespace { // anonymous
 
 class PGConn;                            // A database connection
 class PgAccount;                         // Database account holding the connection(s)
+class PgWaiter;                          // A thread waiting for a free connection
+class PgTemplate;                        // A query template prepared on connections
+class PgAsyncThread;                     // Thread running asynchronous queries
 
 static ObjList s_accounts;
 Mutex s_conmutex(false,"PgSQL::acc");
 static unsigned int s_failedConns;
 
+// A query template prepared as a statement on the connections
+// The template text holds ${name} or '${name}' placeholders
+class PgTemplate : public RefObject
+{
+public:
+    PgTemplate(const String& name, const String& text, unsigned int id);
+    virtual const String& toString() const
+	{ return m_name; }
+    // Build the parameter values from a message, must be deleted by caller
+    const char** values(const NamedList& params) const;
+    String m_name;
+    String m_text;
+    String m_sql;
+    String m_stmt;
+    ObjList m_params;
+    unsigned int m_count;
+    bool m_prepare;
+    unsigned int m_hits;
+    unsigned int m_prepares;
+};
+
 // A database connection
 class PgConn : public String
 {
@@ -52,18 +83,37 @@ public:
     void dropDb();
     // Perform the query, fill the message with data
     // Return number of rows, -1 for non-retryable errors and -2 to retry
-    int queryDb(const char* query, Message* dest);
+    int queryDb(const char* query, Message* dest, PgTemplate* tpl = 0);
+    // Send a batch of queries in pipeline mode, fill the messages with data
+    // Return how many messages from the start of the list were processed
+    unsigned int pipelineDb(ObjList& batch);
     virtual void destruct();
 private:
     // Init DB connection
     bool initDbInternal(int retry);
     // Perform the query, fill the message with data
     // Return number of rows, -1 for non-retryable errors and -2 to retry
-    int queryDbInternal(const char* query, Message* dest);
+    int queryDbInternal(const char* query, Message* dest, PgTemplate* tpl);
+    // Prepare the statement of a template on this connection
+    // Return 1 on success, 0 if the template cannot be prepared, -1 on failure
+    int prepareDb(PgTemplate* tpl, u_int64_t timeout);
+    // Send a query alone or in pipeline, return false on failure
+    bool sendQuery(const char* query, Message* dest, PgTemplate* tpl, bool pipeline = false);
+    // Wait for the socket to become readable or writable
+    bool waitSocket(bool write, u_int64_t timeout);
+    // Send all the buffered output
+    bool flushDb(u_int64_t timeout);
+    // Wait until a result can be read without blocking
+    bool waitResult(u_int64_t timeout);
+    // Store one result in the message, return false if it was an error
+    bool storeResult(PGresult* res, const char* query, Message* dest,
+	int& totalRows, int& affectedRows);
 
     PgAccount* m_account;
     bool m_busy;
     PGconn* m_conn;
+    // statements prepared on this connection, valued with the template name
+    ObjList m_statements;
 };
 
 // Database account holding the connection(s)
@@ -76,6 +126,14 @@ public:
     bool initDb();
     // Make a query
     int queryDb(const char* query, Message* dest);
+    // Queue a query to be run by an asynchronous thread
+    bool queueAsync(Message* msg);
+    // Run queued asynchronous queries, called by the asynchronous threads
+    void runAsync();
+    // Get a referenced template for a message that asks for one
+    PgTemplate* getTemplate(const NamedList& msg);
+    // List the templates with their statistics, return how many they are
+    unsigned int listTemplates(String& str);
     bool hasConn();
     virtual const String& toString() const
 	{ return m_name; }
@@ -89,6 +147,10 @@ public:
 	{ return m_errorQueries; }
     inline unsigned int queryTime()
         { return (unsigned int) m_queryTime; }
+    inline unsigned int queued()
+	{ return m_asyncQueued; }
+    // Compute connection wait time percentiles in milliseconds
+    void waitTimes(unsigned int& p50, unsigned int& p90, unsigned int& p99);
 
 protected:
     inline void incErrorQueriesSafe() {
@@ -98,6 +160,12 @@ protected:
 
 private:
     void dropDb();
+    // Get a free connection, wait in queue if all of them are busy
+    PgConn* getConn();
+    // Release a connection, hand it to the first waiter if any
+    void releaseConn(PgConn* conn);
+    // Update statistics after a query
+    void queryDone(int res, u_int64_t start, Message* dest);
 
     String m_name;
     String m_connection;
@@ -106,12 +174,49 @@ private:
     u_int64_t m_timeout;
     PgConn* m_connPool;
     unsigned int m_connPoolSize;
+    ObjList m_waiters;
+    ObjList m_templates;
+    unsigned int m_templateId;
+    // asynchronous queries
+    ObjList m_asyncQueue;
+    Semaphore m_asyncSem;
+    unsigned int m_asyncQueued;
+    unsigned int m_asyncThreads;
+    unsigned int m_asyncIdle;
+    unsigned int m_asyncMax;
+    unsigned int m_pipeline;
     // stat counters
     Mutex* m_statsMutex;
     unsigned int m_totalQueries;
     unsigned int m_failedQueries;
     unsigned int m_errorQueries;
     u_int64_t m_queryTime;
+    u_int32_t m_waits[WAIT_SAMPLES];
+    unsigned int m_waitCount;
+};
+
+// A thread waiting in queue for a connection of the account
+class PgWaiter : public GenObject
+{
+public:
+    inline PgWaiter()
+	: m_sem(1,"PgSQL::wait"), m_conn(0)
+	{ m_sem.lock(0); }
+    Semaphore m_sem;
+    PgConn* m_conn;
+};
+
+// Thread running the asynchronous queries of an account
+class PgAsyncThread : public Thread
+{
+public:
+    inline PgAsyncThread(PgAccount* account)
+	: Thread("PgSQL Async"), m_account(account)
+	{ }
+    virtual void run()
+	{ m_account->runAsync(); }
+private:
+    RefPointer<PgAccount> m_account;
 };
 
 class PgModule : public Module
@@ -125,6 +230,7 @@ protected:
     virtual void statusParams(String& str);
     virtual void statusDetail(String& str);
     virtual void genUpdate(Message& msg);
+    virtual bool received(Message& msg, int id);
 private:
     bool m_init;
 };
@@ -142,6 +248,92 @@ public:
 };
 
 
+//
+// PgTemplate
+//
+PgTemplate::PgTemplate(const String& name, const String& text, unsigned int id)
+    : m_name(name), m_text(text), m_stmt("yate_"), m_count(0), m_prepare(true),
+      m_hits(0), m_prepares(0)
+{
+    m_stmt << id;
+    // Turn ${name} and '${name}' into $1..$N, a placeholder inside a longer
+    //  quoted literal cannot be a parameter so the template is used as text
+    int quote = -1;
+    unsigned int len = m_text.length();
+    const char* t = m_text.c_str();
+    for (unsigned int i = 0; i < len; i++) {
+	char c = t[i];
+	if (c == '\'') {
+	    // a doubled quote inside a literal is an escaped quote
+	    if (quote >= 0 && t[i + 1] == '\'')
+		m_sql << c << t[++i];
+	    else {
+		quote = (quote < 0) ? (int)i : -1;
+		m_sql << c;
+	    }
+	    continue;
+	}
+	if (c != '$' || t[i + 1] != '{') {
+	    m_sql << c;
+	    continue;
+	}
+	int end = m_text.find('}',i + 2);
+	if (end < 0) {
+	    m_prepare = false;
+	    break;
+	}
+	bool quoted = (quote >= 0);
+	if (quoted) {
+	    // must be the whole literal: '${name}'
+	    if (((unsigned int)quote + 1 != i) || (t[end + 1] != '\'')) {
+		m_prepare = false;
+		break;
+	    }
+	    // remove the opening quote, the closing one is skipped below
+	    m_sql = m_sql.substr(0,m_sql.length() - 1);
+	    quote = -1;
+	}
+	String param = m_text.substr(i + 2,end - i - 2);
+	param.trimBlanks();
+	String def;
+	int pq = param.find('$');
+	if (pq >= 0) {
+	    def = param.substr(pq + 1).trimBlanks();
+	    param = param.substr(0,pq).trimBlanks();
+	}
+	// the same parameter uses the same number
+	unsigned int n = 1;
+	ObjList* o = m_params.skipNull();
+	for (; o; o = o->skipNext(), n++)
+	    if (static_cast<NamedString*>(o->get())->name() == param)
+		break;
+	if (!o) {
+	    m_params.append(new NamedString(param,def));
+	    m_count++;
+	}
+	m_sql << "$" << n;
+	i = end;
+	if (quoted)
+	    i++;
+    }
+    if (!m_prepare)
+	m_sql.clear();
+}
+
+// Build the parameter values from a message, must be deleted by caller
+const char** PgTemplate::values(const NamedList& params) const
+{
+    const char** values = new const char*[m_count ? m_count : 1];
+    unsigned int n = 0;
+    for (ObjList* o = m_params.skipNull(); o; o = o->skipNext()) {
+	const NamedString* p = static_cast<const NamedString*>(o->get());
+	const String* v = params.getParam(p->name());
+	values[n++] = v ? v->c_str() : p->c_str();
+    }
+    return values;
+}
+
+
 //
 // PgConn
 //
@@ -179,19 +371,21 @@ void PgConn::dropDb()
 	return;
     PGconn* tmp = m_conn;
     m_conn = 0;
+    // prepared statements are lost with the session
+    m_statements.clear();
     XDebug(&module,DebugAll,"Connection '%s' dropped [%p]",c_str(),m_account);
     PQfinish(tmp);
 }
 
 // Perform the query, fill the message with data
 // Return number of rows, -1 for non-retryable errors and -2 to retry
-int PgConn::queryDb(const char* query, Message* dest)
+int PgConn::queryDb(const char* query, Message* dest, PgTemplate* tpl)
 {
     int retry = m_account->m_retry;
     for (int i = 0; i < retry; i++) {
 	XDebug(&module,DebugAll,"Connection '%s' performing query (retry=%d): %s [%p]",
 	    c_str(),i + 1,query,m_account);
-	int res = queryDbInternal(query,dest);
+	int res = queryDbInternal(query,dest,tpl);
 	if (res > -2)
 	    return res;
     }
@@ -288,13 +482,29 @@ bool PgConn::initDbInternal(int retry)
 
 // Perform the query, fill the message with data
 // Return number of rows, -1 for non-retryable errors and -2 to retry
-int PgConn::queryDbInternal(const char* query, Message* dest)
+int PgConn::queryDbInternal(const char* query, Message* dest, PgTemplate* tpl)
 {
     if (!initDb())
 	// no retry - initDb already tried and failed...
 	return -1;
     u_int64_t timeout = Time::now() + m_account->m_timeout;
-    if (!PQsendQuery(m_conn,query)) {
+    bool prepare = false;
+    if (tpl) {
+	// the flag is cleared by other connections, read it like they write it
+	Lock lck(m_account);
+	prepare = tpl->m_prepare;
+    }
+    if (prepare && !m_statements.find(tpl->m_stmt)) {
+	if (prepareDb(tpl,timeout) < 0) {
+	    Debug(&module,DebugWarn,"Prepare for '%s' failed: %s [%p]",
+		c_str(),PQerrorMessage(m_conn),m_account);
+	    if (dest)
+		dest->setParam("error",PQerrorMessage(m_conn));
+	    dropDb();
+	    return -2;
+	}
+    }
+    if (!sendQuery(query,dest,tpl)) {
 	// a connection failure cannot be detected at this point so any
 	//  error must be caused by the query itself - bad syntax or so
 	Debug(&module,DebugWarn,"Query '%s' for '%s' failed: %s [%p]",
@@ -305,7 +515,7 @@ int PgConn::queryDbInternal(const char* query, Message* dest)
 	return -1;
     }
 
-    if (PQflush(m_conn)) {
+    if (!flushDb(timeout)) {
 	Debug(&module,DebugWarn,"Flush for '%s' failed: %s [%p]",
 	    c_str(),PQerrorMessage(m_conn),m_account);
 	dropDb();
@@ -316,12 +526,7 @@ int PgConn::queryDbInternal(const char* query, Message* dest)
 
     int totalRows = 0;
     int affectedRows = 0;
-    while (Time::now() < timeout) {
-	PQconsumeInput(m_conn);
-	if (PQisBusy(m_conn)) {
-	    Thread::yield();
-	    continue;
-	}
+    while (waitResult(timeout)) {
 	PGresult* res = PQgetResult(m_conn);
 	if (!res) {
 	    // last result already received and processed - exit successfully
@@ -333,80 +538,318 @@ int PgConn::queryDbInternal(const char* query, Message* dest)
 	    }
 	    return totalRows;
 	}
-	ExecStatusType stat = PQresultStatus(res);
-	switch (stat) {
-	    case PGRES_TUPLES_OK:
-		// we got some data - but maybe zero rows or binary...
-		if (dest) {
-		    affectedRows += String(PQcmdTuples(res)).toInteger();
-		    int columns = PQnfields(res);
-		    int rows = PQntuples(res);
-		    if (rows > 0) {
-			totalRows += rows;
-			dest->setParam("columns",String(columns));
-			if (dest->getBoolValue("results",true) && !PQbinaryTuples(res)) {
-			    Array *a = new Array(columns,rows+1);
-			    for (int k = 0; k < columns; k++) {
-				ObjList* column = a->getColumn(k);
-				if (column)
-				    column->set(new String(PQfname(res,k)));
-				else {
+	storeResult(res,query,dest,totalRows,affectedRows);
+	PQclear(res);
+    }
+    if (Time::now() >= timeout) {
+	Debug(&module,DebugWarn,"Query timed out for '%s' [%p]",c_str(),m_account);
+	if (dest)
+	    dest->setParam("error","query timeout");
+    }
+    else {
+	Debug(&module,DebugWarn,"Query for '%s' failed: %s [%p]",
+	    c_str(),PQerrorMessage(m_conn),m_account);
+	if (dest)
+	    dest->setParam("error",PQerrorMessage(m_conn));
+    }
+    dropDb();
+    return -2;
+}
+
+// Prepare the statement of a template on this connection
+// Return 1 on success, 0 if the template cannot be prepared, -1 on failure
+int PgConn::prepareDb(PgTemplate* tpl, u_int64_t timeout)
+{
+    // release the statement of an older text of the same template
+    for (ObjList* o = m_statements.skipNull(); o; o = o->skipNext()) {
+	NamedString* s = static_cast<NamedString*>(o->get());
+	if (*s != tpl->m_name)
+	    continue;
+	String sql("DEALLOCATE ");
+	sql << s->name();
+	if (!(PQsendQuery(m_conn,sql) && flushDb(timeout)))
+	    return -1;
+	for (;;) {
+	    if (!waitResult(timeout))
+		return -1;
+	    PGresult* res = PQgetResult(m_conn);
+	    if (!res)
+		break;
+	    if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		Debug(&module,DebugMild,"Statement '%s' for '%s' cannot be released: %s [%p]",
+		    s->name().c_str(),c_str(),PQresultErrorMessage(res),m_account);
+	    PQclear(res);
+	}
+	o->remove();
+	break;
+    }
+    if (!(PQsendPrepare(m_conn,tpl->m_stmt,tpl->m_sql,tpl->m_count,0) && flushDb(timeout)))
+	return -1;
+    bool ok = false;
+    for (;;) {
+	if (!waitResult(timeout))
+	    return -1;
+	PGresult* res = PQgetResult(m_conn);
+	if (!res)
+	    break;
+	if (PQresultStatus(res) == PGRES_COMMAND_OK)
+	    ok = true;
+	else
+	    Debug(&module,DebugWarn,"Template '%s' for '%s' cannot be prepared: %s [%p]",
+		tpl->m_name.c_str(),c_str(),PQresultErrorMessage(res),m_account);
+	PQclear(res);
+    }
+    if (!ok) {
+	// the server did not accept the statement, send it as text from now on
+	Lock lck(m_account);
+	tpl->m_prepare = false;
+	return 0;
+    }
+    m_statements.append(new NamedString(tpl->m_stmt,tpl->m_name));
+    Lock stats(m_account->m_statsMutex);
+    tpl->m_prepares++;
+    return 1;
+}
+
+// Send a query alone or in pipeline, return false on failure
+// Templates use their prepared statement or are sent with parameters,
+//  the ones that cannot be prepared have their values escaped in the text
+bool PgConn::sendQuery(const char* query, Message* dest, PgTemplate* tpl, bool pipeline)
+{
+    String text;
+    bool prepare = false;
+    if (tpl) {
+	Lock lck(m_account);
+	prepare = tpl->m_prepare;
+    }
+    if (tpl && dest && !prepare) {
+	text = tpl->m_text;
+	dest->replaceParams(text,true);
+	query = text;
+	tpl = 0;
+    }
+    if (!(tpl && dest)) {
+	// pipeline mode allows only the extended query protocol
+	if (pipeline)
+	    return PQsendQueryParams(m_conn,query,0,0,0,0,0,0);
+	return PQsendQuery(m_conn,query);
+    }
+    const char** values = tpl->values(*dest);
+    int ok = 0;
+    if (m_statements.find(tpl->m_stmt))
+	ok = PQsendQueryPrepared(m_conn,tpl->m_stmt,tpl->m_count,values,0,0,0);
+    else
+	ok = PQsendQueryParams(m_conn,tpl->m_sql,tpl->m_count,0,values,0,0,0);
+    delete[] values;
+    return ok != 0;
+}
+
+// Wait for the socket to become readable or writable
+bool PgConn::waitSocket(bool write, u_int64_t timeout)
+{
+    u_int64_t now = Time::now();
+    if (now >= timeout)
+	return false;
+    Socket sock(PQsocket(m_conn));
+    bool ok = true;
+    if (sock.canSelect()) {
+	bool dummy = false;
+	bool* readOk = write ? 0 : &dummy;
+	bool* writeOk = write ? &dummy : 0;
+	ok = sock.select(readOk,writeOk,0,(int64_t)(timeout - now)) || sock.canRetry();
+    }
+    else
+	Thread::idle();
+    sock.detach();
+    return ok;
+}
+
+// Send all the buffered output, the connection is non-blocking
+bool PgConn::flushDb(u_int64_t timeout)
+{
+    for (;;) {
+	int res = PQflush(m_conn);
+	if (res <= 0)
+	    return !res;
+	// we must also read to let the server make progress
+	if (!(PQconsumeInput(m_conn) && waitSocket(true,timeout)))
+	    return false;
+    }
+}
+
+// Wait until a result can be read without blocking
+// Return false on timeout or connection failure
+bool PgConn::waitResult(u_int64_t timeout)
+{
+    for (;;) {
+	if (!PQconsumeInput(m_conn))
+	    return false;
+	if (!PQisBusy(m_conn))
+	    return true;
+	// sleep until the server sends something instead of spinning
+	if (!waitSocket(false,timeout))
+	    return false;
+    }
+}
+
+// Store one result in the message, return false if it was an error
+bool PgConn::storeResult(PGresult* res, const char* query, Message* dest,
+    int& totalRows, int& affectedRows)
+{
+    ExecStatusType stat = PQresultStatus(res);
+    switch (stat) {
+	case PGRES_TUPLES_OK:
+	    // we got some data - but maybe zero rows or binary...
+	    if (dest) {
+		affectedRows += String(PQcmdTuples(res)).toInteger();
+		int columns = PQnfields(res);
+		int rows = PQntuples(res);
+		if (rows > 0) {
+		    totalRows += rows;
+		    dest->setParam("columns",String(columns));
+		    if (dest->getBoolValue("results",true) && !PQbinaryTuples(res)) {
+			Array *a = new Array(columns,rows+1);
+			for (int k = 0; k < columns; k++) {
+			    ObjList* column = a->getColumn(k);
+			    if (column)
+				column->set(new String(PQfname(res,k)));
+			    else {
+				Debug(&module,DebugGoOn,
+				    "Query '%s' for '%s': No array column for %d [%p]",
+				    query,c_str(),k,m_account);
+				continue;
+			    }
+			    for (int j = 0; j < rows; j++) {
+				column = column->next();
+				if (!column) {
+				    // Stop now: we won't get the next row
 				    Debug(&module,DebugGoOn,
-					"Query '%s' for '%s': No array column for %d [%p]",
-					query,c_str(),k,m_account);
-				    continue;
-				}
-				for (int j = 0; j < rows; j++) {
-				    column = column->next();
-				    if (!column) {
-					// Stop now: we won't get the next row
-					Debug(&module,DebugGoOn,
-					    "Query '%s' for '%s': No array row %d in column %d [%p]",
-					    query,c_str(),j + 1,k,m_account);
-					break;
-				    }
-				    // skip over NULL values
-				    if (PQgetisnull(res,j,k))
-					continue;
-				    GenObject* v = 0;
-				    if (PQfformat(res,k))
-					v = new DataBlock(PQgetvalue(res,j,k),PQgetlength(res,j,k));
-				    else
-					v = new String(PQgetvalue(res,j,k));
-				    column->set(v);
+					"Query '%s' for '%s': No array row %d in column %d [%p]",
+					query,c_str(),j + 1,k,m_account);
+				    break;
 				}
+				// skip over NULL values
+				if (PQgetisnull(res,j,k))
+				    continue;
+				GenObject* v = 0;
+				if (PQfformat(res,k))
+				    v = new DataBlock(PQgetvalue(res,j,k),PQgetlength(res,j,k));
+				else
+				    v = new String(PQgetvalue(res,j,k));
+				column->set(v);
 			    }
-			    dest->userData(a);
-			    a->deref();
 			}
+			dest->userData(a);
+			a->deref();
 		    }
 		}
+	    }
+	    break;
+	case PGRES_COMMAND_OK:
+	    if (dest)
+		affectedRows += String(PQcmdTuples(res)).toInteger();
+	    // no data returned
+	    break;
+	case PGRES_COPY_IN:
+	case PGRES_COPY_OUT:
+	    // data transfers - ignore them
+	    break;
+	default:
+	    Debug(&module,DebugWarn,"Query '%s' for '%s' error: %s [%p]",
+		query,c_str(),PQresultErrorMessage(res),m_account);
+	    if (dest)
+		dest->setParam("error",PQresultErrorMessage(res));
+	    m_account->incErrorQueriesSafe();
+	    module.changed();
+	    return false;
+    }
+    return true;
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+// Send a batch of queries in pipeline mode, fill the messages with data
+// Return how many messages from the start of the list were processed,
+//  the ones after a failed query or connection error need to be run again
+unsigned int PgConn::pipelineDb(ObjList& batch)
+{
+    if (!initDb())
+	return 0;
+    if (!PQenterPipelineMode(m_conn)) {
+	Debug(&module,DebugWarn,"Failed to enter pipeline mode for '%s': %s [%p]",
+	    c_str(),PQerrorMessage(m_conn),m_account);
+	return 0;
+    }
+    u_int64_t timeout = Time::now() + m_account->m_timeout;
+    unsigned int sent = 0;
+    for (ObjList* o = batch.skipNull(); o; o = o->skipNext()) {
+	Message* msg = static_cast<Message*>(o->get());
+	PgTemplate* tpl = m_account->getTemplate(*msg);
+	bool ok = sendQuery(msg->getValue("query"),msg,tpl,true);
+	TelEngine::destruct(tpl);
+	if (!ok)
+	    break;
+	sent++;
+    }
+    unsigned int done = 0;
+    if (sent && PQpipelineSync(m_conn) && flushDb(timeout)) {
+	XDebug(&module,DebugAll,"Connection '%s' pipelined %u queries [%p]",
+	    c_str(),sent,m_account);
+	bool aborted = false;
+	ObjList* o = batch.skipNull();
+	for (unsigned int i = 0; i < sent; i++, o = o->skipNext()) {
+	    Message* dest = static_cast<Message*>(o->get());
+	    const char* query = dest->getValue("query");
+	    int totalRows = 0;
+	    int affectedRows = 0;
+	    bool ok = true;
+	    for (;;) {
+		if (!waitResult(timeout)) {
+		    ok = false;
+		    break;
+		}
+		PGresult* res = PQgetResult(m_conn);
+		if (!res)
+		    break;
+		if (PQresultStatus(res) == PGRES_PIPELINE_ABORTED)
+		    aborted = true;
+		else
+		    storeResult(res,query,dest,totalRows,affectedRows);
+		PQclear(res);
+	    }
+	    if (!ok)
 		break;
-	    case PGRES_COMMAND_OK:
-		if (dest)
-		    affectedRows += String(PQcmdTuples(res)).toInteger();
-		// no data returned
-		break;
-	    case PGRES_COPY_IN:
-	    case PGRES_COPY_OUT:
-		// data transfers - ignore them
-		break;
-	    default:
-		Debug(&module,DebugWarn,"Query '%s' for '%s' error: %s [%p]",
-		    query,c_str(),PQresultErrorMessage(res),m_account);
-		if (dest)
-		    dest->setParam("error",PQresultErrorMessage(res));
-		m_account->incErrorQueriesSafe();
-		module.changed();
+	    if (aborted)
+		continue;
+	    dest->setParam("rows",String(totalRows));
+	    dest->setParam("affected",String(affectedRows));
+	    done++;
+	}
+	if (done == sent || aborted) {
+	    // read the result of the synchronization point
+	    PGresult* res = 0;
+	    if (waitResult(timeout))
+		res = PQgetResult(m_conn);
+	    if (res && (PQresultStatus(res) == PGRES_PIPELINE_SYNC)) {
+		PQclear(res);
+		if (PQexitPipelineMode(m_conn))
+		    return done;
+	    }
+	    else if (res)
+		PQclear(res);
 	}
-	PQclear(res);
     }
-    Debug(&module,DebugWarn,"Query timed out for '%s' [%p]",c_str(),m_account);
-    if (dest)
-	dest->setParam("error","query timeout");
+    Debug(&module,DebugWarn,"Pipeline for '%s' failed after %u of %u queries: %s [%p]",
+	c_str(),done,sent,PQerrorMessage(m_conn),m_account);
     dropDb();
-    return -2;
+    return done;
+}
+#else
+// Pipelining needs libpq 14 or newer, nothing is processed here
+unsigned int PgConn::pipelineDb(ObjList& batch)
+{
+    return 0;
 }
+#endif
 
 
 //
@@ -415,10 +858,12 @@ int PgConn::queryDbInternal(const char* query, Message* dest)
 PgAccount::PgAccount(const NamedList& sect)
     : Mutex(true,"PgAccount"),
       m_name(sect),
-      m_connPool(0), m_connPoolSize(0),
+      m_connPool(0), m_connPoolSize(0), m_templateId(0),
+      m_asyncSem(1,"PgSQL::async"),
+      m_asyncQueued(0), m_asyncThreads(0), m_asyncIdle(0), m_asyncMax(1000), m_pipeline(1),
       m_statsMutex(&s_conmutex),
       m_totalQueries(0), m_failedQueries(0),
-      m_errorQueries(0), m_queryTime(0)
+      m_errorQueries(0), m_queryTime(0), m_waitCount(0)
 {
     m_connection = sect.getValue("connection");
     if (m_connection.null()) {
@@ -447,6 +892,15 @@ PgAccount::PgAccount(const NamedList& sect)
 	m_connPool[i].m_account = this;
 	m_connPool[i].assign(m_name + "." + String(i + 1));
     }
+    m_asyncMax = sect.getIntValue("asyncqueue",1000,1);
+    m_pipeline = sect.getIntValue("pipeline",1,1,256);
+#ifndef LIBPQ_HAS_PIPELINING
+    if (m_pipeline > 1) {
+	Debug(&module,DebugWarn,"Account '%s' cannot pipeline queries, libpq is too old",
+	    m_name.c_str());
+	m_pipeline = 1;
+    }
+#endif
     Debug(&module,DebugInfo,"Database account '%s' created poolsize=%u [%p]",
 	m_name.c_str(),m_connPoolSize,this);
 }
@@ -466,6 +920,8 @@ void PgAccount::destroyed()
     s_accounts.remove(this,false);
     s_conmutex.unlock();
     dropDb();
+    m_asyncQueue.clear();
+    m_templates.clear();
     if (m_connPool)
 	delete[] m_connPool;
     m_connPoolSize = 0;
@@ -492,58 +948,64 @@ int PgAccount::queryDb(const char* query, Message* dest)
 	return -1;
     Debug(&module,DebugAll,"Performing query \"%s\" for '%s'",
 	query,m_name.c_str());
-    // Use a while() to break to the end to update statistics
     int res = -1;
     u_int64_t start = Time::now();
-    while (true) {
-	Lock mylock(this,(long)m_timeout);
-	if (!mylock.locked()) {
-	    Debug(&module,DebugWarn,"Failed to lock '%s' for " FMT64U " usec",
-		m_name.c_str(),m_timeout);
-	    break;
-	}
-	// Find a non busy connection
-	PgConn* conn = 0;
-	PgConn* notConnected = 0;
-	for (unsigned int i = 0; i < m_connPoolSize; i++) {
-	    if (m_connPool[i].isBusy())
-		continue;
-	    if (m_connPool[i].testDb()) {
-		conn = &(m_connPool[i]);
-		break;
-	    }
-	    if (!notConnected)
-		notConnected = &(m_connPool[i]);
-        }
-	if (!conn)
-	    conn = notConnected;
-	if (!conn) {
-	    // Wait for a connection to become non-busy
-	    // Round up the number of intervals to wait
-	    unsigned int n = (unsigned int)((m_timeout + 999999) / Thread::idleUsec());
-	    for (unsigned int i = 0; i < n; i++) {
-		for (unsigned int j = 0; j < m_connPoolSize; j++) {
-		    if (!m_connPool[j].isBusy() && m_connPool[j].testDb()) {
-			conn = &(m_connPool[j]);
-			break;
-		    }
-		}
-		if (conn || Thread::check(false))
-		    break;
-		Thread::idle();
-	    }
-	}
-	if (conn)
-	    conn->setBusy(true);
+    PgTemplate* tpl = dest ? getTemplate(*dest) : 0;
+    PgConn* conn = getConn();
+    if (conn) {
+	res = conn->queryDb(query,dest,tpl);
+	releaseConn(conn);
+    }
+    TelEngine::destruct(tpl);
+    queryDone(res,start,dest);
+    return res;
+}
+
+// Get a referenced template for a message that asks for one
+// The template is created or replaced if its text changed
+PgTemplate* PgAccount::getTemplate(const NamedList& msg)
+{
+    const String& name = msg[YSTRING("template")];
+    if (name.null())
+	return 0;
+    const String& text = msg[YSTRING("query")];
+    Lock mylock(this);
+    ObjList* o = m_templates.find(name);
+    PgTemplate* tpl = o ? static_cast<PgTemplate*>(o->get()) : 0;
+    if (!tpl || (tpl->m_text != text)) {
+	tpl = new PgTemplate(name,text,++m_templateId);
+	if (o)
+	    o->set(tpl);
 	else
-	    Debug(&module,DebugWarn,"Account '%s' failed to pick a connection [%p]",m_name.c_str(),this);
-	mylock.drop();
-	if (conn) {
-	    res = conn->queryDb(query,dest);
-	    conn->setBusy(false);
-	}
-	break;
+	    m_templates.append(tpl);
+	Debug(&module,DebugInfo,"Account '%s' added template '%s' as %s [%p]",
+	    m_name.c_str(),name.c_str(),
+	    (tpl->m_prepare ? tpl->m_stmt.c_str() : "text"),this);
     }
+    tpl->ref();
+    mylock.drop();
+    Lock stats(m_statsMutex);
+    tpl->m_hits++;
+    return tpl;
+}
+
+// List the templates with their statistics, return how many they are
+unsigned int PgAccount::listTemplates(String& str)
+{
+    Lock mylock(this);
+    unsigned int n = 0;
+    for (ObjList* o = m_templates.skipNull(); o; o = o->skipNext()) {
+	PgTemplate* tpl = static_cast<PgTemplate*>(o->get());
+	str.append(m_name + "/" + tpl->m_name,",") << "=" << tpl->m_hits << "|"
+	    << tpl->m_prepares << "|" << String::boolText(tpl->m_prepare);
+	n++;
+    }
+    return n;
+}
+
+// Update statistics after a query
+void PgAccount::queryDone(int res, u_int64_t start, Message* dest)
+{
     Lock stats(m_statsMutex);
     m_totalQueries++;
     if (res > -2) {
@@ -556,7 +1018,216 @@ int PgAccount::queryDb(const char* query, Message* dest)
     module.changed();
     if (res < 0)
 	failure(dest);
-    return res;
+}
+
+// Get a free connection, wait in queue if all of them are busy
+PgConn* PgAccount::getConn()
+{
+    u_int64_t start = Time::now();
+    Lock mylock(this);
+    // Find a non busy connection
+    PgConn* conn = 0;
+    PgConn* notConnected = 0;
+    for (unsigned int i = 0; i < m_connPoolSize; i++) {
+	if (m_connPool[i].isBusy())
+	    continue;
+	if (m_connPool[i].testDb()) {
+	    conn = &(m_connPool[i]);
+	    break;
+	}
+	if (!notConnected)
+	    notConnected = &(m_connPool[i]);
+    }
+    if (!conn)
+	conn = notConnected;
+    if (conn)
+	conn->setBusy(true);
+    else {
+	// Wait in queue, the releasing thread hands us its busy connection
+	PgWaiter waiter;
+	m_waiters.append(&waiter)->setDelete(false);
+	mylock.drop();
+	waiter.m_sem.lock((long)m_timeout);
+	mylock.acquire(this);
+	conn = waiter.m_conn;
+	if (!conn)
+	    m_waiters.remove(&waiter,false);
+    }
+    mylock.drop();
+    u_int64_t wait = Time::now() - start;
+    Lock stats(m_statsMutex);
+    m_waits[m_waitCount++ % WAIT_SAMPLES] = (wait > 0xffffffff) ? 0xffffffff : (u_int32_t)wait;
+    stats.drop();
+    if (!conn)
+	Debug(&module,DebugWarn,"Account '%s' failed to pick a connection [%p]",m_name.c_str(),this);
+    return conn;
+}
+
+// Release a connection, hand it to the first waiter if any
+void PgAccount::releaseConn(PgConn* conn)
+{
+    Lock mylock(this);
+    PgWaiter* waiter = static_cast<PgWaiter*>(m_waiters.remove(false));
+    if (waiter) {
+	// connection stays busy, it belongs to the waiter now
+	waiter->m_conn = conn;
+	waiter->m_sem.unlock();
+    }
+    else
+	conn->setBusy(false);
+}
+
+static int waitCompare(const void* a, const void* b)
+{
+    u_int32_t wa = *(const u_int32_t*)a;
+    u_int32_t wb = *(const u_int32_t*)b;
+    return (wa < wb) ? -1 : (wa > wb);
+}
+
+// Compute connection wait time percentiles in milliseconds
+void PgAccount::waitTimes(unsigned int& p50, unsigned int& p90, unsigned int& p99)
+{
+    u_int32_t waits[WAIT_SAMPLES];
+    Lock stats(m_statsMutex);
+    unsigned int n = (m_waitCount < WAIT_SAMPLES) ? m_waitCount : WAIT_SAMPLES;
+    ::memcpy(waits,m_waits,n * sizeof(u_int32_t));
+    stats.drop();
+    p50 = p90 = p99 = 0;
+    if (!n)
+	return;
+    ::qsort(waits,n,sizeof(u_int32_t),waitCompare);
+    p50 = waits[(n - 1) * 50 / 100] / 1000;
+    p90 = waits[(n - 1) * 90 / 100] / 1000;
+    p99 = waits[(n - 1) * 99 / 100] / 1000;
+}
+
+// Queue a query to be run by an asynchronous thread
+bool PgAccount::queueAsync(Message* msg)
+{
+    Lock mylock(this);
+    if (m_asyncQueued >= m_asyncMax) {
+	mylock.drop();
+	Debug(&module,DebugMild,"Account '%s' has %u asynchronous queries queued, rejecting [%p]",
+	    m_name.c_str(),m_asyncMax,this);
+	TelEngine::destruct(msg);
+	return false;
+    }
+    m_asyncQueue.append(msg);
+    m_asyncQueued++;
+    if ((m_asyncQueued > m_asyncIdle) && (m_asyncThreads < m_connPoolSize)) {
+	PgAsyncThread* thread = new PgAsyncThread(this);
+	if (thread->startup()) {
+	    m_asyncThreads++;
+	    m_asyncIdle++;
+	}
+	else {
+	    delete thread;
+	    if (!m_asyncThreads) {
+		m_asyncQueue.remove(msg);
+		m_asyncQueued--;
+		Debug(&module,DebugWarn,"Account '%s' failed to start an async thread [%p]",
+		    m_name.c_str(),this);
+		return false;
+	    }
+	}
+    }
+    mylock.drop();
+    m_asyncSem.unlock();
+    return true;
+}
+
+// Send the result of an asynchronous query as a new message
+static void asyncDone(Message* msg)
+{
+    msg->clearParam("async");
+    msg->setParam("dbtype","pgsqldb");
+    const String& notify = (*msg)["notify"];
+    if (notify) {
+	*msg = notify;
+	Engine::enqueue(msg);
+    }
+    else
+	TelEngine::destruct(msg);
+}
+
+// Run queued asynchronous queries, called by the asynchronous threads
+void PgAccount::runAsync()
+{
+    u_int64_t idle = Time::now() + ASYNC_IDLE;
+    for (;;) {
+	m_asyncSem.lock(Thread::idleUsec());
+	Lock mylock(this);
+	if (!m_asyncQueue.skipNull()) {
+	    if (Thread::check(false) || (Time::now() > idle)) {
+		m_asyncThreads--;
+		m_asyncIdle--;
+		return;
+	    }
+	    continue;
+	}
+	m_asyncIdle--;
+	mylock.drop();
+	u_int64_t start = Time::now();
+	PgConn* conn = getConn();
+	// take as many queries as we can pipeline on the connection
+	ObjList batch;
+	ObjList* last = &batch;
+	ObjList expired;
+	unsigned int n = 0;
+	mylock.acquire(this);
+	while (n < m_pipeline) {
+	    Message* msg = static_cast<Message*>(m_asyncQueue.remove(false));
+	    if (!msg)
+		break;
+	    m_asyncQueued--;
+	    // queries waited as long as a synchronous one waits for a connection
+	    if (msg->msgTime().usec() + m_timeout < start) {
+		expired.append(msg);
+		continue;
+	    }
+	    last = last->append(msg);
+	    n++;
+	}
+	bool more = (0 != m_asyncQueue.skipNull());
+	mylock.drop();
+	// let another thread pick up the rest
+	if (more)
+	    m_asyncSem.unlock();
+	while (GenObject* obj = expired.remove(false)) {
+	    Message* msg = static_cast<Message*>(obj);
+	    Debug(&module,DebugMild,"Account '%s' dropping asynchronous query queued for too long [%p]",
+		m_name.c_str(),this);
+	    queryDone(-2,start,msg);
+	    asyncDone(msg);
+	}
+	unsigned int done = 0;
+	if (conn && (n > 1)) {
+	    done = conn->pipelineDb(batch);
+	    for (unsigned int i = 0; i < done; i++) {
+		Message* msg = static_cast<Message*>(batch.remove(false));
+		queryDone(msg->getParam("error") ? -1 : 0,start,msg);
+		asyncDone(msg);
+	    }
+	}
+	// run one by one whatever the pipeline did not process
+	while (GenObject* obj = batch.remove(false)) {
+	    Message* msg = static_cast<Message*>(obj);
+	    int res = -1;
+	    if (conn) {
+		PgTemplate* tpl = getTemplate(*msg);
+		res = conn->queryDb(msg->getValue("query"),msg,tpl);
+		TelEngine::destruct(tpl);
+	    }
+	    queryDone(res,start,msg);
+	    asyncDone(msg);
+	}
+	if (conn)
+	    releaseConn(conn);
+	mylock.acquire(this);
+	m_asyncIdle++;
+	mylock.drop();
+	idle = Time::now() + ASYNC_IDLE;
+    }
 }
 
 bool PgAccount::hasConn()
@@ -585,8 +1256,16 @@ bool PgHandler::received(Message& msg)
     if (!db)
 	return false;
     str = msg.getParam("query");
-    if (!TelEngine::null(str))
-	db->queryDb(*str,&msg);
+    if (!TelEngine::null(str)) {
+	// asynchronous queries are answered by a message named by "notify"
+	if (msg.getBoolValue("async")) {
+	    if (!db->queueAsync(new Message(msg)))
+		return failure(&msg);
+	    msg.setParam("queued",String::boolText(true));
+	}
+	else
+	    db->queryDb(*str,&msg);
+    }
     db = 0;
     msg.setParam("dbtype","pgsqldb");
     return true;
@@ -607,7 +1286,7 @@ PgModule::~PgModule()
 void PgModule::statusModule(String& str)
 {
     Module::statusModule(str);
-    str.append("format=Total|Failed|Errors|AvgExecTime",",");
+    str.append("format=Total|Failed|Errors|AvgExecTime|Queued|WaitP50|WaitP90|WaitP99",",");
 }
 
 void PgModule::statusParams(String& str)
@@ -629,10 +1308,36 @@ void PgModule::statusDetail(String& str)
 	    str << (acc->queryTime() / (acc->total() - acc->failed()) / 1000); //miliseconds
         else
 	    str << "0";
+	unsigned int p50, p90, p99;
+	acc->waitTimes(p50,p90,p99);
+	str << "|" << acc->queued() << "|" << p50 << "|" << p90 << "|" << p99;
     }
     s_conmutex.unlock();
 }
 
+bool PgModule::received(Message& msg, int id)
+{
+    if (id == Status) {
+	// status pgsqldb templates: list the query templates of all accounts
+	String target = msg.getValue(YSTRING("module"));
+	if (target.startSkip(name()) && (target == YSTRING("templates"))) {
+	    String str;
+	    unsigned int n = 0;
+	    s_conmutex.lock();
+	    for (ObjList* o = s_accounts.skipNull(); o; o = o->skipNext())
+		n += static_cast<PgAccount*>(o->get())->listTemplates(str);
+	    s_conmutex.unlock();
+	    msg.retValue() << "name=" << name() << ",type=" << type()
+		<< ",format=Hits|Prepares|Prepared;templates=" << n;
+	    if (str)
+		msg.retValue() << ";" << str;
+	    msg.retValue() << "\r\n";
+	    return true;
+	}
+    }
+    return Module::received(msg,id);
+}
+
 void PgModule::initialize()
 {
     Module::initialize();
@@ -671,6 +1376,12 @@ void PgModule::genUpdate(Message& msg)
 	msg.setParam(String("errorred.") << index,String(acc->errorred()));
 	msg.setParam(String("hasconn.") << index,String::boolText(acc->hasConn()));
 	msg.setParam(String("querytime.") << index,String(acc->queryTime()));
+	unsigned int p50, p90, p99;
+	acc->waitTimes(p50,p90,p99);
+	msg.setParam(String("queued.") << index,String(acc->queued()));
+	msg.setParam(String("waittime50.") << index,String(p50));
+	msg.setParam(String("waittime90.") << index,String(p90));
+	msg.setParam(String("waittime99.") << index,String(p99));
 	index++;
     }
     s_conmutex.unlock();
@@ -29,6 +29,7 @@ static bool s_critical = false;
 static u_int32_t s_nextTime = 0;
 static int s_expire = 30;
 static bool s_errOffline = true;
+static bool s_templates = false;
 static ObjList s_handlers;
 
 static NamedList s_statusaccounts("StatusAccounts");
@@ -56,6 +57,8 @@ public:
     virtual ~AAAHandler();
     void loadAccount();
     static void prepareQuery(Message& msg, const String& account, const String& query, bool results);
+    static void bindQuery(Message& msg, const String& account, const String& name,
+	const String& query, const NamedList& params, bool results);
     virtual const String& name() const;
     virtual bool received(Message& msg);
     virtual bool loadQuery();
@@ -380,6 +383,33 @@ void AAAHandler::prepareQuery(Message& msg, const String& account, const String&
     msg.setParam("results",String::boolText(results));
 }
 
+// add the account, query template and the values it uses to the "database" message
+// the database module substitutes the ${name} placeholders, as prepared statement
+//  parameters if it can, so values are not SQL escaped here
+void AAAHandler::bindQuery(Message& msg, const String& account, const String& name,
+    const String& query, const NamedList& params, bool results)
+{
+    // values named like the database message parameters cannot be bound
+    static const char* const s_reserved[] = {
+	"account", "query", "template", "results", "async", "notify", 0
+    };
+    NamedList values("");
+    bool ok = s_templates && (params.collectParams(query,values,s_reserved) >= 0);
+    if (!ok) {
+	String tmp = query;
+	params.replaceParams(tmp,true);
+	prepareQuery(msg,account,tmp,results);
+	return;
+    }
+    Debug(&module,DebugInfo,"On account '%s' performing template '%s'%s",
+	account.c_str(),name.c_str(),(results ? " expects results" : ""));
+    msg.copyParams(values);
+    msg.setParam("account",account);
+    msg.setParam("template","register." + name);
+    msg.setParam("query",query);
+    msg.setParam("results",String::boolText(results));
+}
+
 // run the initialization query
 void AAAHandler::initQuery()
 {
@@ -414,11 +444,10 @@ bool AAAHandler::received(Message& msg)
 {
     if (m_query.null() || m_account.null())
 	return false;
-    String query(m_query);
+    const String& query = m_query;
     String account(m_account);
-    msg.replaceParams(query,true);
     msg.replaceParams(account,true);
-    if (query.null() || account.null())
+    if (account.null())
 	return false;
 
     switch (m_type)
@@ -430,7 +459,7 @@ bool AAAHandler::received(Message& msg)
 	    if (s_critical)
 		return failure(&msg);
 	    Message m("database");
-	    prepareQuery(m,account,query,true);
+	    bindQuery(m,account,name(),query,msg,true);
 	    if (Engine::dispatch(m))
 		if (m.getIntValue("affected") >= 1 || m.getIntValue("rows") >=1)
 		    return true;
@@ -442,7 +471,7 @@ bool AAAHandler::received(Message& msg)
 	    if (!msg.getBoolValue(YSTRING("auth_register"),true))
 		return false;
 	    Message m("database");
-	    prepareQuery(m,account,query,true);
+	    bindQuery(m,account,name(),query,msg,true);
 	    if (Engine::dispatch(m))
 		if (m.getIntValue("rows") >=1)
 		{
@@ -464,7 +493,7 @@ bool AAAHandler::received(Message& msg)
 	    if (s_critical)
 		return failure(&msg);
 	    Message m("database");
-	    prepareQuery(m,account,query,true);
+	    bindQuery(m,account,name(),query,msg,true);
 	    if (Engine::dispatch(m))
 		if (m.getIntValue("rows") >=1)
 		{
@@ -481,7 +510,7 @@ bool AAAHandler::received(Message& msg)
 	    if (s_critical)
 		return failure(&msg);
 	    Message m("database");
-	    prepareQuery(m,account,query,true);
+	    bindQuery(m,account,name(),query,msg,true);
 	    if (Engine::dispatch(m))
 		if (m.getIntValue("rows") >=1)
 		{
@@ -508,7 +537,7 @@ bool AAAHandler::received(Message& msg)
 		return false;
 	    // no error check needed on unregister - we return false
 	    Message m("database");
-	    prepareQuery(m,account,query,true);
+	    bindQuery(m,account,name(),query,msg,true);
 	    // we don't enqueue the message because we must assure ourselves that this message is processed synchronously
 	    Engine::dispatch(m);
 	}
@@ -523,7 +552,7 @@ bool AAAHandler::received(Message& msg)
 		return false;
 	    // no error check needed - we enqueue the query and return false
 	    Message* m = new Message("database");
-	    prepareQuery(*m,account,query,false);
+	    bindQuery(*m,account,name(),query,msg,false);
 	    Engine::enqueue(m);
 	}
 	break;
@@ -570,14 +599,15 @@ bool CDRHandler::received(Message& msg)
     // Don't update CDR if told so
     if (!msg.getBoolValue("cdrwrite",true))
 	return false;
-    String query(msg.getValue("operation"));
-    if (query == YSTRING("initialize"))
+    const String& oper = msg[YSTRING("operation")];
+    String query;
+    if (oper == YSTRING("initialize"))
 	query = m_queryInitialize;
-    else if (query == YSTRING("update"))
+    else if (oper == YSTRING("update"))
 	query = m_queryUpdate;
-    else if (query == YSTRING("combined"))
+    else if (oper == YSTRING("combined"))
 	query = m_queryCombined;
-    else if (query == YSTRING("finalize"))
+    else if (oper == YSTRING("finalize"))
 	query = m_query;
     else
 	return false;
@@ -585,14 +615,13 @@ bool CDRHandler::received(Message& msg)
     if (query.null())
 	return false;
     String account(m_account);
-    msg.replaceParams(query,true);
     msg.replaceParams(account,true);
-    if (query.null() || account.null())
+    if (account.null())
 	return false;
 
     // failure while accounting is critical
     Message m("database");
-    prepareQuery(m,account,query,true);
+    bindQuery(m,account,name() + "." + oper,query,msg,true);
     bool error = !Engine::dispatch(m) || m.getParam("error");
     if (m_critical && (s_critical != error)) {
 	s_critical = error;
@@ -634,11 +663,9 @@ Array* EventNotify::queryDatabase(Message& msg, const String& notifier,
     NamedList nl("");
     nl.addParam("notifier",notifier);
     nl.addParam("event",m_event);
-    String query = m_querySubs;
     String account = m_account;
-    nl.replaceParams(query,true);
     nl.replaceParams(account,true);
-    prepareQuery(msg,account,query,true);
+    bindQuery(msg,account,name() + ".notify",m_querySubs,nl,true);
     if (!Engine::dispatch(msg))
 	return 0;
     rows = msg.getIntValue("rows",0);
@@ -793,25 +820,23 @@ bool SubscribeHandler::received(Message& msg)
 	msg.getValue("operation"),msg.getValue("notifier"),
 	msg.getValue("subscriber"),msg.getValue("event"),msg.getValue("notifyto"));
 
-    String query = msg.getValue("operation");
+    const String& oper = msg[YSTRING("operation")];
+    String query;
     bool subscribe = true;
-    if(query == "subscribe")
+    if(oper == "subscribe")
 	query = m_querySubscribe;
-    else if (query == "unsubscribe") {
+    else if (oper == "unsubscribe") {
 	subscribe = false;
 	query = m_queryUnsubscribe;
     }
-    else
-	query = "";
 
     if (!query)
 	return false;
 
     String account = m_account;
-    msg.replaceParams(query,true);
     msg.replaceParams(account,true);
     Message m("database");
-    prepareQuery(m,account,query,true);
+    bindQuery(m,account,name() + "." + oper,query,msg,true);
     int rows = 0;
     if(!Engine::dispatch(m)) {
 	msg.setParam("reason","failure");
@@ -887,10 +912,8 @@ bool SubscribeTimerHandler::received(Message& msg)
 
     Message m("database");
     String account = m_account;
-    String query = m_queryExpire;
-    msg.replaceParams(query,true);
     msg.replaceParams(account,true);
-    prepareQuery(m,account,query,true);
+    bindQuery(m,account,name() + ".expire",m_queryExpire,msg,true);
     if(!Engine::dispatch(m))
 	return false;
 
@@ -1029,6 +1052,7 @@ void RegistModule::initialize()
     Output("Initializing module Register for database");
     s_expire = s_cfg.getIntValue("general","expires",s_expire);
     s_errOffline = s_cfg.getBoolValue("call.route","offlineauto",true);
+    s_templates = s_cfg.getBoolValue("general","templates",false);
     Engine::install(new MessageRelay("engine.start",this,Private,150));
     addHandler("call.cdr",AAAHandler::Cdr);
     addHandler("linetracker",AAAHandler::Cdr);
@@ -0,0 +1,466 @@
+/*
+ * benchmark.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Microbenchmarks for engine classes, run with "benchmark <test>"
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2013 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatephone.h>
+#include <yatexml.h>
+
+#include <math.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+typedef void (*BenchFunc)(String& out, int size, int loops);
+
+struct BenchTest
+{
+    const char* name;
+    BenchFunc func;
+    int size;
+    int loops;
+};
+
+class BenchHandler : public MessageHandler
+{
+public:
+    BenchHandler()
+	: MessageHandler("engine.command",100,"benchmark")
+	{ }
+    virtual bool received(Message& msg);
+};
+
+// Call endpoint used to attach audio legs to a conference room
+class BenchLeg : public CallEndpoint
+{
+public:
+    BenchLeg(const char* id)
+	: CallEndpoint(id)
+	{ }
+};
+
+// Consumer that measures the level of the data it receives
+class BenchConsumer : public DataConsumer
+{
+public:
+    BenchConsumer(const char* format)
+	: DataConsumer(format), m_samples(0), m_sum2(0)
+	{ }
+    virtual unsigned long Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags)
+	{
+	    unsigned int n = data.length() / 2;
+	    const int16_t* p = (const int16_t*)data.data();
+	    for (unsigned int i = 0; i < n; i++)
+		m_sum2 += (int64_t)p[i] * p[i];
+	    m_samples += n;
+	    return invalidStamp();
+	}
+    inline unsigned int samples() const
+	{ return m_samples; }
+    inline unsigned int rms() const
+	{ return m_samples ? (unsigned int)::sqrt((double)m_sum2 / m_samples) : 0; }
+private:
+    unsigned int m_samples;
+    u_int64_t m_sum2;
+};
+
+class Benchmark : public Plugin
+{
+public:
+    Benchmark();
+    virtual ~Benchmark();
+    virtual void initialize();
+private:
+    bool m_init;
+};
+
+INIT_PLUGIN(Benchmark);
+
+// Report the time spent in a loop
+static void report(String& out, const char* what, int count, u_int64_t usec)
+{
+    if (!usec)
+	usec = 1;
+    out << "  " << what << ": " << count << " in " << (unsigned int)usec << " usec, "
+	<< (unsigned int)((1000 * (u_int64_t)count) / usec) << "/msec\r\n";
+}
+
+// Linear parameter lookup as done before NamedList had an index
+static const NamedString* linearParam(const NamedList& list, const String& name)
+{
+    for (const ObjList* l = list.paramList()->skipNull(); l; l = l->skipNext()) {
+	const NamedString* s = static_cast<const NamedString*>(l->get());
+	if (s->name() == name)
+	    return s;
+    }
+    return 0;
+}
+
+// Look up every parameter of a message, plus a missing one, many times
+static void benchNamedList(String& out, int size, int loops)
+{
+    NamedList list("benchmark");
+    ObjList names;
+    for (int i = 0; i < size; i++) {
+	String* name = new String("param_");
+	*name << i;
+	list.addParam(*name,String(i));
+	names.append(name);
+    }
+    names.append(new String("missing"));
+    out << "NamedList lookup of " << size << " parameters\r\n";
+    int count = 0;
+    u_int64_t t = Time::now();
+    for (int n = 0; n < loops; n++) {
+	for (ObjList* l = names.skipNull(); l; l = l->skipNext()) {
+	    if (linearParam(list,*static_cast<String*>(l->get())))
+		count++;
+	}
+    }
+    report(out,"linear",count,Time::now() - t);
+    count = 0;
+    t = Time::now();
+    for (int n = 0; n < loops; n++) {
+	for (ObjList* l = names.skipNull(); l; l = l->skipNext()) {
+	    if (list.getParam(*static_cast<String*>(l->get())))
+		count++;
+	}
+    }
+    report(out,"indexed",count,Time::now() - t);
+}
+
+// Build messages of many parameters and count them
+static void benchNamedBuild(String& out, int size, int loops)
+{
+    out << "NamedList building of " << size << " parameters\r\n";
+    unsigned int count = 0;
+    u_int64_t t = Time::now();
+    for (int n = 0; n < loops; n++) {
+	// plain list append walks to the end each time
+	ObjList list;
+	for (int i = 0; i < size; i++)
+	    list.append(new NamedString("param",String(i)));
+	count += list.count();
+    }
+    report(out,"ObjList append",count,Time::now() - t);
+    count = 0;
+    t = Time::now();
+    for (int n = 0; n < loops; n++) {
+	NamedList list("benchmark");
+	for (int i = 0; i < size; i++)
+	    list.addParam("param",String(i));
+	count += list.count();
+    }
+    report(out,"NamedList addParam",count,Time::now() - t);
+}
+
+// Build status lines with one entry per channel as Driver::statusDetail does
+// Shrinking after each append emulates the exact allocation done before
+static void benchStatus(String& out, int size, int loops)
+{
+    out << "Status line of " << size << " channels\r\n";
+    for (int exact = 1; exact >= 0; exact--) {
+	unsigned int total = 0;
+	u_int64_t t = Time::now();
+	for (int n = 0; n < loops; n++) {
+	    String str;
+	    for (int i = 0; i < size; i++) {
+		str << (i ? "," : "") << "sip/" << i << "=answered|127.0.0.1:5070|tone/" << i;
+		if (exact)
+		    str.shrink();
+	    }
+	    total += str.length();
+	}
+	report(out,exact ? "exact" : "capacity",total,Time::now() - t);
+    }
+}
+
+static const char* s_sipHeaders[] = {
+    "INVITE sip:1234@127.0.0.1:5070 SIP/2.0",
+    "Via: SIP/2.0/UDP 127.0.0.1:5060;rport;branch=z9hG4bK1529258327",
+    "From: <sip:dumb@127.0.0.1>;tag=1529258327",
+    "To: <sip:1234@127.0.0.1:5070>",
+    "Call-ID: 1974076084@127.0.0.1",
+    "CSeq: 1 INVITE",
+    "User-Agent: YATE/5.0.1",
+    "Contact: <sip:dumb@127.0.0.1:5060>",
+    "Max-Forwards: 70",
+    "Allow: ACK, INVITE, BYE, CANCEL, REGISTER, REFER, OPTIONS, INFO",
+    "Content-Type: application/sdp",
+    0
+};
+
+// Build SIP messages with headers and body as SIPMessage::getBuffer does
+static void benchSipBuffer(String& out, int size, int loops)
+{
+    String body;
+    for (int i = 0; i < size; i++)
+	body << "a=rtpmap:" << i << " PCMU/8000\r\n";
+    out << "SIP message with " << body.length() << " bytes body\r\n";
+    for (int exact = 1; exact >= 0; exact--) {
+	unsigned int total = 0;
+	u_int64_t t = Time::now();
+	for (int n = 0; n < loops; n++) {
+	    String hdrs;
+	    for (const char** h = s_sipHeaders; *h; h++) {
+		hdrs << *h << "\r\n";
+		if (exact)
+		    hdrs.shrink();
+	    }
+	    String cl;
+	    cl << "Content-Length: " << body.length() << "\r\n\r\n";
+	    DataBlock buf;
+	    if (!exact)
+		buf.reserve(hdrs.length() + cl.length() + body.length());
+	    buf += hdrs;
+	    buf += cl;
+	    if (exact)
+		buf.shrink();
+	    buf += body;
+	    total += buf.length();
+	}
+	report(out,exact ? "exact" : "capacity",total,Time::now() - t);
+    }
+}
+
+// Run one conference room with many legs talking in turns
+static void benchRoom(String& out, int size, int loops, int maxmix)
+{
+    String room("benchmark-");
+    room << size << "-" << maxmix;
+    ObjList legs;
+    ObjList srcs;
+    for (int i = 0; i < size; i++) {
+	String id("bench/");
+	id << i;
+	BenchLeg* leg = new BenchLeg(id);
+	Message m("call.execute");
+	m.userData(leg);
+	m.addParam("callto","conf/" + room);
+	m.addParam("maxusers",String(size));
+	m.addParam("maxmix",String(maxmix));
+	CallEndpoint* peer = Engine::dispatch(m) ? leg->getPeer() : 0;
+	DataConsumer* cons = peer ? peer->getConsumer() : 0;
+	if (!cons) {
+	    out << "  could not attach " << id << " to conf/" << room << "\r\n";
+	    leg->deref();
+	    break;
+	}
+	DataSource* src = new DataSource;
+	src->attach(cons);
+	legs.append(leg);
+	srcs.append(src);
+    }
+    // each leg talks for 25 blocks then stays silent for 75 blocks
+    DataBlock voice(0,320);
+    int16_t* p = (int16_t*)voice.data();
+    for (unsigned int i = 0; i < 160; i++)
+	p[i] = (int16_t)((i & 16) ? 1000 + 50 * (i & 15) : -1000 - 50 * (i & 15));
+    DataBlock silence(0,320);
+    int count = 0;
+    u_int64_t t = Time::now();
+    for (int n = 0; n < loops; n++) {
+	int i = 0;
+	for (ObjList* l = srcs.skipNull(); l; l = l->skipNext(), i++) {
+	    bool talk = ((n + i) % 100) < 25;
+	    static_cast<DataSource*>(l->get())->Forward(talk ? voice : silence);
+	    count++;
+	}
+    }
+    String what;
+    if (maxmix)
+	what << "loudest " << maxmix;
+    else
+	what = "all legs";
+    report(out,what,count,Time::now() - t);
+    for (ObjList* l = srcs.skipNull(); l; l = l->skipNext())
+	static_cast<DataSource*>(l->get())->clear();
+    srcs.clear();
+    for (ObjList* l = legs.skipNull(); l; l = l->skipNext())
+	static_cast<CallEndpoint*>(l->get())->disconnect("benchmark");
+    legs.clear();
+}
+
+// Feed audio blocks into conference rooms of many legs
+static void benchConference(String& out, int size, int loops)
+{
+    out << "Conference of " << size << " legs\r\n";
+    benchRoom(out,size,loops,0);
+    benchRoom(out,size,loops,4);
+}
+
+static const char* s_resampPairs[] = {
+    "slin", "slin/16000",
+    "slin/16000", "slin",
+    "slin", "slin/48000",
+    "slin/48000", "slin",
+    "slin/44100", "slin",
+    "slin", "slin/44100",
+    "slin/48000", "slin/16000",
+    0
+};
+
+// Resample a sine wave of the given frequency through translator chains
+static void benchResample(String& out, int size, int loops)
+{
+    out << "Resampling a " << size << " Hz tone of RMS 7071\r\n";
+    for (const char** fmt = s_resampPairs; *fmt; fmt += 2) {
+	DataSource* src = new DataSource(fmt[0]);
+	BenchConsumer* cons = new BenchConsumer(fmt[1]);
+	String what;
+	what << fmt[0] << " -> " << fmt[1];
+	if (!DataTranslator::attachChain(src,cons)) {
+	    out << "  " << what << ": no translator\r\n";
+	    TelEngine::destruct(src);
+	    TelEngine::destruct(cons);
+	    continue;
+	}
+	// 10 msec blocks
+	int rate = src->getFormat().sampleRate();
+	unsigned int n = rate / 100;
+	DataBlock block(0,2 * n);
+	int16_t* p = (int16_t*)block.data();
+	unsigned int count = 0;
+	unsigned long ts = 0;
+	u_int64_t t = Time::now();
+	for (int i = 0; i < loops; i++) {
+	    for (unsigned int j = 0; j < n; j++, count++)
+		p[j] = (int16_t)(10000 * ::sin(2 * M_PI * size * count / rate));
+	    ts += n;
+	    src->Forward(block,ts);
+	}
+	t = Time::now() - t;
+	what << " (" << cons->samples() << " out, RMS " << cons->rms() << ")";
+	report(out,what,count,t);
+	DataTranslator::detachChain(src,cons);
+	TelEngine::destruct(src);
+	TelEngine::destruct(cons);
+    }
+}
+
+// Parse a stream of XMPP stanzas pushed in chunks as read from a socket
+static void benchXml(String& out, int size, int loops)
+{
+    String stream;
+    unsigned int n = 0;
+    while (stream.length() < (unsigned int)loops * 1024) {
+	stream << "<message to='juliet@example.com' from='romeo@example.net/orchard'"
+	    << " type='chat' id='m" << n << "'><body>Wherefore art thou, Romeo? &amp; "
+	    << n << "</body></message>";
+	// Some stanzas carry a large text spread over many chunks
+	if (!(++n % 1000)) {
+	    stream << "<iq type='set' id='v" << n << "'><vCard xmlns='vcard-temp'><PHOTO><BINVAL>";
+	    for (int i = 0; i < 1024; i++)
+		stream << "R0lGODlhAQABAIAAAAAAAP///yH5BAEAAAAALAAAAAABAAEAAAIBRAA7";
+	    stream << "</BINVAL></PHOTO></vCard></iq>";
+	}
+    }
+    out << "XML stream of " << stream.length() << " bytes in chunks of " << size << "\r\n";
+    XmlDomParser parser("benchmark",true);
+    unsigned int stanzas = 0;
+    u_int64_t t = Time::now();
+    for (unsigned int i = 0; i < stream.length(); i += size) {
+	if (!parser.parse(stream.substr(i,size)) && parser.error() != XmlSaxParser::Incomplete) {
+	    out << "  parse error: " << parser.getError() << "\r\n";
+	    return;
+	}
+	XmlElement* xml;
+	while (0 != (xml = parser.fragment()->popElement())) {
+	    stanzas++;
+	    TelEngine::destruct(xml);
+	}
+    }
+    t = Time::now() - t;
+    String what;
+    what << "bytes (" << stanzas << " stanzas)";
+    report(out,what,stream.length(),t);
+}
+
+static const BenchTest s_tests[] = {
+    { "namedlist", benchNamedList, 100, 1000 },
+    { "namedbuild", benchNamedBuild, 100, 1000 },
+    { "status", benchStatus, 1000, 100 },
+    { "sipbuffer", benchSipBuffer, 10, 10000 },
+    { "conference", benchConference, 100, 500 },
+    { "resample", benchResample, 1000, 1000 },
+    { "xml", benchXml, 1024, 5120 },
+    { 0, 0, 0, 0 }
+};
+
+bool BenchHandler::received(Message& msg)
+{
+    String line(msg.getValue(YSTRING("line")));
+    if (line.null()) {
+	const String* partial = msg.getParam(YSTRING("partline"));
+	if (partial && (*partial == YSTRING("benchmark"))) {
+	    const String& word = msg[YSTRING("partword")];
+	    for (const BenchTest* b = s_tests; b->name; b++)
+		if (word.null() || String(b->name).startsWith(word))
+		    msg.retValue().append(b->name,"\t");
+	}
+	else if (!partial || partial->null()) {
+	    const String& word = msg[YSTRING("partword")];
+	    if (word.null() || String("benchmark").startsWith(word))
+		msg.retValue().append("benchmark","\t");
+	}
+	return false;
+    }
+    if (!line.startSkip("benchmark"))
+	return false;
+    // benchmark <test> [size] [loops]
+    ObjList* args = line.split(' ',false);
+    const String* test = static_cast<const String*>((*args)[0]);
+    for (const BenchTest* b = s_tests; b->name; b++) {
+	if (test && (*test != b->name))
+	    continue;
+	const String* tmp = static_cast<const String*>((*args)[1]);
+	int size = tmp ? tmp->toInteger(b->size,0,1) : b->size;
+	tmp = static_cast<const String*>((*args)[2]);
+	int loops = tmp ? tmp->toInteger(b->loops,0,1) : b->loops;
+	b->func(msg.retValue(),size,loops);
+    }
+    TelEngine::destruct(args);
+    return true;
+}
+
+
+Benchmark::Benchmark()
+    : Plugin("benchmark","misc"),
+      m_init(false)
+{
+    Output("Loaded module Benchmark");
+}
+
+Benchmark::~Benchmark()
+{
+    Output("Unloading module Benchmark");
+}
+
+void Benchmark::initialize()
+{
+    Output("Initializing module Benchmark");
+    if (m_init)
+	return;
+    m_init = true;
+    Engine::install(new BenchHandler);
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
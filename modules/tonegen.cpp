@@ -123,6 +123,7 @@ class ToneSource : public ThreadedSource
 public:
     virtual void destroyed();
     virtual void run();
+    virtual bool tick(const Time& when);
     inline const String& name()
 	{ return m_name; }
     bool startup();
@@ -143,10 +144,18 @@ protected:
     int m_repeat;
     bool m_firstPass;
 private:
+    void initData();
+    void fillData();
+    void endData();
     DataBlock m_data;
     unsigned m_brate;
     unsigned m_total;
     u_int64_t m_time;
+    u_int64_t m_tpos;
+    const Tone* m_cur;
+    int m_samp;
+    int m_dpos;
+    int m_nsam;
 };
 
 class TempSource : public ToneSource
@@ -200,6 +209,7 @@ public:
 static ObjList s_toneDesc;               // List of configured tones
 static ObjList s_defToneDesc;            // List of default tones
 static String s_defLang;                 // Default tone language
+static bool s_sharedClock = false;       // Play tones from shared clock threads
 static const String s_default = "itu";
 
 // 421.052Hz (19 samples @ 8kHz) sine wave, pretty close to standard 425Hz
@@ -655,7 +665,8 @@ bool ToneData::decode(const String& desc, int& samples, const short*& data, bool
 
 ToneSource::ToneSource(const ToneDesc* tone)
     : m_tone(0), m_repeat(tone == 0), m_firstPass(true),
-      m_data(0,320), m_brate(16000), m_total(0), m_time(0)
+      m_data(0,320), m_brate(16000), m_total(0), m_time(0),
+      m_tpos(0), m_cur(0), m_samp(0), m_dpos(1), m_nsam(0)
 {
     if (tone) {
 	m_tone = tone->tones();
@@ -677,7 +688,9 @@ void ToneSource::destroyed()
 bool ToneSource::startup()
 {
     DDebug(&__plugin,DebugAll,"ToneSource::startup(\"%s\") tone=%p",m_name.c_str(),m_tone);
-    return m_tone && start("Tone Source");
+    if (!m_tone)
+	return false;
+    return s_sharedClock ? schedule() : start("Tone Source");
 }
 
 void ToneSource::cleanup()
@@ -844,44 +857,63 @@ ToneSource* ToneSource::getTone(String& tone, const String& prefix)
     return t;
 }
 
+// Reset the generator to the start of the tone
+void ToneSource::initData()
+{
+    m_tpos = Time::now();
+    m_time = m_tpos;
+    m_samp = 0; // sample number
+    m_dpos = 1; // position in data
+    m_cur = m_tone;
+    m_nsam = m_cur->nsamples;
+    if (m_nsam < 0)
+	m_nsam = -m_nsam;
+}
+
+// Fill the data buffer with the next block of samples
+void ToneSource::fillData()
+{
+    short *d = (short *) m_data.data();
+    for (unsigned int i = m_data.length()/2; i--; m_samp++,m_dpos++) {
+	if (m_samp >= m_nsam) {
+	    // go to the start of the next tone
+	    m_samp = 0;
+	    const Tone *otone = m_cur;
+	    advanceTone(m_cur);
+	    m_nsam = m_cur ? m_cur->nsamples : 32000;
+	    if (m_nsam < 0) {
+		m_nsam = -m_nsam;
+		// reset repeat point here
+		m_tone = m_cur;
+	    }
+	    if (m_cur != otone)
+		m_dpos = 1;
+	}
+	if (m_cur && m_cur->data) {
+	    if (m_dpos > m_cur->data[0])
+		m_dpos = 1;
+	    *d++ = m_cur->data[m_dpos];
+	}
+	else
+	    *d++ = 0;
+    }
+}
+
+void ToneSource::endData()
+{
+    Debug(&__plugin,DebugAll,"ToneSource [%p] end, total=%u (%u b/s)",
+	this,m_total,byteRate(m_time,m_total));
+    m_time = 0;
+}
+
 void ToneSource::run()
 {
     Debug(&__plugin,DebugAll,"ToneSource::run() [%p]",this);
-    u_int64_t tpos = Time::now();
-    m_time = tpos;
-    int samp = 0; // sample number
-    int dpos = 1; // position in data
-    const Tone* tone = m_tone;
-    int nsam = tone->nsamples;
-    if (nsam < 0)
-	nsam = -nsam;
+    initData();
     while (m_tone && looping(noChan())) {
 	Thread::check();
-	short *d = (short *) m_data.data();
-	for (unsigned int i = m_data.length()/2; i--; samp++,dpos++) {
-	    if (samp >= nsam) {
-		// go to the start of the next tone
-		samp = 0;
-		const Tone *otone = tone;
-		advanceTone(tone);
-		nsam = tone ? tone->nsamples : 32000;
-		if (nsam < 0) {
-		    nsam = -nsam;
-		    // reset repeat point here
-		    m_tone = tone;
-		}
-		if (tone != otone)
-		    dpos = 1;
-	    }
-	    if (tone && tone->data) {
-		if (dpos > tone->data[0])
-		    dpos = 1;
-		*d++ = tone->data[dpos];
-	    }
-	    else
-		*d++ = 0;
-	}
-	int64_t dly = tpos - Time::now();
+	fillData();
+	int64_t dly = m_tpos - Time::now();
 	if (dly > 0) {
 	    XDebug(&__plugin,DebugAll,"ToneSource sleeping for " FMT64 " usec",dly);
 	    Thread::usleep((unsigned long)dly);
@@ -890,11 +922,29 @@ void ToneSource::run()
 	    break;
 	Forward(m_data,m_total/2);
 	m_total += m_data.length();
-	tpos += (m_data.length()*(u_int64_t)1000000/m_brate);
+	m_tpos += (m_data.length()*(u_int64_t)1000000/m_brate);
     }
-    Debug(&__plugin,DebugAll,"ToneSource [%p] end, total=%u (%u b/s)",
-	this,m_total,byteRate(m_time,m_total));
-    m_time = 0;
+    endData();
+}
+
+// Called from a shared clock, send all blocks that became due
+bool ToneSource::tick(const Time& when)
+{
+    if (!m_time) {
+	Debug(&__plugin,DebugAll,"ToneSource::tick() started [%p]",this);
+	initData();
+    }
+    while (m_tpos <= when) {
+	if (!(m_tone && looping(noChan()))) {
+	    endData();
+	    return false;
+	}
+	fillData();
+	Forward(m_data,m_total/2);
+	m_total += m_data.length();
+	m_tpos += (m_data.length()*(u_int64_t)1000000/m_brate);
+    }
+    return true;
 }
 
 
@@ -1228,6 +1278,7 @@ void ToneGenDriver::initialize()
     // Init tones from config
     Configuration cfg(Engine::configFile("tonegen"));
     s_defLang = cfg.getValue("general","lang");
+    s_sharedClock = cfg.getBoolValue("general","shared_clock");
     if (s_defLang == s_default)
 	s_defLang.clear();
     unsigned int n = cfg.sections();
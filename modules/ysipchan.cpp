@@ -25,6 +25,13 @@
 
 #include <string.h>
 
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
 
 using namespace TelEngine;
 namespace { // anonymous
@@ -35,6 +42,7 @@ class YateSIPTransport;                  // SIP transport: keeps a socket, read/
 class YateSIPUDPTransport;               // UDP transport
 class YateSIPTCPTransport;               // TCP/TLS transport
 class YateSIPTransportWorker;            // A transport worker
+class YateSIPTCPReactor;                 // Incoming TCP/TLS transports multiplexer
 class YateSIPTCPListener;                // A TCP listener
 class YateUDPParty;                      // A SIP UDP party
 class YateTCPParty;                      // A SIP TCP/TLS party
@@ -54,6 +62,18 @@ class SIPDriver;
 #define TCP_IDLE_DEF 120
 #define TCP_IDLE_MAX 600
 
+// Maximum number of UDP datagrams read at once by a transport
+#define UDP_BATCH 8
+
+// TCP reactor timer wheel tick (usec) and number of slots
+#define REACTOR_TICK 100000
+#define REACTOR_SLOTS 1024
+// Maximum socket events retrieved at once by a TCP reactor
+#define REACTOR_EVENTS 64
+// Outgoing messages waiting to be sent on a reactor handled connection before
+//  we stop reading from it, a peer that doesn't read is not allowed to send more
+#define REACTOR_QUEUE_MAX 64
+
 // Maximum allowed value for bind retry interval in milliseconds
 // 1 minute
 #define BIND_RETRY_MAX 60000
@@ -452,6 +472,7 @@ class YateSIPTCPTransport : public YateSIPTransport
 {
     YCLASS(YateSIPTCPTransport,YateSIPTransport);
     friend class YateTCPParty;
+    friend class YateSIPTCPReactor;
 public:
     // Build an outgoing transport
     YateSIPTCPTransport(bool tls, const String& laddr, const String& raddr, int rport);
@@ -497,6 +518,8 @@ protected:
     void resetConnection(Socket* sock = 0);
     // Set transport idle timeout
     void setIdleTimeout(u_int64_t time = Time::now());
+    // Time a reactor must process the transport if nothing happens on the socket
+    u_int64_t reactorTimeout(u_int64_t now, int wait);
     // Send keep alive (or response to keep alive)
     bool sendKeepAlive(bool request);
     inline bool sendPendingKeepAlive() {
@@ -527,6 +550,14 @@ protected:
     String m_localAddr;                  // Optional local address to bind to
     unsigned int m_connectRetry;         // Number of re-connect
     u_int64_t m_nextConnect;             // Interval to try ro re-connect
+    // Incoming handled by a reactor (protected by the reactor mutex unless noted)
+    YateSIPTCPReactor* m_reactor;        // Reactor handling us (protected by our mutex)
+    bool m_reactorListed;                // Attached to the reactor
+    bool m_reactorReady;                 // Queued in reactor's ready list
+    bool m_reactorDetach;                // Reactor must drop us
+    int m_reactorSlot;                   // Reactor timer wheel slot, -1 if none
+    u_int64_t m_reactorTime;             // Time the reactor must process us if idle
+    unsigned int m_reactorEvents;        // Socket events we are waiting for
 };
 
 // Transport worker
@@ -542,6 +573,52 @@ private:
     YateSIPTransport* m_transport;
 };
 
+// Thread handling many incoming TCP/TLS transports
+// Transports are processed when their socket becomes ready, when they have
+//  data to send or when their idle timer expires
+class YateSIPTCPReactor : public Thread, public GenObject
+{
+public:
+    YateSIPTCPReactor(unsigned int index, Thread::Priority prio);
+    ~YateSIPTCPReactor();
+    inline bool valid() const
+	{ return m_poll >= 0 && m_wake >= 0; }
+    inline unsigned int count() const
+	{ return m_count; }
+    // Start handling an incoming transport, takes over its reference
+    bool attach(YateSIPTCPTransport* trans);
+    // Ask the reactor to drop a transport
+    void detach(YateSIPTCPTransport* trans);
+    // Process a transport as soon as possible
+    void wake(YateSIPTCPTransport* trans);
+    // Append reactor load to a status line
+    void status(String& buf);
+    virtual void run();
+    virtual void cleanup();
+    // Start the reactors
+    static void startPool(unsigned int count, Thread::Priority prio);
+    // Attach a transport to the least loaded reactor
+    static bool attachPool(YateSIPTCPTransport* trans);
+    // Retrieve the number of running reactors
+    static unsigned int poolCount();
+private:
+    void ready(YateSIPTCPTransport* trans);
+    void schedule(YateSIPTCPTransport* trans, u_int64_t when);
+    void expireTimers(u_int64_t time);
+    void watch(YateSIPTCPTransport* trans);
+    void remove(YateSIPTCPTransport* trans);
+    Mutex m_mutex;
+    unsigned int m_index;
+    int m_poll;
+    int m_wake;
+    ObjList m_transports;
+    ObjList m_ready;
+    ObjList* m_wheel;
+    u_int64_t m_tick;
+    unsigned int m_count;
+    u_int64_t m_processed;
+};
+
 class YateSIPTCPListener : public Thread, public GenObject, public ProtocolHolder, public YateSIPListener
 {
     friend class SIPDriver;
@@ -642,11 +719,6 @@ public:
     bool hasActiveTransaction(YateSIPTransport* trans);
     // Check if the engine has pending transactions
     bool hasInitialTransaction();
-    // Clear transactions
-    inline void clearTransactions() {
-	    Lock lck(this);
-	    m_transList.clear();
-	}
     inline bool prack() const
 	{ return m_prack; }
     inline bool info() const
@@ -1135,6 +1207,7 @@ public:
 	const char* target = 0);
 protected:
     virtual void genUpdate(Message& msg);
+    virtual void statusParams(String& str);
     // Setup a listener from config
     void setupListener(const String& name, const NamedList& params, bool isGeneral,
 	const NamedList& defs = NamedList::empty());
@@ -1144,9 +1217,14 @@ private:
     void msgStatusTransports(Message& msg, bool showUdp, bool showTcp, bool showTls);
     void msgStatusListener(Message& msg);
     void msgStatusTransport(Message& msg, const String& id);
+    void msgStatusReactors(Message& msg);
 
     SDPParser m_parser;
     YateSIPEndPoint *m_endpoint;
+    // engine event counter at previous status, used to compute the rate
+    u_int64_t m_statusTime;
+    u_int64_t m_statusEvents;
+    unsigned int m_statusRate;
 };
 
 static SIPDriver plugin;
@@ -3113,39 +3191,52 @@ int YateSIPUDPTransport::process()
     }
     else
 	retVal = Thread::idleUsec();
-    // We can read the data
-    m_buffer.resize(m_maxpkt);
-    int res = m_sock->recvFrom((void*)m_buffer.data(),m_buffer.length() - 1,m_remote);
-    if (res <= 0) {
+    // We can read the data, get all pending datagrams up to a batch
+    m_buffer.resize(UDP_BATCH * m_maxpkt);
+    void* bufs[UDP_BATCH];
+    int lens[UDP_BATCH];
+    SocketAddr from[UDP_BATCH];
+    for (int i = 0; i < UDP_BATCH; i++) {
+	bufs[i] = (char*)m_buffer.data() + i * m_maxpkt;
+	lens[i] = m_maxpkt - 1;
+    }
+    int n = m_sock->recvMany(bufs,lens,from,UDP_BATCH);
+    if (n <= 0) {
 	printReadError();
 	return retVal;
     }
-    if (res < 72) {
-	DDebug(&plugin,DebugInfo,
-	    "Transport(%s) received short SIP message of %d bytes from %s [%p]",
-	    m_id.c_str(),res,m_remote.addr().c_str(),this);
-	return 0;
-    }
-    char* b = (char*)m_buffer.data();
-    b[res] = 0;
-    if (s_printMsg)
-	printRecvMsg(b,res);
+    for (int i = 0; i < n; i++) {
+	int res = lens[i];
+	if (res < 0)
+	    continue;
+	m_remote = from[i];
+	if (res < 72) {
+	    DDebug(&plugin,DebugInfo,
+		"Transport(%s) received short SIP message of %d bytes from %s [%p]",
+		m_id.c_str(),res,m_remote.addr().c_str(),this);
+	    continue;
+	}
+	char* b = (char*)bufs[i];
+	b[res] = 0;
+	if (s_printMsg)
+	    printRecvMsg(b,res);
+
+	if (s_floodProtection && s_floodEvents && evc >= s_floodEvents) {
+	    if (!s_printFloodTime)
+		Alarm(&plugin,"performance",DebugWarn,
+		    "Flood detected, dropping INVITE/REGISTER/SUBSCRIBE/OPTIONS, allowing reINVITES");
+	    s_printFloodTime = Time::now() + 10000000;
+	    if (!msgIsAllowed(b,res))
+		continue;
+	}
+	else if (s_printFloodTime && s_printFloodTime < Time::now()) {
+	    s_printFloodTime = 0;
+	    Alarm(&plugin,"performance",DebugNote,"Flood drop cleared, resumed normal message processing");
+	}
 
-    if (s_floodProtection && s_floodEvents && evc >= s_floodEvents) {
-	if (!s_printFloodTime)
-	    Alarm(&plugin,"performance",DebugWarn,
-		"Flood detected, dropping INVITE/REGISTER/SUBSCRIBE/OPTIONS, allowing reINVITES");
-	s_printFloodTime = Time::now() + 10000000;
-	if (!msgIsAllowed(b,res))
-	    return 0;
-    }
-    else if (s_printFloodTime && s_printFloodTime < Time::now()) {
-	s_printFloodTime = 0;
-	Alarm(&plugin,"performance",DebugNote,"Flood drop cleared, resumed normal message processing");
+	SIPMessage* msg = SIPMessage::fromParsing(0,b,res);
+	receiveMsg(msg);
     }
-
-    SIPMessage* msg = SIPMessage::fromParsing(0,b,res);
-    receiveMsg(msg);
     return 0;
 }
 
@@ -3159,7 +3250,9 @@ YateSIPTCPTransport::YateSIPTCPTransport(bool tls, const String& laddr, const St
     m_flowTimer(false), m_keepAlivePending(false),
     m_msg(0), m_sipBufOffs(0), m_contentLen(0),
     m_remoteAddr(raddr), m_remotePort(rport), m_localAddr(laddr),
-    m_connectRetry(s_tcpConnectRetry), m_nextConnect(0)
+    m_connectRetry(s_tcpConnectRetry), m_nextConnect(0),
+    m_reactor(0), m_reactorListed(false), m_reactorReady(false), m_reactorDetach(false),
+    m_reactorSlot(-1), m_reactorTime(0), m_reactorEvents(0)
 {
     m_maxpkt = s_tcpMaxpkt;
     if (m_remotePort <= 0)
@@ -3178,7 +3271,9 @@ YateSIPTCPTransport::YateSIPTCPTransport(Socket* sock, bool tls)
     m_idleInterval(TCP_IDLE_DEF), m_idleTimeout(0),
     m_flowTimer(false), m_keepAlivePending(false),
     m_msg(0), m_sipBufOffs(0), m_contentLen(0),
-    m_remotePort(0), m_connectRetry(0), m_nextConnect(0)
+    m_remotePort(0), m_connectRetry(0), m_nextConnect(0),
+    m_reactor(0), m_reactorListed(false), m_reactorReady(false), m_reactorDetach(false),
+    m_reactorSlot(-1), m_reactorTime(0), m_reactorEvents(0)
 {
     m_maxpkt = s_tcpMaxpkt;
     m_id << (tls ? "tls:" : "tcp:");
@@ -3210,8 +3305,9 @@ bool YateSIPTCPTransport::init(const NamedList& params, bool first, Thread::Prio
     Debug(&plugin,DebugAll,
 	"Transport(%s) initialized maxpkt=%u rtp_localip=%s nat_address=%s tcp_idle=%u [%p]",
 	m_id.c_str(),m_maxpkt,m_rtpLocalAddr.c_str(),m_rtpNatAddr.c_str(),m_idleInterval,this);
+    // Incoming connections are multiplexed by reactors when available
     if (ok && first)
-	ok = startWorker(prio);
+	ok = (!m_outgoing && YateSIPTCPReactor::attachPool(this)) || startWorker(prio);
     return ok;
 }
 
@@ -3250,6 +3346,8 @@ bool YateSIPTCPTransport::send(SIPEvent* event)
     Debug(&plugin,DebugAll,"Transport(%s) enqueued (%p,%s) [%p]",
 	m_id.c_str(),msg,tmp.c_str(),this);
 #endif
+    if (m_reactor)
+	m_reactor->wake(this);
     return true;
 }
 
@@ -3359,6 +3457,10 @@ void YateSIPTCPTransport::statusChanged()
 	m_queue.clear();
 	m_sent = -1;
     }
+    YateSIPTCPReactor* reactor = (m_status >= Terminating) ? m_reactor : 0;
+    lock.drop();
+    if (reactor)
+	reactor->detach(this);
 }
 
 // Reset transport's party
@@ -3764,6 +3866,13 @@ void YateSIPTCPTransport::setIdleTimeout(u_int64_t time)
 	m_id.c_str(),(unsigned int)(m_idleTimeout / 1000000),this);
 }
 
+u_int64_t YateSIPTCPTransport::reactorTimeout(u_int64_t now, int wait)
+{
+    if (s_engineHalt || m_keepAlivePending || m_idleTimeout <= now)
+	return now + wait;
+    return m_idleTimeout;
+}
+
 bool YateSIPTCPTransport::sendKeepAlive(bool request)
 {
     XDebug(&plugin,DebugAll,"Transport(%s) sending keep alive%s [%p]",
@@ -3841,6 +3950,345 @@ void YateSIPTransportWorker::cleanupTransport(bool final, bool terminate)
 }
 
 
+static ObjList s_reactors;                // TCP reactors
+static Mutex s_reactorsMutex(false,"YSIPReactors");
+
+YateSIPTCPReactor::YateSIPTCPReactor(unsigned int index, Thread::Priority prio)
+    : Thread("YSIP Reactor",prio),
+    m_mutex(false,"YSIPReactor"), m_index(index), m_poll(-1), m_wake(-1),
+    m_wheel(0), m_tick(0), m_count(0), m_processed(0)
+{
+#ifdef HAVE_EPOLL
+    m_poll = ::epoll_create1(EPOLL_CLOEXEC);
+    m_wake = ::eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC);
+    if (valid()) {
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = 0;
+	if (::epoll_ctl(m_poll,EPOLL_CTL_ADD,m_wake,&ev)) {
+	    ::close(m_wake);
+	    m_wake = -1;
+	}
+    }
+    if (!valid())
+	Debug(&plugin,DebugWarn,"Reactor(%u) failed to create descriptors: %d [%p]",
+	    m_index,errno,this);
+#endif
+    m_wheel = new ObjList[REACTOR_SLOTS];
+}
+
+YateSIPTCPReactor::~YateSIPTCPReactor()
+{
+#ifdef HAVE_EPOLL
+    if (m_wake >= 0)
+	::close(m_wake);
+    if (m_poll >= 0)
+	::close(m_poll);
+#endif
+    delete[] m_wheel;
+}
+
+// Start handling a transport
+bool YateSIPTCPReactor::attach(YateSIPTCPTransport* trans)
+{
+#ifdef HAVE_EPOLL
+    if (!(trans && valid()))
+	return false;
+    Lock lck(trans);
+    if (!(trans->m_sock && trans->m_sock->valid()) || trans->m_reactor)
+	return false;
+    m_mutex.lock();
+    trans->m_reactorListed = true;
+    trans->m_reactorDetach = false;
+    trans->m_reactorEvents = EPOLLIN;
+    m_transports.append(trans)->setDelete(false);
+    m_count++;
+    m_mutex.unlock();
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = trans;
+    if (::epoll_ctl(m_poll,EPOLL_CTL_ADD,trans->m_sock->handle(),&ev)) {
+	Debug(&plugin,DebugWarn,"Reactor(%u) failed to watch transport %s: %d [%p]",
+	    m_index,trans->toString().c_str(),errno,this);
+	Lock mylock(m_mutex);
+	trans->m_reactorListed = false;
+	m_transports.remove(trans,false);
+	m_count--;
+	return false;
+    }
+    trans->m_reactor = this;
+    lck.drop();
+    DDebug(&plugin,DebugAll,"Reactor(%u) handling transport %s [%p]",
+	m_index,trans->toString().c_str(),this);
+    // Process it now, the connection may already have data
+    wake(trans);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Called from other threads, the transport is dropped by the reactor thread
+void YateSIPTCPReactor::detach(YateSIPTCPTransport* trans)
+{
+    Lock lck(m_mutex);
+    if (!trans->m_reactorListed)
+	return;
+    trans->m_reactorDetach = true;
+    lck.drop();
+    wake(trans);
+}
+
+void YateSIPTCPReactor::wake(YateSIPTCPTransport* trans)
+{
+    m_mutex.lock();
+    bool first = !m_ready.skipNull();
+    ready(trans);
+    m_mutex.unlock();
+#ifdef HAVE_EPOLL
+    // no need to signal if the reactor was already going to process something
+    if (first) {
+	u_int64_t val = 1;
+	if (::write(m_wake,&val,sizeof(val)) < 0)
+	    DDebug(&plugin,DebugMild,"Reactor(%u) wake failed: %d [%p]",m_index,errno,this);
+    }
+#endif
+}
+
+// Queue a transport for processing, must be called with the mutex locked
+void YateSIPTCPReactor::ready(YateSIPTCPTransport* trans)
+{
+    if (trans->m_reactorReady || !trans->m_reactorListed)
+	return;
+    trans->m_reactorReady = true;
+    m_ready.append(trans)->setDelete(false);
+}
+
+// Put a transport in the timer wheel slot of its timeout
+void YateSIPTCPReactor::schedule(YateSIPTCPTransport* trans, u_int64_t when)
+{
+    Lock lck(m_mutex);
+    if (trans->m_reactorSlot >= 0) {
+	m_wheel[trans->m_reactorSlot].remove(trans,false);
+	trans->m_reactorSlot = -1;
+    }
+    if (!trans->m_reactorListed)
+	return;
+    trans->m_reactorTime = when;
+    u_int64_t tick = when / REACTOR_TICK;
+    if (tick < m_tick)
+	tick = m_tick;
+    trans->m_reactorSlot = (int)(tick % REACTOR_SLOTS);
+    m_wheel[trans->m_reactorSlot].append(trans)->setDelete(false);
+}
+
+// Move transports whose timeout has expired to the ready list
+// Must be called with the mutex locked
+void YateSIPTCPReactor::expireTimers(u_int64_t time)
+{
+    u_int64_t tick = time / REACTOR_TICK;
+    unsigned int slots = REACTOR_SLOTS;
+    if (tick - m_tick < slots)
+	slots = (unsigned int)(tick - m_tick) + 1;
+    for (unsigned int i = 0; i < slots; i++) {
+	ObjList* l = &m_wheel[(m_tick + i) % REACTOR_SLOTS];
+	while (l) {
+	    YateSIPTCPTransport* t = static_cast<YateSIPTCPTransport*>(l->get());
+	    // entries due in a later turn of the wheel stay where they are
+	    if (!t || (t->m_reactorTime > time)) {
+		l = l->next();
+		continue;
+	    }
+	    t->m_reactorSlot = -1;
+	    l->remove(false);
+	    ready(t);
+	}
+    }
+    m_tick = tick;
+}
+
+// Update the socket events we wait for: stop reading while the peer is not
+//  taking the data we send, wait for writing while data is pending
+void YateSIPTCPReactor::watch(YateSIPTCPTransport* trans)
+{
+#ifdef HAVE_EPOLL
+    Lock lck(trans);
+    if (!(trans->m_sock && trans->m_sock->valid()))
+	return;
+    bool pending = trans->m_keepAlivePending || trans->m_queue.skipNull();
+    bool congested = pending && (trans->m_queue.count() > REACTOR_QUEUE_MAX);
+    unsigned int events = (congested ? 0 : EPOLLIN) | (pending ? EPOLLOUT : 0);
+    if (events == trans->m_reactorEvents)
+	return;
+    if (congested != !(trans->m_reactorEvents & EPOLLIN))
+	Debug(&plugin,congested ? DebugMild : DebugInfo,"Transport(%s) %s reading, %u messages waiting to be sent [%p]",
+	    trans->toString().c_str(),congested ? "paused" : "resumed",trans->m_queue.count(),trans);
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = trans;
+    if (!::epoll_ctl(m_poll,EPOLL_CTL_MOD,trans->m_sock->handle(),&ev))
+	trans->m_reactorEvents = events;
+#endif
+}
+
+// Drop a transport from the reactor thread, terminate it and release its reference
+void YateSIPTCPReactor::remove(YateSIPTCPTransport* trans)
+{
+    trans->lock();
+    trans->m_reactor = 0;
+#ifdef HAVE_EPOLL
+    // a closed socket was already removed from the set by the system
+    if (trans->m_sock && trans->m_sock->valid()) {
+	struct epoll_event ev;
+	::epoll_ctl(m_poll,EPOLL_CTL_DEL,trans->m_sock->handle(),&ev);
+    }
+#endif
+    trans->unlock();
+    m_mutex.lock();
+    trans->m_reactorListed = false;
+    if (trans->m_reactorReady) {
+	m_ready.remove(trans,false);
+	trans->m_reactorReady = false;
+    }
+    if (trans->m_reactorSlot >= 0) {
+	m_wheel[trans->m_reactorSlot].remove(trans,false);
+	trans->m_reactorSlot = -1;
+    }
+    if (m_transports.remove(trans,false))
+	m_count--;
+    m_mutex.unlock();
+    DDebug(&plugin,DebugAll,"Reactor(%u) released transport %s [%p]",
+	m_index,trans->toString().c_str(),this);
+    trans->terminate();
+    trans->deref();
+}
+
+void YateSIPTCPReactor::run()
+{
+    DDebug(&plugin,DebugAll,"Reactor(%u) started [%p]",m_index,this);
+#ifdef HAVE_EPOLL
+    struct epoll_event ev[REACTOR_EVENTS];
+    ObjList list;
+    while (!Thread::check(false)) {
+	m_mutex.lock();
+	int wait = m_ready.skipNull() ? 0 : (REACTOR_TICK / 1000);
+	bool empty = !m_count;
+	m_mutex.unlock();
+	// be responsive to thread cancellation while exiting
+	if (Engine::exiting()) {
+	    if (empty)
+		break;
+	    if (wait > (int)Thread::idleMsec())
+		wait = Thread::idleMsec();
+	}
+	int n = ::epoll_wait(m_poll,ev,REACTOR_EVENTS,wait);
+	if (n < 0) {
+	    if (errno != EINTR)
+		Debug(&plugin,DebugWarn,"Reactor(%u) wait failed: %d [%p]",m_index,errno,this);
+	    n = 0;
+	}
+	Time now;
+	m_mutex.lock();
+	for (int i = 0; i < n; i++) {
+	    YateSIPTCPTransport* t = static_cast<YateSIPTCPTransport*>(ev[i].data.ptr);
+	    if (t)
+		ready(t);
+	    else {
+		u_int64_t val = 0;
+		while (::read(m_wake,&val,sizeof(val)) > 0)
+		    ;
+	    }
+	}
+	expireTimers(now);
+	// take the ready transports, the ones woken meanwhile go to the next round
+	while (GenObject* o = m_ready.remove(false)) {
+	    static_cast<YateSIPTCPTransport*>(o)->m_reactorReady = false;
+	    list.append(o)->setDelete(false);
+	}
+	m_mutex.unlock();
+	while (YateSIPTCPTransport* t = static_cast<YateSIPTCPTransport*>(list.remove(false))) {
+	    if (t->m_reactorDetach) {
+		remove(t);
+		continue;
+	    }
+	    // keep the transport alive while calling its method
+	    RefPointer<YateSIPTCPTransport> trans = t;
+	    int res = t->process();
+	    m_processed++;
+	    if (res < 0) {
+		remove(t);
+		continue;
+	    }
+	    watch(t);
+	    if (!res) {
+		Lock lck(m_mutex);
+		ready(t);
+	    }
+	    else
+		schedule(t,t->reactorTimeout(now,res));
+	}
+    }
+#endif
+    DDebug(&plugin,DebugAll,"Reactor(%u) terminated [%p]",m_index,this);
+}
+
+// Release all transports when the thread ends
+void YateSIPTCPReactor::cleanup()
+{
+    s_reactorsMutex.lock();
+    s_reactors.remove(this,false);
+    s_reactorsMutex.unlock();
+    while (true) {
+	m_mutex.lock();
+	YateSIPTCPTransport* t = static_cast<YateSIPTCPTransport*>(m_transports.get());
+	m_mutex.unlock();
+	if (!t)
+	    break;
+	remove(t);
+    }
+}
+
+void YateSIPTCPReactor::status(String& buf)
+{
+    Lock lck(m_mutex);
+    buf.append(String(m_index),",") << "=" << m_count << "|" << m_processed;
+}
+
+// Start the reactors, the pool never shrinks
+void YateSIPTCPReactor::startPool(unsigned int count, Thread::Priority prio)
+{
+#ifdef HAVE_EPOLL
+    Lock lck(s_reactorsMutex);
+    for (unsigned int i = s_reactors.count(); i < count; i++) {
+	YateSIPTCPReactor* r = new YateSIPTCPReactor(i + 1,prio);
+	if (!(r->valid() && r->startup())) {
+	    delete r;
+	    break;
+	}
+	s_reactors.append(r)->setDelete(false);
+    }
+#endif
+}
+
+bool YateSIPTCPReactor::attachPool(YateSIPTCPTransport* trans)
+{
+    Lock lck(s_reactorsMutex);
+    YateSIPTCPReactor* best = 0;
+    for (ObjList* o = s_reactors.skipNull(); o; o = o->skipNext()) {
+	YateSIPTCPReactor* r = static_cast<YateSIPTCPReactor*>(o->get());
+	if (!best || r->count() < best->count())
+	    best = r;
+    }
+    return best && best->attach(trans);
+}
+
+unsigned int YateSIPTCPReactor::poolCount()
+{
+    Lock lck(s_reactorsMutex);
+    return s_reactors.count();
+}
+
+
 YateSIPTCPListener::YateSIPTCPListener(int proto, const String& name, const NamedList& params)
     : Thread("YSIP Listener",Thread::priority(params.getValue("thread"))),
     ProtocolHolder(proto),
@@ -8627,7 +9075,7 @@ bool SIPDriver::msgExecute(Message& msg, String& dest)
 SIPDriver::SIPDriver()
     : Driver("sip","varchans"), 
       m_parser("sip","SIP Call"),
-      m_endpoint(0)
+      m_endpoint(0), m_statusTime(0), m_statusEvents(0), m_statusRate(0)
 {
     Output("Loaded module SIP Channel");
     m_parser.debugChain(this);
@@ -8716,6 +9164,7 @@ void SIPDriver::initialize()
 	    return;
 	}
 	m_endpoint->startup();
+	YateSIPTCPReactor::startPool(s_cfg.getIntValue("general","tcp_reactors",2,0,64),prio);
 	setup();
 	installRelay(Halt);
 	installRelay(Progress);
@@ -8823,6 +9272,7 @@ bool SIPDriver::commandComplete(Message& msg, const String& partLine, const Stri
 	itemComplete(msg.retValue(),YSTRING("accounts"),partWord);
 	itemComplete(msg.retValue(),YSTRING("listeners"),partWord);
 	itemComplete(msg.retValue(),YSTRING("transports"),partWord);
+	itemComplete(msg.retValue(),YSTRING("reactors"),partWord);
     }
     String cmdTrans = cmd + " transports";
     String cmdOverViewTrans = overviewCmd + " transports";
@@ -8869,7 +9319,30 @@ void SIPDriver::msgStatus(Message& msg)
 	}
 	else if (str.startSkip("listeners"))
 	    msgStatusListener(msg);
+	else if (str.startSkip("reactors"))
+	    msgStatusReactors(msg);
+    }
+}
+
+void SIPDriver::statusParams(String& str)
+{
+    Driver::statusParams(str);
+    YateSIPEngine* engine = m_endpoint ? m_endpoint->engine() : 0;
+    if (!engine)
+	return;
+    // status is also built for module updates, keep the rate over at least 1s
+    u_int64_t now = Time::now();
+    u_int64_t events = engine->eventCount();
+    if (now >= m_statusTime + 1000000) {
+	if (m_statusTime)
+	    m_statusRate = (unsigned int)((events - m_statusEvents) * 1000000 / (now - m_statusTime));
+	m_statusTime = now;
+	m_statusEvents = events;
     }
+    str << ",transactions=" << engine->transactionCount();
+    str << ",events=" << events << ",eventrate=" << m_statusRate;
+    str << ",scans=" << engine->scanCount();
+    str << ",reactors=" << YateSIPTCPReactor::poolCount();
 }
 
 // Build and dispatch a socket.ssl message
@@ -9120,6 +9593,28 @@ void SIPDriver::msgStatusListener(Message& msg)
     msg.retValue() << "\r\n";
 }
 
+// Add TCP reactors status
+void SIPDriver::msgStatusReactors(Message& msg)
+{
+    msg.retValue().clear();
+    msg.retValue() << "module=" << name();
+    msg.retValue() << ",protocol=SIP";
+    msg.retValue() << ",format=Transports|Processed;";
+    String buf;
+    unsigned int n = 0;
+    bool details = msg.getBoolValue("details",true);
+    Lock lock(s_reactorsMutex);
+    for (ObjList* o = s_reactors.skipNull(); o; o = o->skipNext()) {
+	n++;
+	if (details)
+	    static_cast<YateSIPTCPReactor*>(o->get())->status(buf);
+    }
+    lock.drop();
+    msg.retValue() << "reactors=" << n;
+    msg.retValue().append(buf,";");
+    msg.retValue() << "\r\n";
+}
+
 // Add transport status
 void SIPDriver::msgStatusTransport(Message& msg, const String& id)
 {
@@ -624,6 +624,22 @@ public:
      */
     static void enableOutput(bool enable = true, bool colorize = false);
 
+    /**
+     * Enable or disable writing the debug output from a separate thread.
+     * Each thread queues its messages in its own buffer without locking,
+     *  messages that do not fit in the buffer are dropped and counted.
+     * Messages of level DebugFail are always written at once
+     * @param size Size in bytes of each thread's buffer, zero to write directly
+     * @return True if the output mode was set, false if not supported
+     */
+    static bool setAsync(unsigned int size);
+
+    /**
+     * Retrieve the number of debug messages lost because a buffer was full
+     * @return Count of dropped messages since the engine started
+     */
+    static unsigned int dropped();
+
     /**
      * Retrieve the format of timestamps
      * @return The current formatting type for timestamps
@@ -1948,6 +1964,26 @@ public:
      */
     void clear();
 
+    /**
+     * Make room for a string of a given length so appending up to it will
+     *  not allocate memory again. On an empty string the memory is allocated
+     *  by the first append.
+     * @param len Length of the string to make room for, without the terminator
+     */
+    void reserve(unsigned int len);
+
+    /**
+     * Release the memory reserved but not used by the string
+     */
+    void shrink();
+
+    /**
+     * Get the length the string can grow to without allocating memory
+     * @return Capacity of the string, at least its length
+     */
+    inline unsigned int capacity() const
+	{ return (m_string && (m_capacity > m_length)) ? m_capacity : m_length; }
+
     /**
      * Extract the caracter at a given index
      * @param index Index of character in string
@@ -2615,6 +2651,8 @@ private:
     void clearMatches();
     char* m_string;
     unsigned int m_length;
+    // Allocated length if above m_length, reserved length if m_string is NULL
+    unsigned int m_capacity;
     // I hope every C++ compiler now knows about mutable...
     mutable unsigned int m_hash;
     StringMatchPrivate* m_matches;
@@ -3669,6 +3707,26 @@ public:
      */
     void truncate(unsigned int len);
 
+    /**
+     * Make room for data of a given length so appending up to it will
+     *  not allocate memory again. On an empty block the memory is allocated
+     *  by the first append.
+     * @param len Length of the data to make room for
+     */
+    void reserve(unsigned int len);
+
+    /**
+     * Release the memory reserved but not used by the data
+     */
+    void shrink();
+
+    /**
+     * Get the length the data can grow to without allocating memory
+     * @return Capacity of the block, at least its length
+     */
+    inline unsigned int capacity() const
+	{ return m_data ? m_capacity : 0; }
+
     /**
      * Cut off a number of bytes from the data block
      * @param len Amount to cut, positive to cut from end, negative to cut from start of block
@@ -3759,8 +3817,12 @@ public:
     String sqlEscape(char extraEsc) const;
 
 private:
+    void appendData(const void* value, unsigned int len);
+    void assignData(const void* value, unsigned int len);
     void* m_data;
     unsigned int m_length;
+    // Allocated length if m_data is set, reserved length otherwise
+    unsigned int m_capacity;
 };
 
 /**
@@ -4298,6 +4360,11 @@ public:
      */
     NamedList(const char* name, const NamedList& original, const String& prefix);
 
+    /**
+     * Destructor, releases the parameter index
+     */
+    virtual ~NamedList();
+
     /**
      * Assignment operator
      * @param value New name and parameters to assign
@@ -4324,13 +4391,13 @@ public:
      * @return Count of existing named strings
      */
     inline unsigned int count() const
-	{ return m_params.count(); }
+	{ return (m_count >= 0) ? (unsigned int)m_count : recount(); }
 
     /**
      * Clear all parameters
      */
     inline void clearParams()
-	{ m_params.clear(); }
+	{ clearIndex(); m_params.clear(); m_last = 0; m_count = 0; }
 
     /**
      * Add a named string to the parameter list.
@@ -4355,8 +4422,11 @@ public:
      */
     inline NamedList& setParam(NamedString* param)
     {
-	if (param)
+	if (param) {
+	    clearIndex();
+	    m_count = -1;
 	    m_params.setUnique(param);
+	}
 	return *this;
     }
 
@@ -4452,6 +4522,8 @@ public:
 
     /**
      * Locate a named string in the parameter list.
+     * Long lists build a hash index on the first lookup that scans many
+     *  parameters, later lookups don't compare the name with each of them.
      * @param name Name of parameter to locate
      * @return A pointer to the named string or NULL.
      */
@@ -4526,6 +4598,16 @@ public:
      */
     int replaceParams(String& str, bool sqlEsc = false, char extraEsc = 0) const;
 
+    /**
+     * Copy the parameters referenced as ${paramname} in a String to another list
+     * @param str String holding the parameter references
+     * @param dest List to which the referenced parameters are added, the ones
+     *  missing from this list are skipped
+     * @param reserved Optional null terminated array of names that cannot be referenced
+     * @return Number of references found, -1 on a syntax error or reserved name
+     */
+    int collectParams(const String& str, NamedList& dest, const char* const* reserved = 0) const;
+
     /**
      * Dumps the name and all parameters to a string in a human readable format.
      * No escaping takes place so this method should be used for debugging only
@@ -4543,11 +4625,14 @@ public:
     static const NamedList& empty();
 
     /**
-     * Get the parameters list
+     * Get the parameters list.
+     * The lookup index and cached list end are discarded as the list may be
+     *  changed directly. Don't add or remove parameters through the returned
+     *  pointer after looking up or adding other parameters by name.
      * @return Pointer to the parameters list
      */
     inline ObjList* paramList()
-	{ return &m_params; }
+	{ clearIndex(); m_last = 0; m_count = -1; return &m_params; }
 
     /**
      * Get the parameters list
@@ -4558,7 +4643,16 @@ public:
 
 private:
     NamedList(); // no default constructor please
+    void clearIndex();
+    void indexParam(NamedString* param);
+    void unindexParam(NamedString* param);
+    void buildIndex() const;
+    unsigned int recount() const;
+    ObjList* tail();
     ObjList m_params;
+    mutable HashList* m_index;
+    ObjList* m_last;
+    mutable int m_count;
 };
 
 /**
@@ -6828,6 +6922,19 @@ public:
     inline int sendTo(const void* buffer, int length, const SocketAddr& addr, int flags = 0)
 	{ return sendTo(buffer, length, addr.address(), addr.length(), flags); }
 
+    /**
+     * Send several messages over a connected or unconnected socket.
+     * Uses a single system call for a batch of messages where supported
+     * @param buffers Array of buffers holding the messages
+     * @param lengths Array holding the length of each message
+     * @param addrs Array of addresses to send each message to, NULL to send on a connected socket
+     * @param count Number of messages in the arrays
+     * @param flags Operating system specific bit flags that change the behaviour
+     * @return Number of messages sent, @ref socketError() if an error occurred before sending any
+     */
+    virtual int sendMany(const void* const* buffers, const int* lengths, const SocketAddr* addrs,
+	int count, int flags = 0);
+
     /**
      * Send a message over a connected socket
      * @param buffer Buffer for data transfer
@@ -6866,6 +6973,20 @@ public:
      */
     int recvFrom(void* buffer, int length, SocketAddr& addr, int flags = 0);
 
+    /**
+     * Receive several messages from a connected or unconnected socket.
+     * Uses a single system call for a batch of messages where supported,
+     *  fewer messages than requested may be returned even if more are pending.
+     * Messages consumed by a socket filter are reported with a length of @ref socketError()
+     * @param buffers Array of buffers for data transfer
+     * @param lengths Array holding the length of each buffer on input, length of each message on return
+     * @param addrs Array of addresses to fill in with the source of each message, may be NULL
+     * @param count Number of entries in the arrays
+     * @param flags Operating system specific bit flags that change the behaviour
+     * @return Number of messages received, @ref socketError() if an error occurred
+     */
+    virtual int recvMany(void* const* buffers, int* lengths, SocketAddr* addrs, int count, int flags = 0);
+
     /**
      * Receive a message from a connected socket
      * @param buffer Buffer for data transfer
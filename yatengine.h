@@ -287,6 +287,7 @@ private:
 };
 
 class MessageDispatcher;
+class MessageHandlerIndex;
 class MessageRelay;
 class Engine;
 
@@ -460,6 +461,7 @@ private:
     RefObject* m_data;
     bool m_notify;
     bool m_broadcast;
+    u_int64_t m_queued;
     void commonEncode(String& str) const;
     int commonDecode(const char* str, int offs);
 };
@@ -715,13 +717,17 @@ public:
      *  called and the return value is true if any handler returned true.
      * Note that in some cases when a handler is removed from the list
      *  other handlers with equal priority may be called twice.
+     * Handlers are looked up in an index by message name that is rebuilt
+     *  only after the list of installed handlers changes.
      * @param msg The message to dispatch
      * @return True if one handler accepted it, false if all ignored
      */
     bool dispatch(Message& msg);
 
     /**
-     * Put a message in the waiting queue for asynchronous dispatching
+     * Put a message in the waiting queue for asynchronous dispatching.
+     * The queue is protected by its own mutex so enqueueing does not wait
+     *  for handlers being installed or messages being dispatched.
      * @param msg The message to enqueue, will be destroyed after dispatching
      * @return True if successfully queued, false otherwise
      */
@@ -738,6 +744,13 @@ public:
      */
     bool dequeueOne();
 
+    /**
+     * Dispatch one message from the waiting queue
+     * @param waited Set to the time in microseconds the message spent in queue
+     * @return True if success, false if the queue is empty
+     */
+    bool dequeueOne(u_int64_t& waited);
+
     /**
      * Set a limit to generate warning when a message took too long to dispatch
      * @param usec Warning time limit in microseconds, zero to disable
@@ -749,7 +762,7 @@ public:
      * Clear all the message handlers and post-dispatch hooks
      */
     inline void clear()
-	{ m_handlers.clear(); m_hookAppend = &m_hooks; m_hooks.clear(); }
+	{ m_handlers.clear(); m_changes++; m_hookAppend = &m_hooks; m_hooks.clear(); }
 
     /**
      * Get the number of messages waiting in the queue
@@ -785,14 +798,18 @@ protected:
 	{ m_trackParam = paramName; }
 
 private:
+    MessageHandlerIndex* handlerIndex();
     ObjList m_handlers;
     ObjList m_messages;
     ObjList m_hooks;
     Mutex m_hookMutex;
+    Mutex m_msgMutex;
     ObjList* m_msgAppend;
     ObjList* m_hookAppend;
+    MessageHandlerIndex* m_index;
     String m_trackParam;
     unsigned int m_changes;
+    unsigned int m_msgCount;
     u_int64_t m_warnTime;
     int m_hookCount;
     bool m_hookHole;
@@ -860,6 +877,14 @@ public:
      */
     bool dequeue();
 
+    /**
+     * Wait until a message is enqueued or a timeout expires
+     * @param maxwait Time in microseconds to wait, -1 wait forever
+     * @return True if a message was possibly enqueued, false on timeout
+     */
+    inline bool wait(long maxwait = -1)
+	{ return m_wakeup.lock(maxwait); }
+
     /**
      * Add a new filter to this queue
      * @param name The filter name
@@ -919,6 +944,7 @@ private:
     ObjList m_workers;
     ObjList* m_append;
     unsigned int m_count;
+    Semaphore m_wakeup;
 };
 
 
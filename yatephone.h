@@ -390,6 +390,7 @@ class DataSource;
 class DataTranslator;
 class TranslatorFactory;
 class ThreadedSourcePrivate;
+class MediaClock;
 
 /**
  * A data consumer
@@ -568,12 +569,15 @@ private:
 };
 
 /**
- * A data source with a thread of its own
+ * A data source with a thread of its own.
+ * Sources that implement @ref tick() can instead be scheduled on a small
+ *  pool of shared media clock threads by calling @ref schedule()
  * @short Data source with own thread
  */
 class YATE_API ThreadedSource : public DataSource
 {
     friend class ThreadedSourcePrivate;
+    friend class MediaClock;
 public:
     /**
      * The destruction notification, checks that the thread is gone
@@ -589,19 +593,29 @@ public:
     bool start(const char* name = "ThreadedSource", Thread::Priority prio = Thread::Normal);
 
     /**
-     * Stops and destroys the worker thread if running
+     * Schedules the source on a shared media clock thread that periodically
+     *  calls @ref tick() instead of starting a thread of its own
+     * @param msec Interval between calls in milliseconds, rounded up to the clock period
+     * @param prio Priority of the shared clock thread
+     * @return True if scheduled, false if an error occured
+     */
+    bool schedule(unsigned int msec = 20, Thread::Priority prio = Thread::Normal);
+
+    /**
+     * Stops and destroys the worker thread if running or removes the source
+     *  from its shared clock
      */
     void stop();
 
     /**
      * Return a pointer to the worker thread
-     * @return Pointer to running worker thread or NULL
+     * @return Pointer to running worker thread or shared clock thread, NULL if none
      */
     Thread* thread() const;
 
     /**
      * Check if the data thread is running
-     * @return True if the data thread was started and is running
+     * @return True if the data thread was started and is running or the source is scheduled
      */
     bool running() const;
 
@@ -611,7 +625,7 @@ protected:
      * @param format Name of the data format, default "slin" (Signed Linear)
      */
     inline explicit ThreadedSource(const char* format = "slin")
-	: DataSource(format), m_thread(0)
+	: DataSource(format), m_thread(0), m_clock(0)
 	{ }
 
     /**
@@ -619,6 +633,15 @@ protected:
      */
     virtual void run() = 0;
 
+    /**
+     * The cooperative worker method, called periodically from a shared clock
+     *  thread after @ref schedule(). It must return quickly and never sleep.
+     * Default implementation returns false
+     * @param when Scheduled time of the current clock tick
+     * @return True to keep being called, false to stop and clean up
+     */
+    virtual bool tick(const Time& when);
+
     /**
      * The cleanup after thread method, deletes the source if already
      *  dereferenced and set for asynchronous deletion
@@ -634,6 +657,7 @@ protected:
 
 private:
     ThreadedSourcePrivate* m_thread;
+    MediaClock* m_clock;
 };
 
 /**
@@ -1619,6 +1643,7 @@ class YATE_API Channel : public CallEndpoint, public DebugEnabler, public Messag
 {
     friend class Driver;
     friend class Router;
+    friend class RouteJob;
     YNOCOPY(Channel); // no automatic copies please
 private:
     NamedList m_parameters;
@@ -1628,6 +1653,8 @@ private:
     u_int64_t m_maxcall;
     u_int64_t m_maxPDD;          // Timeout while waiting for some progress on outgoing calls
     u_int64_t m_dtmfTime;
+    u_int64_t m_timerTime;       // Time the channel is filed for in the driver's timer wheel
+    int m_timerSlot;
     unsigned int m_toutAns;
     unsigned int m_dtmfSeq;
     String m_dtmfText;
@@ -1781,12 +1808,21 @@ public:
     virtual bool msgControl(Message& msg);
 
     /**
-     * Timer check method, by default handles channel timeouts
+     * Timer check method, by default handles channel timeouts.
+     * It is called by the driver only when the time returned by nextTimer() has passed
      * @param msg Timer message
      * @param tmr Current time against which timers are compared
      */
     virtual void checkTimers(Message& msg, const Time& tmr);
 
+    /**
+     * Get the earliest time checkTimers() needs to be called.
+     * Channels that override checkTimers() to handle their own timers must
+     *  override this method too and call scheduleTimers() when they change
+     * @return Earliest of the timeout, maxcall and maxPDD times, zero if none is set
+     */
+    virtual u_int64_t nextTimer() const;
+
     /**
      * Notification on progress of prerouting incoming call
      * @param msg Notification call.preroute message just after being dispatched
@@ -1889,7 +1925,7 @@ public:
      * @param tout New timeout time or zero to disable
      */
     inline void timeout(u_int64_t tout)
-	{ m_timeout = tout; }
+	{ m_timeout = tout; scheduleTimers(); }
 
     /**
      * Get the time this channel will time out on outgoing calls
@@ -1903,7 +1939,7 @@ public:
      * @param tout New timeout time or zero to disable
      */
     inline void maxcall(u_int64_t tout)
-	{ m_maxcall = tout; }
+	{ m_maxcall = tout; scheduleTimers(); }
 
     /**
      * Set the time this channel will time out on outgoing calls
@@ -1934,7 +1970,7 @@ public:
      * @param tout New timeout time or zero to disable
      */
     inline void maxPDD(u_int64_t tout)
-	{ m_maxPDD = tout; }
+	{ m_maxPDD = tout; scheduleTimers(); }
 
     /**
      * Set the time this channel will time out while waiting for some progress
@@ -2028,6 +2064,12 @@ protected:
      */
     void dropChan();
 
+    /**
+     * Notify the parent driver that the time returned by nextTimer() may have
+     *  moved earlier so the channel is checked in time
+     */
+    void scheduleTimers();
+
     /**
      * This method is overriden to safely remove the channel from the parent
      *  driver list before actually destroying the channel.
@@ -2142,6 +2184,7 @@ private:
 class YATE_API Driver : public Module
 {
     friend class Router;
+    friend class RouteJob;
     friend class Channel;
 
 private:
@@ -2149,6 +2192,7 @@ private:
     bool m_varchan;
     String m_prefix;
     ObjList m_chans;
+    HashList m_chanIndex;
     int m_routing;
     int m_routed;
     int m_total;
@@ -2158,6 +2202,12 @@ private:
     int m_maxchans;
     int m_chanCount;
     bool m_dtmfDups;
+    ObjList* m_timerWheel;
+    u_int64_t m_timerTick;
+    int m_routeQueued;
+    unsigned int m_routePooled;
+    u_int64_t m_routeWaitTotal;
+    u_int64_t m_routeWaitMax;
 
 public:
     /**
@@ -2215,7 +2265,8 @@ public:
     virtual bool canAccept(bool routers = true);
 
     /**
-     * Check if new incoming connections can be routed
+     * Check if new incoming connections can be routed.
+     * Calls are refused when the routing thread pool queue is full
      * @return True if at least one new connection can be routed, false if not
      */
     virtual bool canRoute();
@@ -2242,7 +2293,7 @@ public:
 
     /**
      * Get the number of calls currently in the routing stage
-     * @return Number of router threads currently running
+     * @return Number of calls being routed or waiting for a routing thread
      */
     inline int routing() const
 	{ return m_routing; }
@@ -2283,6 +2334,11 @@ protected:
      */
     Driver(const char* name, const char* type = 0);
 
+    /**
+     * Destructor
+     */
+    virtual ~Driver();
+
     /**
      * This method is called to initialize the loaded module
      */
@@ -2409,10 +2465,13 @@ protected:
 
 private:
     Driver(); // no default constructor please
+    void scheduleTimer(Channel* chan);
+    void expireTimers(ObjList& due, u_int64_t time);
 };
 
 /**
- * Asynchronous call routing thread
+ * Asynchronous call routing thread.
+ * Channels use it only if the routing thread pool is disabled
  * @short Call routing thread
  */
 class YATE_API Router : public Thread